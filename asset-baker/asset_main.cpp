@@ -5,6 +5,10 @@
 
 #include <lz4.h>
 #include <chrono>
+#include <algorithm>
+#include <map>
+#include <mutex>
+#include <atomic>
 
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
@@ -13,7 +17,14 @@
 #include <asset_loader.h>
 #include <texture_asset.h>
 #include <mesh_asset.h>
+#include <mesh_optimizer.h>
 #include <material_asset.h>
+#include <asset_archive.h>
+#include <asset_dictionary.h>
+#include <asset_threadpool.h>
+
+#define XXH_INLINE_ALL
+#include <xxhash.h>
 
 #define TINYGLTF_IMPLEMENTATION
 #include <tiny_gltf.h>
@@ -34,108 +45,1134 @@ namespace fs = std::filesystem;
 using namespace assets;
 
 
+struct BakerOptions {
+	//pack every baked asset into a single archive next to the export folder
+	bool bPackArchive = false;
+
+	//train a shared lz4 dictionary per asset type and store small archive entries compressed with it
+	bool bArchiveDictionaries = false;
+
+	//lz4 levels per asset class, higher hc levels only cost bake time, decode speed stays the same
+	//meshes above 256kb are split into blocks so the runtime can decode them on several cores
+	CompressionProfile meshCompression{ CompressionMode::LZ4, 0, 256 * 1024 };
+	CompressionProfile textureCompression;
+
+	//filter meshes with the mesh codec before lz4
+	bool bMeshCodec = false;
+
+	//store meshes uncompressed in the engine vertex layout so loading them is a plain copy
+	bool bGpuReadyMeshes = false;
+
+	//store meshes with octahedral normals, 8 bit color and half float uvs, 22 bytes per vertex instead of 48
+	bool bQuantizedMeshes = false;
+
+	//weld duplicate vertices and reorder triangles and vertices for the post transform cache before packing
+	bool bOptimizeMeshes = true;
+
+	//split meshes into meshlets with bounds and normal cones, so the gpu can cull parts of a mesh
+	bool bMeshlets = true;
+
+	//levels of detail per mesh including the full one, each simplified to about half the triangles of the one before
+	uint32_t lodCount = 4;
+
+	//bake the textures of every gltf as BCn, with the format picked by the material slot that uses them
+	bool bBlockCompressedTextures = false;
+
+	//decode every baked blob again and print ratio and decode time per asset class
+	bool bCompressionReport = false;
+
+	//threads baking files, meshes and textures at the same time, 0 uses every hardware thread
+	uint32_t jobs = 1;
+
+	//ignore the bake manifest and convert everything again
+	bool bRebuild = false;
+};
+
+struct CompressionStats {
+	size_t assetCount = 0;
+	uint64_t originalBytes = 0;
+	uint64_t compressedBytes = 0;
+	double decodeMs = 0;
+};
+
+struct CompressionReport {
+	CompressionStats meshes;
+	CompressionStats textures;
+
+	//assets are recorded from every baking thread
+	std::mutex mutex;
+};
+
+//vertex counts and cache miss ratios of every optimized mesh, acmr is weighted by triangle count
+struct MeshOptimizationReport {
+	size_t meshCount = 0;
+	uint64_t triangleCount = 0;
+	uint64_t verticesBefore = 0;
+	uint64_t verticesAfter = 0;
+	double acmrBefore = 0;
+	double acmrAfter = 0;
+
+	std::mutex mutex;
+};
+
+//time spent in every stage of the texture conversion, summed over the textures baked on all threads
+struct TextureStageTimes {
+	double loadMs = 0;
+	double mipmapMs = 0;
+	double encodeMs = 0;
+	double writeMs = 0;
+};
+
+struct TextureTimeReport {
+	size_t textureCount = 0;
+	TextureStageTimes total;
+
+	std::mutex mutex;
+};
+
+//what the quantized vertex format lost on every mesh
+struct QuantizationReport {
+	std::vector<std::pair<std::string, assets::QuantizationError>> meshes;
+
+	std::mutex mutex;
+};
+
+//what a previous run baked, saved in the export folder so unchanged sources are skipped.
+//paths are relative to the asset folder for sources and to the export folder for outputs
+struct BakeManifest {
+	struct Texture {
+		std::string output;
+		std::string image;
+		TextureFormat format;
+	};
+
+	struct Scene {
+		uint64_t hash = 0;	//gltf contents and the baker options that change its outputs
+		std::map<std::string, uint64_t> dependencies;
+		std::vector<std::string> outputs;
+		std::vector<Texture> textures;
+
+		//duplicate textures its materials were pointed away from
+		std::map<std::string, std::string> textureAliases;
+	};
+
+	std::map<std::string, Scene> scenes;
+	std::map<std::string, uint64_t> textures;	//image contents, format and texture options of every .tx
+};
+
 struct ConverterState {
 	fs::path asset_path;
 	fs::path export_path;
 
+	BakerOptions options;
+	CompressionReport report;
+	MeshOptimizationReport meshReport;
+	QuantizationReport quantizationReport;
+	TextureTimeReport textureTimes;
+
+	//left empty when rebuilding, read only while baking
+	BakeManifest cache;
+
+	//null when baking on a single thread
+	std::unique_ptr<assets::ThreadPool> pool;
+
 	fs::path convert_to_export_relative(fs::path path)const;
 };
 
-bool convert_image(const fs::path& input, const fs::path& output)
+//every index writes its own output files, so the result doesnt depend on the thread count
+void parallel_for(const ConverterState& convState, size_t count, const std::function<void(size_t)>& function)
 {
-	int texWidth, texHeight, texChannels;
+	if (convState.pool)
+	{
+		convState.pool->ParallelFor(count, function);
+		return;
+	}
+	for (size_t i = 0; i < count; ++i)
+	{
+		function(i);
+	}
+}
 
-	auto pngstart = std::chrono::high_resolution_clock::now();
+bool parse_baker_options(int argc, char* argv[], BakerOptions& options)
+{
+	for (int i = 2; i < argc; i++)
+	{
+		std::string arg = argv[i];
+		if (arg == "-pak")
+		{
+			options.bPackArchive = true;
+		}
+		else if (arg == "-pak-dictionaries")
+		{
+			options.bPackArchive = true;
+			options.bArchiveDictionaries = true;
+		}
+		else if (arg == "-mesh-codec")
+		{
+			options.bMeshCodec = true;
+		}
+		else if (arg == "-bc-textures")
+		{
+			options.bBlockCompressedTextures = true;
+		}
+		else if (arg == "-mesh-gpu-ready")
+		{
+			options.bGpuReadyMeshes = true;
+		}
+		else if (arg == "-mesh-quantized")
+		{
+			options.bQuantizedMeshes = true;
+		}
+		else if (arg == "-no-mesh-optimization")
+		{
+			options.bOptimizeMeshes = false;
+		}
+		else if (arg == "-no-meshlets")
+		{
+			options.bMeshlets = false;
+		}
+		else if (arg == "-no-lods")
+		{
+			options.lodCount = 1;
+		}
+		else if (arg.rfind("-lods=", 0) == 0)
+		{
+			int lods = atoi(arg.c_str() + 6);
+			if (lods < 1 || lods > 8)
+			{
+				std::cout << "Invalid lod count " << arg.substr(6) << ", expected 1 to 8" << std::endl;
+				return false;
+			}
+			options.lodCount = static_cast<uint32_t>(lods);
+		}
+		else if (arg == "-compression-report")
+		{
+			options.bCompressionReport = true;
+		}
+		else if (arg == "-rebuild")
+		{
+			options.bRebuild = true;
+		}
+		else if (arg.rfind("-j", 0) == 0)
+		{
+			//-j, -jN or -j=N
+			std::string value = arg.substr(arg.size() > 2 && arg[2] == '=' ? 3 : 2);
+			int jobs = value.empty() ? 0 : atoi(value.c_str());
+			if (jobs < 0 || (!value.empty() && jobs == 0))
+			{
+				std::cout << "Invalid job count " << value << std::endl;
+				return false;
+			}
+			options.jobs = static_cast<uint32_t>(jobs);
+		}
+		else if (arg.rfind("-mesh-chunk-size=", 0) == 0)
+		{
+			//in kb, 0 disables chunking
+			options.meshCompression.chunkSize = static_cast<uint32_t>(std::max(0, atoi(arg.c_str() + arg.find('=') + 1))) * 1024;
+		}
+		else if (arg.rfind("-mesh-compression=", 0) == 0 || arg.rfind("-texture-compression=", 0) == 0)
+		{
+			std::string value = arg.substr(arg.find('=') + 1);
+			CompressionProfile& profile = arg[1] == 'm' ? options.meshCompression : options.textureCompression;
+			if (!parse_compression_profile(value.c_str(), profile))
+			{
+				std::cout << "Invalid compression profile " << value << ", expected none, fast, hc or hc1 to hc12" << std::endl;
+				return false;
+			}
+		}
+		else
+		{
+			std::cout << "Unknown option " << arg << std::endl;
+			return false;
+		}
+	}
 
-	stbi_uc* pixels = stbi_load(input.u8string().c_str(), &texWidth, &texHeight, &texChannels, STBI_rgb_alpha);
+	if (options.bGpuReadyMeshes && options.bQuantizedMeshes)
+	{
+		std::cout << "-mesh-gpu-ready and -mesh-quantized pick different vertex formats, use only one" << std::endl;
+		return false;
+	}
 
-	auto pngend = std::chrono::high_resolution_clock::now();
+	//applied last so the order of -mesh-codec and -mesh-compression doesnt matter
+	if (options.bMeshCodec && options.meshCompression.mode != CompressionMode::None)
+	{
+		options.meshCompression.mode = CompressionMode::MeshCodec;
+	}
+	if (options.bGpuReadyMeshes)
+	{
+		options.meshCompression.mode = CompressionMode::None;
+	}
+	return true;
+}
 
-	auto diff = pngend - pngstart;
+//simplified levels are appended after the full mesh, every one is simplified from the full mesh so its error is measured against it.
+//stops early once a level barely shrinks, that happens when most of what is left are seams and borders
+void build_baked_lods(MeshInfo& meshinfo, std::vector<Vertex_f32_PNCV>& vertices, std::vector<uint32_t>& indices, uint32_t lodCount)
+{
+	uint32_t baseCount = static_cast<uint32_t>(indices.size());
+	meshinfo.lods.push_back({ 0, baseCount, 0.f });
+
+	//levels that far off are never picked anyway
+	float maxError = meshinfo.bounds.radius * 0.25f;
+
+	for (uint32_t i = 1; i < lodCount; ++i)
+	{
+		uint32_t previousCount = meshinfo.lods.back().indexCount;
+		size_t target = (baseCount >> i) / 3 * 3;
+
+		float error = 0.f;
+		std::vector<uint32_t> lod = assets::simplify_mesh(indices.data(), baseCount, vertices[0].position, vertices.size(), sizeof(Vertex_f32_PNCV),
+			target, maxError, &error);
+		if (lod.empty() || lod.size() > previousCount * 0.8f)
+		{
+			break;
+		}
+
+		assets::optimize_vertex_cache(lod.data(), lod.size(), vertices.size());
+
+		meshinfo.lods.push_back({ static_cast<uint32_t>(indices.size()), static_cast<uint32_t>(lod.size()), error });
+		indices.insert(indices.end(), lod.begin(), lod.end());
+	}
+
+	if (meshinfo.lods.size() == 1)
+	{
+		meshinfo.lods.clear();
+	}
+}
+
+AssetFile pack_baked_mesh(MeshInfo& meshinfo, std::vector<Vertex_f32_PNCV>& vertices, std::vector<uint32_t>& indices, ConverterState& convState, const std::string& meshName)
+{
+	const BakerOptions& options = convState.options;
+
+	//ranges of the final index order, so this has to run after the mesh optimization
+	if (options.bMeshlets && !vertices.empty())
+	{
+		meshinfo.meshlets = assets::build_meshlets(indices.data(), indices.size(), vertices[0].position, vertices.size(), sizeof(Vertex_f32_PNCV));
+	}
+
+	//meshlets only cover lod 0, which stays at the start of the index buffer
+	if (options.lodCount > 1 && !indices.empty())
+	{
+		build_baked_lods(meshinfo, vertices, indices, options.lodCount);
+		meshinfo.indexBufferSize = indices.size() * sizeof(uint32_t);
+	}
+
+	//every index fits in 16 bits up to 65536 vertices, which halves the index memory of most meshes
+	std::vector<uint16_t> shortIndices;
+	char* indexData = (char*)indices.data();
+	if (vertices.size() <= 65536)
+	{
+		shortIndices.assign(indices.begin(), indices.end());
+		indexData = (char*)shortIndices.data();
+
+		meshinfo.indexSize = sizeof(uint16_t);
+		meshinfo.indexBufferSize = shortIndices.size() * sizeof(uint16_t);
+	}
+
+	//quantized last, everything above works on the full precision positions
+	if (options.bQuantizedMeshes)
+	{
+		std::vector<Vertex_P32N8C8V16> quantizedVertices(vertices.size());
+		assets::QuantizationError error = assets::pack_quantized_vertices(vertices.data(), quantizedVertices.data(), vertices.size());
+
+		{
+			std::lock_guard<std::mutex> lock(convState.quantizationReport.mutex);
+			convState.quantizationReport.meshes.push_back({ meshName, error });
+		}
+
+		meshinfo.vertexFormat = assets::VertexFormat::P32N8C8V16;
+		meshinfo.vertexBufferSize = quantizedVertices.size() * sizeof(Vertex_P32N8C8V16);
+		return assets::pack_mesh(&meshinfo, (char*)quantizedVertices.data(), indexData, options.meshCompression);
+	}
+
+	if (!options.bGpuReadyMeshes)
+	{
+		return assets::pack_mesh(&meshinfo, (char*)vertices.data(), indexData, options.meshCompression);
+	}
+
+	std::vector<Vertex_P32O8C8V32> runtimeVertices(vertices.size());
+	assets::pack_runtime_vertices(vertices.data(), runtimeVertices.data(), vertices.size());
+
+	meshinfo.vertexFormat = assets::VertexFormat::P32O8C8V32;
+	meshinfo.vertexBufferSize = runtimeVertices.size() * sizeof(Vertex_P32O8C8V32);
+	return assets::pack_mesh(&meshinfo, (char*)runtimeVertices.data(), indexData, options.meshCompression);
+}
+
+void record_mesh_compression(CompressionReport& report, MeshInfo& info, const AssetFile& file)
+{
+	std::vector<char> vertices(info.vertexBufferSize);
+	std::vector<char> indices(info.indexBufferSize);
+
+	auto start = std::chrono::high_resolution_clock::now();
+	bool decoded = assets::UnpackMesh(&info, file.binaryBlob.data(), file.binaryBlob.size(), vertices.data(), indices.data());
+	auto end = std::chrono::high_resolution_clock::now();
+
+	if (!decoded)
+	{
+		std::cout << "Failed to decode baked mesh " << info.originalFile << std::endl;
+		return;
+	}
+
+	std::lock_guard<std::mutex> lock(report.mutex);
+	CompressionStats& stats = report.meshes;
+	stats.assetCount++;
+	stats.originalBytes += info.vertexBufferSize + info.indexBufferSize;
+	stats.compressedBytes += file.binaryBlob.size();
+	stats.decodeMs += std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count() / 1000000.0;
+}
+
+void record_texture_times(TextureTimeReport& report, const TextureStageTimes& times)
+{
+	std::lock_guard<std::mutex> lock(report.mutex);
+	report.textureCount++;
+	report.total.loadMs += times.loadMs;
+	report.total.mipmapMs += times.mipmapMs;
+	report.total.encodeMs += times.encodeMs;
+	report.total.writeMs += times.writeMs;
+}
+
+void record_texture_compression(CompressionReport& report, TextureInfo& info, const AssetFile& file)
+{
+	std::vector<char> pixels(info.textureSize);
+
+	auto start = std::chrono::high_resolution_clock::now();
+	bool decoded = assets::unpack_texture(&info, file.binaryBlob.data(), file.binaryBlob.size(), pixels.data());
+	auto end = std::chrono::high_resolution_clock::now();
+
+	if (!decoded)
+	{
+		std::cout << "Failed to decode baked texture " << info.originalFile << std::endl;
+		return;
+	}
+
+	std::lock_guard<std::mutex> lock(report.mutex);
+	CompressionStats& stats = report.textures;
+	stats.assetCount++;
+	stats.originalBytes += info.textureSize;
+	stats.compressedBytes += file.binaryBlob.size();
+	stats.decodeMs += std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count() / 1000000.0;
+}
+
+//welds, then reorders for the vertex cache and last for vertex fetch, so the fetch order follows the final triangle order
+void optimize_baked_mesh(std::vector<Vertex_f32_PNCV>& vertices, std::vector<uint32_t>& indices, ConverterState& convState)
+{
+	if (!convState.options.bOptimizeMeshes || indices.empty())
+	{
+		return;
+	}
+
+	size_t verticesBefore = vertices.size();
+	float acmrBefore = assets::calculate_acmr(indices.data(), indices.size(), vertices.size());
+
+	size_t vertexCount = assets::weld_vertices(vertices.data(), vertices.size(), sizeof(Vertex_f32_PNCV), indices.data(), indices.size());
+	assets::optimize_vertex_cache(indices.data(), indices.size(), vertexCount);
+	vertexCount = assets::optimize_vertex_fetch(vertices.data(), vertexCount, sizeof(Vertex_f32_PNCV), indices.data(), indices.size());
+	vertices.resize(vertexCount);
+
+	float acmrAfter = assets::calculate_acmr(indices.data(), indices.size(), vertices.size());
+
+	MeshOptimizationReport& report = convState.meshReport;
+	size_t triangleCount = indices.size() / 3;
+
+	std::lock_guard<std::mutex> lock(report.mutex);
+	report.meshCount++;
+	report.triangleCount += triangleCount;
+	report.verticesBefore += verticesBefore;
+	report.verticesAfter += vertexCount;
+	report.acmrBefore += double(acmrBefore) * triangleCount;
+	report.acmrAfter += double(acmrAfter) * triangleCount;
+}
+
+void print_mesh_optimization_report(const MeshOptimizationReport& report)
+{
+	if (report.triangleCount == 0)
+	{
+		return;
+	}
+
+	std::cout << "optimized " << report.meshCount << " meshes, " << report.triangleCount << " triangles" << std::endl
+		<< "vertices " << report.verticesBefore << " -> " << report.verticesAfter << std::endl
+		<< "acmr " << report.acmrBefore / report.triangleCount << " -> " << report.acmrAfter / report.triangleCount
+		<< " (fifo cache of " << assets::kVertexCacheSize << ")" << std::endl;
+}
+
+//sorted by name, the meshes are recorded from every baking thread
+void print_quantization_report(QuantizationReport& report)
+{
+	if (report.meshes.empty())
+	{
+		return;
+	}
+	std::sort(report.meshes.begin(), report.meshes.end(), [](const auto& a, const auto& b) { return a.first < b.first; });
+
+	assets::QuantizationError worst{ 0.f, 0.f };
+	std::cout << "quantized meshes, max normal error in degrees and max uv error:" << std::endl;
+	for (auto& [name, error] : report.meshes)
+	{
+		std::cout << name << "," << error.normalDegrees << "," << error.uv << std::endl;
+		worst.normalDegrees = std::max(worst.normalDegrees, error.normalDegrees);
+		worst.uv = std::max(worst.uv, error.uv);
+	}
+	std::cout << "worst of " << report.meshes.size() << " meshes: normal " << worst.normalDegrees << " degrees, uv " << worst.uv << std::endl;
+}
+
+void print_compression_report(const BakerOptions& options, const CompressionReport& report)
+{
+	auto print_row = [](const char* name, const CompressionProfile& profile, const CompressionStats& stats) {
+		double ratio = stats.compressedBytes ? double(stats.originalBytes) / double(stats.compressedBytes) : 0.0;
+		double throughput = stats.decodeMs > 0 ? (stats.originalBytes / (1024.0 * 1024.0)) / (stats.decodeMs / 1000.0) : 0.0;
+
+		std::cout << name << "," << compression_profile_name(profile) << "," << stats.assetCount << ","
+			<< stats.originalBytes << "," << stats.compressedBytes << "," << ratio << ","
+			<< stats.decodeMs << "," << throughput << std::endl;
+	};
+
+	std::cout << "class,profile,assets,original_bytes,compressed_bytes,ratio,decode_ms,decode_mb_per_s" << std::endl;
+	print_row("mesh", options.meshCompression, report.meshes);
+	print_row("texture", options.textureCompression, report.textures);
+}
+
+//one dictionary per asset type that has enough small files to learn from, in type order so the archive is reproducible
+void add_archive_dictionaries(assets::ArchiveWriter& writer, const std::vector<fs::path>& files)
+{
+	constexpr size_t minSamples = 8;
+
+	std::map<std::string, std::vector<std::shared_ptr<MappedFile>>> samplesByType;
+	for (auto& f : files)
+	{
+		if (fs::file_size(f) > kDictionaryEntryMaxSize)
+		{
+			continue;
+		}
+		std::shared_ptr<MappedFile> file = MappedFile::Open(f.string().c_str());
+		if (file && file->size() >= 4)
+		{
+			samplesByType[std::string(file->data(), 4)].push_back(std::move(file));
+		}
+	}
+
+	for (auto& [type, typeFiles] : samplesByType)
+	{
+		if (typeFiles.size() < minSamples)
+		{
+			continue;
+		}
+
+		std::vector<std::string_view> samples;
+		for (auto& file : typeFiles)
+		{
+			samples.emplace_back(file->data(), file->size());
+		}
+
+		std::vector<char> dictionary = assets::train_dictionary(samples);
+		if (!dictionary.empty() && writer.AddDictionary(type.c_str(), dictionary))
+		{
+			std::cout << "trained " << dictionary.size() << " byte dictionary for " << type << " from " << samples.size() << " assets" << std::endl;
+		}
+	}
+}
+
+bool pack_export_archive(const fs::path& exportDir, const fs::path& archivePath, const BakerOptions& options)
+{
+	auto start = std::chrono::high_resolution_clock::now();
+
+	//sort so the archive layout doesnt depend on directory iteration order
+	std::vector<fs::path> files;
+	for (auto& p : fs::recursive_directory_iterator(exportDir))
+	{
+		auto ext = p.path().extension();
+		if (ext == ".mesh" || ext == ".tx" || ext == ".mat" || ext == ".pfb")
+		{
+			files.push_back(p.path());
+		}
+	}
+	std::sort(files.begin(), files.end());
+
+	assets::ArchiveWriter writer;
+	if (!writer.Open(archivePath.string().c_str()))
+	{
+		return false;
+	}
+
+	if (options.bArchiveDictionaries)
+	{
+		add_archive_dictionaries(writer, files);
+	}
+
+	for (auto& f : files)
+	{
+		std::string assetPath = f.lexically_proximate(exportDir).generic_string();
+		if (!writer.AddFile(assetPath, f.string().c_str()))
+		{
+			return false;
+		}
+	}
+
+	bool result = writer.Finish();
+
+	auto end = std::chrono::high_resolution_clock::now();
+	std::cout << "packed " << files.size() << " assets into " << archivePath << " in " << std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count() / 1000000.0 << "ms" << std::endl;
+
+	if (options.bArchiveDictionaries)
+	{
+		uint64_t inputSize = 0;
+		for (auto& f : files)
+		{
+			inputSize += fs::file_size(f);
+		}
+		std::cout << "archive is " << fs::file_size(archivePath) << " bytes for " << inputSize << " bytes of assets" << std::endl;
+	}
+
+	return result;
+}
+
+//bump whenever the baker or assetlib change what gets written for the same input, every cached output is rebaked
+static const uint32_t s_kBakeVersion = 6;
+
+static const char* s_kBakeManifestName = "bake_manifest.json";
+
+uint64_t hash_bytes(const void* data, size_t size, uint64_t seed = 0)
+{
+	return XXH64(data, size, seed);
+}
+
+uint64_t combine_hashes(uint64_t a, uint64_t b)
+{
+	uint64_t both[2] = { a, b };
+	return hash_bytes(both, sizeof(both));
+}
+
+bool hash_file(const fs::path& path, uint64_t& outHash)
+{
+	std::error_code ec;
+	if (!fs::is_regular_file(path, ec))
+	{
+		return false;
+	}
+	if (fs::file_size(path, ec) == 0)
+	{
+		outHash = hash_bytes(nullptr, 0);
+		return true;
+	}
+
+	std::shared_ptr<MappedFile> file = MappedFile::Open(path.string().c_str());
+	if (!file)
+	{
+		return false;
+	}
+	outHash = hash_bytes(file->data(), file->size());
+	return true;
+}
+
+//only the options that change what a scene writes, so toggling the report or the archive keeps the cache
+std::string scene_bake_options(const BakerOptions& options)
+{
+	return "bake" + std::to_string(s_kBakeVersion) + " asset" + std::to_string(kCurrentAssetVersion)
+		+ " mesh " + compression_profile_name(options.meshCompression) + "/" + std::to_string(options.meshCompression.chunkSize)
+		+ (options.bGpuReadyMeshes ? " gpu-ready" : "") + (options.bQuantizedMeshes ? " quantized" : "") + (options.bBlockCompressedTextures ? " bc-textures" : "")
+		+ (options.bOptimizeMeshes ? "" : " unoptimized-meshes") + (options.bMeshlets ? "" : " no-meshlets")
+		+ " lods" + std::to_string(options.lodCount);
+}
+
+std::string texture_bake_options(const BakerOptions& options)
+{
+	return "bake" + std::to_string(s_kBakeVersion) + " asset" + std::to_string(kCurrentAssetVersion)
+		+ " texture " + compression_profile_name(options.textureCompression);
+}
+
+static std::string hash_to_string(uint64_t hash)
+{
+	char buffer[17];
+	snprintf(buffer, sizeof(buffer), "%016llx", (unsigned long long)hash);
+	return buffer;
+}
+
+static uint64_t hash_from_string(const std::string& s)
+{
+	return std::strtoull(s.c_str(), nullptr, 16);
+}
+
+bool load_bake_manifest(const fs::path& path, BakeManifest& manifest)
+{
+	std::ifstream file(path);
+	if (!file.is_open())
+	{
+		return false;
+	}
+
+	nlohmann::json json = nlohmann::json::parse(file, nullptr, false);
+	if (json.is_discarded() || json.value("version", 0u) != s_kBakeVersion)
+	{
+		std::cout << "Ignoring outdated bake manifest " << path << std::endl;
+		return false;
+	}
+
+	for (auto& [key, scene] : json["scenes"].items())
+	{
+		BakeManifest::Scene& entry = manifest.scenes[key];
+		entry.hash = hash_from_string(scene["hash"]);
+		for (auto& [dependency, hash] : scene["dependencies"].items())
+		{
+			entry.dependencies[dependency] = hash_from_string(hash);
+		}
+		entry.outputs = scene["outputs"].get<std::vector<std::string>>();
+		for (auto& texture : scene["textures"])
+		{
+			entry.textures.push_back({ texture["output"], texture["image"], (TextureFormat)texture["format"].get<uint32_t>() });
+		}
+		entry.textureAliases = scene["texture_aliases"].get<std::map<std::string, std::string>>();
+	}
+	for (auto& [key, hash] : json["textures"].items())
+	{
+		manifest.textures[key] = hash_from_string(hash);
+	}
+	return true;
+}
+
+bool save_bake_manifest(const fs::path& path, const BakeManifest& manifest)
+{
+	nlohmann::json json;
+	json["version"] = s_kBakeVersion;
+	json["scenes"] = nlohmann::json::object();
+	json["textures"] = nlohmann::json::object();
+
+	for (auto& [key, scene] : manifest.scenes)
+	{
+		nlohmann::json entry;
+		entry["hash"] = hash_to_string(scene.hash);
+		entry["dependencies"] = nlohmann::json::object();
+		for (auto& [dependency, hash] : scene.dependencies)
+		{
+			entry["dependencies"][dependency] = hash_to_string(hash);
+		}
+		entry["outputs"] = scene.outputs;
+		entry["textures"] = nlohmann::json::array();
+		for (auto& texture : scene.textures)
+		{
+			entry["textures"].push_back({ {"output", texture.output}, {"image", texture.image}, {"format", (uint32_t)texture.format} });
+		}
+		entry["texture_aliases"] = scene.textureAliases;
+		json["scenes"][key] = std::move(entry);
+	}
+	for (auto& [key, hash] : manifest.textures)
+	{
+		json["textures"][key] = hash_to_string(hash);
+	}
+
+	std::ofstream file(path, std::ios::trunc);
+	file << json.dump(1);
+	return file.good();
+}
+
+//a cached scene is reused when the gltf, every buffer it reads and the options match, and all of its outputs are still there
+bool scene_up_to_date(const ConverterState& convState, const BakeManifest::Scene& scene, uint64_t sceneHash)
+{
+	if (scene.hash != sceneHash)
+	{
+		return false;
+	}
+	for (auto& [dependency, hash] : scene.dependencies)
+	{
+		uint64_t currentHash;
+		if (!hash_file(convState.asset_path / dependency, currentHash) || currentHash != hash)
+		{
+			return false;
+		}
+	}
+	for (auto& output : scene.outputs)
+	{
+		if (!fs::exists(convState.export_path / output))
+		{
+			return false;
+		}
+	}
+	return true;
+}
 
-	std::cout << "png took " << std::chrono::duration_cast<std::chrono::nanoseconds>(diff).count() / 1000000.0 << "ms"  << std::endl;
+nvtt::Format nvtt_format(TextureFormat format)
+{
+	switch (format)
+	{
+	case TextureFormat::BC1:
+		return nvtt::Format_BC1;
+	case TextureFormat::BC3:
+		return nvtt::Format_BC3;
+	case TextureFormat::BC4:
+		return nvtt::Format_BC4;
+	case TextureFormat::BC5:
+		return nvtt::Format_BC5;
+	case TextureFormat::BC7:
+		return nvtt::Format_BC7;
+	default:
+		return nvtt::Format_RGBA;
+	}
+}
+
+bool convert_image(const fs::path& input, const fs::path& output, ConverterState& convState, TextureFormat format = TextureFormat::RGBA8)
+{
+	using Clock = std::chrono::high_resolution_clock;
+	auto elapsed_ms = [](Clock::time_point start) {
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count() / 1000000.0;
+	};
+	TextureStageTimes times;
+
+	int texWidth, texHeight, texChannels;
+
+	auto loadStart = Clock::now();
+	stbi_uc* pixels = stbi_load(input.u8string().c_str(), &texWidth, &texHeight, &texChannels, STBI_rgb_alpha);
+	times.loadMs = elapsed_ms(loadStart);
 
 	if (!pixels) {
 		std::cout << "Failed to load texture file " << input << std::endl;
 		return false;
 	}
-	
-	int texture_size = texWidth * texHeight * 4;
+
+	nvtt::Surface surface;
+	surface.setImage(nvtt::InputFormat::InputFormat_BGRA_8UB, texWidth, texHeight, 1, pixels);
+
+	//the surface keeps its own copy, so from here on only the current mip and the page being written are in memory
+	stbi_image_free(pixels);
+
+	//stb gives rgba, the swapped channels cancel out on the RGBA output but the block encoders need them in place
+	if (IsBlockCompressed(format))
+	{
+		surface.swizzle(2, 1, 0, 3);
+		if (format == TextureFormat::BC3 || format == TextureFormat::BC7)
+		{
+			surface.setAlphaMode(nvtt::AlphaMode_Transparency);
+		}
+	}
 
 	TextureInfo texinfo;
-	texinfo.textureSize = texture_size;
-	
-	texinfo.textureFormat = TextureFormat::RGBA8;
+	texinfo.textureSize = 0;
+	texinfo.textureFormat = format;
 	texinfo.originalFile = input.string();
-	auto start = std::chrono::high_resolution_clock::now();
 
-	std::vector<char> all_buffer;
+	//the writer needs every page before the first one is written. nvtt halves both sides down to 1 the same way
+	uint32_t width = texWidth;
+	uint32_t height = texHeight;
+	while (width > 1 || height > 1)
+	{
+		width = std::max(1u, width / 2);
+		height = std::max(1u, height / 2);
+
+		uint32_t pageSize = static_cast<uint32_t>(assets::texture_page_size(format, width, height));
+		texinfo.pages.push_back({ width, height, 0, pageSize });
+		texinfo.textureSize += pageSize;
+	}
+
+	//nvtt hands a mip over in several writes, they are gathered into the page with bulk copies
+	struct PageHandler : nvtt::OutputHandler {
+		virtual bool writeData(const void* data, int size) {
+			const char* bytes = (const char*)data;
+			buffer.insert(buffer.end(), bytes, bytes + size);
+			return true;
+		}
+		virtual void beginImage(int size, int width, int height, int depth, int face, int miplevel) { };
+
+		// Indicate the end of the compressed image. (New in NVTT 2.1)
+		virtual void endImage() {};
+		std::vector<char> buffer;
+	};
+
+	PageHandler handler;
+	if (!texinfo.pages.empty())
+	{
+		handler.buffer.reserve(texinfo.pages[0].originalSize);
+	}
+
+	nvtt::Compressor compressor;
+	nvtt::CompressionOptions compressionOptions;
+	nvtt::OutputOptions outputOptions;
+	outputOptions.setOutputHandler(&handler);
+	compressionOptions.setFormat(nvtt_format(format));
+	compressionOptions.setPixelType(nvtt::PixelType_UnsignedNorm);
+
+	assets::TextureWriter writer;
+	if (!writer.Open(output.string().c_str(), &texinfo, convState.options.textureCompression))
+	{
+		return false;
+	}
+
+	bool bFailed = false;
+	size_t pageIndex = 0;
+	while (!bFailed && surface.canMakeNextMipmap(1))
+	{
+		auto mipStart = Clock::now();
+		surface.buildNextMipmap(nvtt::MipmapFilter_Box);
+		times.mipmapMs += elapsed_ms(mipStart);
+
+		auto encodeStart = Clock::now();
+		compressor.compress(surface, 0, 0, compressionOptions, outputOptions);
+		times.encodeMs += elapsed_ms(encodeStart);
+
+		//every page has to be whole blocks so the mips can be copied to the image as they are
+		if (pageIndex >= texinfo.pages.size() || handler.buffer.size() != texinfo.pages[pageIndex].originalSize
+			|| uint32_t(surface.width()) != texinfo.pages[pageIndex].width || uint32_t(surface.height()) != texinfo.pages[pageIndex].height)
+		{
+			std::cout << "Unexpected page size " << handler.buffer.size() << " for mip " << surface.width() << "x" << surface.height() << " of " << input << std::endl;
+			bFailed = true;
+			break;
+		}
+
+		auto writeStart = Clock::now();
+		bFailed = !writer.WritePage(handler.buffer.data());
+		times.writeMs += elapsed_ms(writeStart);
+
+		handler.buffer.clear();
+		pageIndex++;
+	}
+
+	if (bFailed || !writer.Finish())
+	{
+		std::cout << "Failed to write texture " << output << std::endl;
+		fs::remove(output);
+		return false;
+	}
+
+	std::cout << "texture " << input.filename().string() << " " << texWidth << "x" << texHeight << ": load " << times.loadMs << "ms, mipmaps " << times.mipmapMs
+		<< "ms, encode " << times.encodeMs << "ms, compress and write " << times.writeMs << "ms" << std::endl;
+	record_texture_times(convState.textureTimes, times);
+
+	//the blob only exists in the file, so the report reads it back
+	if (convState.options.bCompressionReport)
+	{
+		assets::AssetFile newImage;
+		if (assets::LoadBinaryFile(output.string().c_str(), newImage))
+		{
+			record_texture_compression(convState.report, texinfo, newImage);
+		}
+	}
+
+	return true;
+}
+
+
+//which material slots use a texture decides its block format
+enum class TextureUsage {
+	Mask,		//occlusion, BC4
+	Normal,		//BC5, only xy are kept so z has to be rebuilt when sampling
+	Emissive,	//BC1
+	Color,		//base color and packed metallic roughness, BC7
+};
+
+TextureFormat texture_usage_format(TextureUsage usage)
+{
+	switch (usage)
+	{
+	case TextureUsage::Mask:
+		return TextureFormat::BC4;
+	case TextureUsage::Normal:
+		return TextureFormat::BC5;
+	case TextureUsage::Emissive:
+		return TextureFormat::BC1;
+	default:
+		return TextureFormat::BC7;
+	}
+}
+
+struct TextureJob {
+	fs::path imagePath;
+	TextureFormat format;
+};
+
+//textures are keyed by output path, scenes that share an image folder would otherwise write the same file from two threads
+using TextureJobs = std::map<fs::path, TextureJob>;
 
-	struct DumbHandler : nvtt::OutputHandler {
-		// Output data. Compressed data is output as soon as it's generated to minimize memory allocations.
-		virtual bool writeData(const void* data, int size) {
-			for (int i = 0; i < size; i++) {
-				buffer.push_back(((char*)data)[i]);
-			}
-			return true;
+void extract_gltf_textures(tinygltf::Model& model, const fs::path& input, const fs::path& outputFolder, TextureJobs& jobs)
+{
+	//an image shared by several slots, like a packed occlusion metallic roughness map, gets the format that keeps the most channels
+	std::map<int, TextureUsage> imageUsages;
+	auto use_texture = [&](int textureIndex, TextureUsage usage) {
+		if (textureIndex < 0 || textureIndex >= (int)model.textures.size())
+		{
+			return;
+		}
+		int image = model.textures[textureIndex].source;
+		auto it = imageUsages.find(image);
+		if (it == imageUsages.end() || it->second < usage)
+		{
+			imageUsages[image] = usage;
 		}
-		virtual void beginImage(int size, int width, int height, int depth, int face, int miplevel) { };
-
-		// Indicate the end of the compressed image. (New in NVTT 2.1)
-		virtual void endImage() {};
-		std::vector<char> buffer;
 	};
 
+	for (auto& glmat : model.materials)
+	{
+		//extract_gltf_materials falls back to the first texture for the base color
+		use_texture(std::max(0, glmat.pbrMetallicRoughness.baseColorTexture.index), TextureUsage::Color);
+		use_texture(glmat.pbrMetallicRoughness.metallicRoughnessTexture.index, TextureUsage::Color);
+		use_texture(glmat.normalTexture.index, TextureUsage::Normal);
+		use_texture(glmat.occlusionTexture.index, TextureUsage::Mask);
+		use_texture(glmat.emissiveTexture.index, TextureUsage::Emissive);
+	}
 
-	
-	nvtt::Compressor compressor;
+	for (auto& [image, usage] : imageUsages)
+	{
+		if (image < 0 || image >= (int)model.images.size())
+		{
+			continue;
+		}
 
-	nvtt::CompressionOptions optiuns;
-	nvtt::OutputOptions outputOptions;
-	nvtt::Surface surface;
+		//same path the materials point at
+		fs::path imagePath = input.parent_path() / model.images[image].uri;
+		fs::path texturePath = outputFolder.parent_path() / model.images[image].uri;
+		texturePath.replace_extension(".tx");
 
-	DumbHandler handler;
-	outputOptions.setOutputHandler(&handler);
+		//the last image wins, same as when every scene converted its own textures in order
+		jobs[texturePath.lexically_normal()] = { imagePath, texture_usage_format(usage) };
+	}
+}
 
-	surface.setImage(nvtt::InputFormat::InputFormat_BGRA_8UB, texWidth, texHeight, 1, pixels);
+//export relative .tx that wasnt converted, to the one with the same image, format and options that was
+using TextureAliases = std::map<std::string, std::string>;
+
+//converts the textures whose image, format or options changed since the cached bake, every texture that is up to date afterwards goes in manifest.
+//textures made from identical images are converted once, the first in path order is kept and the others are returned as aliases
+TextureAliases convert_textures(const TextureJobs& jobs, ConverterState& convState, BakeManifest& manifest)
+{
+	auto start = std::chrono::high_resolution_clock::now();
 
+	std::vector<std::pair<fs::path, TextureJob>> ordered{ jobs.begin(), jobs.end() };
+
+	std::string options = texture_bake_options(convState.options);
+	uint64_t optionsHash = hash_bytes(options.data(), options.size());
+
+	//the conversion is deterministic, so the source hash stands in for the hash of the converted texture
+	std::vector<uint64_t> hashes(ordered.size(), 0);
+	parallel_for(convState, ordered.size(), [&](size_t i) {
+		auto& [texturePath, job] = ordered[i];
+
+		uint64_t imageHash;
+		if (!hash_file(job.imagePath, imageHash))
+		{
+			std::cout << "Failed to read image " << job.imagePath << std::endl;
+			return;
+		}
+		hashes[i] = combine_hashes(combine_hashes(imageHash, (uint64_t)job.format), optionsHash);
+	});
 
-	while (surface.canMakeNextMipmap(1))
+	TextureAliases aliases;
+	std::unordered_map<uint64_t, size_t> firstByHash;
+	std::vector<size_t> unique;
+	for (size_t i = 0; i < ordered.size(); ++i)
 	{
-		surface.buildNextMipmap(nvtt::MipmapFilter_Box);
+		if (hashes[i] == 0)
+		{
+			continue;
+		}
+		auto [it, inserted] = firstByHash.insert({ hashes[i], i });
+		if (!inserted)
+		{
+			aliases[convState.convert_to_export_relative(ordered[i].first).generic_string()] = convState.convert_to_export_relative(ordered[it->second].first).generic_string();
+			continue;
+		}
+		unique.push_back(i);
+		fs::create_directories(ordered[i].first.parent_path());
+	}
+
+	//stays false when the conversion failed, so the next run tries again
+	std::vector<char> converted(unique.size(), 0);
+	std::atomic<size_t> hits{ 0 };
 
-		optiuns.setFormat(nvtt::Format::Format_RGBA);
-		optiuns.setPixelType(nvtt::PixelType_UnsignedNorm);
+	parallel_for(convState, unique.size(), [&](size_t i) {
+		auto& [texturePath, job] = ordered[unique[i]];
+		uint64_t textureHash = hashes[unique[i]];
 
-		compressor.compress(surface, 0, 0, optiuns, outputOptions);
+		auto cached = convState.cache.textures.find(convState.convert_to_export_relative(texturePath).generic_string());
+		if (cached != convState.cache.textures.end() && cached->second == textureHash && fs::exists(texturePath))
+		{
+			hits++;
+			converted[i] = 1;
+			return;
+		}
 
-		texinfo.pages.push_back({});
-		texinfo.pages.back().width = surface.width();
-		texinfo.pages.back().height = surface.height();
-		texinfo.pages.back().originalSize = (uint32_t)handler.buffer.size();
+		converted[i] = convert_image(job.imagePath, texturePath, convState, job.format);
+	});
 
-		all_buffer.insert(all_buffer.end(), handler.buffer.begin(), handler.buffer.end());
-		handler.buffer.clear();
+	for (size_t i = 0; i < unique.size(); ++i)
+	{
+		if (converted[i])
+		{
+			manifest.textures[convState.convert_to_export_relative(ordered[unique[i]].first).generic_string()] = hashes[unique[i]];
+		}
 	}
-	
 
-	texinfo.textureSize = all_buffer.size();
-	assets::AssetFile newImage = assets::pack_texture(&texinfo, all_buffer.data());
+	auto end = std::chrono::high_resolution_clock::now();
+	std::cout << "textures: " << hits << " up to date, " << unique.size() - hits << " baked, " << aliases.size() << " duplicates in "
+		<< std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count() / 1000000.0 << "ms" << std::endl;
 
-	auto  end = std::chrono::high_resolution_clock::now();
+	//summed over threads, so with several jobs they add up to more than the time above
+	const TextureTimeReport& times = convState.textureTimes;
+	if (times.textureCount != 0)
+	{
+		std::cout << "texture stages: load " << times.total.loadMs << "ms, mipmaps " << times.total.mipmapMs << "ms, encode " << times.total.encodeMs
+			<< "ms, compress and write " << times.total.writeMs << "ms" << std::endl;
+	}
 
+	return aliases;
+}
 
+//aliases of the textures a scene asked for
+TextureAliases scene_texture_aliases(const BakeManifest::Scene& scene, const TextureAliases& aliases)
+{
+	TextureAliases sceneAliases;
+	for (auto& texture : scene.textures)
+	{
+		auto it = aliases.find(texture.output);
+		if (it != aliases.end())
+		{
+			sceneAliases.insert(*it);
+		}
+	}
+	return sceneAliases;
+}
 
-	std::cout << "compression took " << std::chrono::duration_cast<std::chrono::nanoseconds>(diff).count() / 1000000.0 << "ms" << std::endl;
-		
+//points the materials of a scene at the textures that were converted in place of their duplicates
+void alias_material_textures(const BakeManifest::Scene& scene, const TextureAliases& aliases, const ConverterState& convState)
+{
+	for (auto& output : scene.outputs)
+	{
+		fs::path materialPath = convState.export_path / output;
+		if (materialPath.extension() != ".mat")
+		{
+			continue;
+		}
 
-	stbi_image_free(pixels);
+		assets::AssetFile file;
+		if (!LoadBinaryFile(materialPath.string().c_str(), file))
+		{
+			continue;
+		}
+		assets::MaterialInfo material = assets::read_material_info(&file);
 
-	SaveBinaryFile(output.string().c_str(), newImage);
+		bool changed = false;
+		for (auto& [slot, texture] : material.textures)
+		{
+			auto it = aliases.find(fs::path(texture).lexically_normal().generic_string());
+			if (it != aliases.end())
+			{
+				//same separators as the paths extract_gltf_materials writes
+				texture = fs::path(it->second).make_preferred().string();
+				changed = true;
+			}
+		}
 
-	return true;
+		if (changed)
+		{
+			assets::AssetFile newFile = assets::pack_material(&material);
+			SaveBinaryFile(materialPath.string().c_str(), newFile);
+		}
+	}
 }
 
+//textures a cached scene asked for the last time it was baked
+void restore_scene_textures(const ConverterState& convState, const BakeManifest::Scene& scene, TextureJobs& jobs)
+{
+	for (auto& texture : scene.textures)
+	{
+		jobs[(convState.export_path / texture.output).lexically_normal()] = { convState.asset_path / texture.image, texture.format };
+	}
+}
 
 void pack_vertex(assets::Vertex_f32_PNCV& new_vert, tinyobj::real_t vx, tinyobj::real_t vy, tinyobj::real_t vz, tinyobj::real_t nx, tinyobj::real_t ny, tinyobj::real_t nz, tinyobj::real_t ux, tinyobj::real_t uy)
 {
@@ -150,19 +1187,6 @@ void pack_vertex(assets::Vertex_f32_PNCV& new_vert, tinyobj::real_t vx, tinyobj:
 	new_vert.uv[0] = ux;
 	new_vert.uv[1] = 1 - uy;
 }
-void pack_vertex(assets::Vertex_P32N8C8V16& new_vert, tinyobj::real_t vx, tinyobj::real_t vy, tinyobj::real_t vz, tinyobj::real_t nx, tinyobj::real_t ny, tinyobj::real_t nz, tinyobj::real_t ux, tinyobj::real_t uy)
-{
-	new_vert.position[0] = vx;
-	new_vert.position[1] = vy;
-	new_vert.position[2] = vz;
-
-	new_vert.normal[0] = uint8_t(  ((nx + 1.0) / 2.0) * 255);
-	new_vert.normal[1] = uint8_t(  ((ny + 1.0) / 2.0) * 255);
-	new_vert.normal[2] = uint8_t(  ((nz + 1.0) / 2.0) * 255);
-
-	new_vert.uv[0] = ux;
-	new_vert.uv[1] = 1 - uy;
-}
 
 template<typename V>
 void extract_mesh_from_obj(std::vector<tinyobj::shape_t>& shapes, tinyobj::attrib_t& attrib, std::vector<uint32_t>& _indices, std::vector<V>& _vertices)
@@ -194,8 +1218,8 @@ void extract_mesh_from_obj(std::vector<tinyobj::shape_t>& shapes, tinyobj::attri
 				tinyobj::real_t ux = attrib.texcoords[2 * idx.texcoord_index + 0];
 				tinyobj::real_t uy = attrib.texcoords[2 * idx.texcoord_index + 1];
 
-				//copy it into our vertex
-				V new_vert;
+				//copy it into our vertex, zeroed so the fields obj doesnt have are identical and can be welded
+				V new_vert{};
 				pack_vertex(new_vert, vx, vy, vz, nx, ny, nz, ux, uy);
 
 
@@ -207,7 +1231,7 @@ void extract_mesh_from_obj(std::vector<tinyobj::shape_t>& shapes, tinyobj::attri
 	}
 }
 
-bool convert_mesh(const fs::path& input, const fs::path& output)
+bool convert_mesh(const fs::path& input, const fs::path& output, ConverterState& convState)
 {
 	//attrib will contain the assets::Vertex_f32_PNCV arrays of the file
 	tinyobj::attrib_t attrib;
@@ -249,7 +1273,7 @@ bool convert_mesh(const fs::path& input, const fs::path& output)
 	std::vector<uint32_t> _indices;
 
 	extract_mesh_from_obj(shapes, attrib, _indices, _vertices);
-
+	optimize_baked_mesh(_vertices, _indices, convState);
 
 	MeshInfo meshinfo;
 	meshinfo.vertexFormat = VertexFormatEnum;
@@ -262,7 +1286,7 @@ bool convert_mesh(const fs::path& input, const fs::path& output)
 	//pack mesh file
 	auto start = std::chrono::high_resolution_clock::now();
 
-	assets::AssetFile newFile = assets::pack_mesh(&meshinfo, (char*)_vertices.data(), (char*)_indices.data());
+	assets::AssetFile newFile = pack_baked_mesh(meshinfo, _vertices, _indices, convState, input.stem().string());
 	
 	auto  end = std::chrono::high_resolution_clock::now();
 
@@ -270,6 +1294,11 @@ bool convert_mesh(const fs::path& input, const fs::path& output)
 
 	std::cout << "compression took " << std::chrono::duration_cast<std::chrono::nanoseconds>(diff).count() / 1000000.0 << "ms" << std::endl;
 
+	if (convState.options.bCompressionReport)
+	{
+		record_mesh_compression(convState.report, meshinfo, newFile);
+	}
+
 	//save to disk
 	SaveBinaryFile(output.string().c_str(), newFile);
 	
@@ -480,13 +1509,80 @@ std::string calculate_gltf_mesh_name(tinygltf::Model& model, int meshIndex, int
 	
 	return meshname;
 }
-bool extract_gltf_meshes(tinygltf::Model& model, const fs::path& input, const fs::path& outputFolder, const ConverterState& convState)
+//export relative path of every mesh that wasnt written, to the identical one that was. Same form as the prefab mesh paths
+using MeshAliases = std::map<std::string, std::string>;
+
+struct BakedMesh {
+	fs::path path;
+	assets::AssetFile file;
+	uint64_t hash = 0;
+};
+
+uint64_t hash_asset_file(const assets::AssetFile& file)
+{
+	uint64_t hash = hash_bytes(file.type, sizeof(file.type), file.version);
+	hash = hash_bytes(file.json.data(), file.json.size(), hash);
+	return hash_bytes(file.binaryBlob.data(), file.binaryBlob.size(), hash);
+}
+
+//meshes of one source share their originalFile, so identical geometry packs to identical bytes.
+//the first of each set of duplicates is the one written, so which one is kept doesnt depend on the thread count
+MeshAliases save_unique_meshes(const std::vector<BakedMesh>& meshes, const ConverterState& convState)
+{
+	MeshAliases aliases;
+	std::unordered_map<uint64_t, size_t> firstByHash;
+	std::vector<size_t> unique;
+	for (size_t i = 0; i < meshes.size(); ++i)
+	{
+		auto [it, inserted] = firstByHash.insert({ meshes[i].hash, i });
+		const BakedMesh& first = meshes[it->second];
+		if (!inserted && first.file.json == meshes[i].file.json && first.file.binaryBlob == meshes[i].file.binaryBlob)
+		{
+			aliases[convState.convert_to_export_relative(meshes[i].path).string()] = convState.convert_to_export_relative(first.path).string();
+			continue;
+		}
+		unique.push_back(i);
+	}
+
+	parallel_for(convState, unique.size(), [&](size_t i) {
+		const BakedMesh& mesh = meshes[unique[i]];
+
+		//save to disk
+		SaveBinaryFile(mesh.path.string().c_str(), mesh.file);
+	});
+
+	if (!aliases.empty())
+	{
+		std::cout << "skipped " << aliases.size() << " duplicate meshes out of " << meshes.size() << std::endl;
+	}
+	return aliases;
+}
+
+void alias_prefab_meshes(assets::PrefabInfo& prefab, const MeshAliases& aliases)
+{
+	for (auto& [node, mesh] : prefab.node_meshes)
+	{
+		auto it = aliases.find(mesh.mesh_path);
+		if (it != aliases.end())
+		{
+			mesh.mesh_path = it->second;
+		}
+	}
+}
+
+bool extract_gltf_meshes(tinygltf::Model& model, const fs::path& input, const fs::path& outputFolder, ConverterState& convState, MeshAliases& outAliases)
 {
-	tinygltf::Model* glmod = &model;
+	//every primitive is baked into its own file, so they all go to the pool at once
+	std::vector<std::pair<int, int>> primitives;
 	for (auto meshindex = 0; meshindex < model.meshes.size(); meshindex++){
+		for (auto primindex = 0; primindex < model.meshes[meshindex].primitives.size(); primindex++){
+			primitives.push_back({ meshindex, primindex });
+		}
+	}
 
-		auto& glmesh = model.meshes[meshindex];
-		
+	std::vector<BakedMesh> baked(primitives.size());
+	parallel_for(convState, primitives.size(), [&](size_t i) {
+		auto [meshindex, primindex] = primitives[i];
 
 		using VertexFormat = assets::Vertex_f32_PNCV;
 		auto VertexFormatEnum = assets::VertexFormat::PNCV_F32;
@@ -494,36 +1590,36 @@ bool extract_gltf_meshes(tinygltf::Model& model, const fs::path& input, const fs
 		std::vector<VertexFormat> _vertices;
 		std::vector<uint32_t> _indices;
 
-		for (auto primindex = 0; primindex < glmesh.primitives.size(); primindex++){
+		std::string meshname = calculate_gltf_mesh_name(model, meshindex, primindex);
 
-			_vertices.clear();
-			_indices.clear();
+		auto& primitive = model.meshes[meshindex].primitives[primindex];
 
-			std::string meshname = calculate_gltf_mesh_name(model, meshindex, primindex);
+		extract_gltf_indices(primitive, model, _indices);
+		extract_gltf_vertices(primitive, model, _vertices);
+		optimize_baked_mesh(_vertices, _indices, convState);
 
-			auto& primitive = glmesh.primitives[primindex];
-			
-			extract_gltf_indices(primitive, model, _indices);
-			extract_gltf_vertices(primitive, model, _vertices);
-			
+		MeshInfo meshinfo;
+		meshinfo.vertexFormat = VertexFormatEnum;
+		meshinfo.vertexBufferSize = _vertices.size() * sizeof(VertexFormat);
+		meshinfo.indexBufferSize = _indices.size() * sizeof(uint32_t);
+		meshinfo.indexSize = sizeof(uint32_t);
+		meshinfo.originalFile = input.string();
 
-			MeshInfo meshinfo;
-			meshinfo.vertexFormat = VertexFormatEnum;
-			meshinfo.vertexBufferSize = _vertices.size() * sizeof(VertexFormat);
-			meshinfo.indexBufferSize = _indices.size() * sizeof(uint32_t);
-			meshinfo.indexSize = sizeof(uint32_t);
-			meshinfo.originalFile = input.string();
+		meshinfo.bounds = assets::CalculateBounds(_vertices.data(), _vertices.size());
 
-			meshinfo.bounds = assets::CalculateBounds(_vertices.data(), _vertices.size());
+		assets::AssetFile newFile = pack_baked_mesh(meshinfo, _vertices, _indices, convState, meshname);
 
-			assets::AssetFile newFile = assets::pack_mesh(&meshinfo, (char*)_vertices.data(), (char*)_indices.data());
+		if (convState.options.bCompressionReport)
+		{
+			record_mesh_compression(convState.report, meshinfo, newFile);
+		}
 
-			fs::path meshpath = outputFolder / (meshname + ".mesh");
+		baked[i].path = outputFolder / (meshname + ".mesh");
+		baked[i].hash = hash_asset_file(newFile);
+		baked[i].file = std::move(newFile);
+	});
 
-			//save to disk
-			SaveBinaryFile(meshpath.string().c_str(), newFile);
-		}
-	}
+	outAliases = save_unique_meshes(baked, convState);
 	return true;
 }
 
@@ -641,7 +1737,7 @@ void extract_gltf_materials(tinygltf::Model& model, const fs::path& input, const
 	}
 }
 
-void extract_gltf_nodes(tinygltf::Model& model, const fs::path& input, const fs::path& outputFolder, const ConverterState& convState)
+void extract_gltf_nodes(tinygltf::Model& model, const fs::path& input, const fs::path& outputFolder, const MeshAliases& meshAliases, const ConverterState& convState)
 {
 	assets::PrefabInfo prefab;
 
@@ -820,6 +1916,8 @@ void extract_gltf_nodes(tinygltf::Model& model, const fs::path& input, const fs:
 	}
 
 
+	alias_prefab_meshes(prefab, meshAliases);
+
 	assets::AssetFile newFile = assets::pack_prefab(prefab);
 
 	fs::path scenefilepath = (outputFolder.parent_path()) / input.stem();
@@ -931,8 +2029,9 @@ void extract_assimp_materials(const aiScene* scene, const fs::path& input, const
 		SaveBinaryFile(materialPath.string().c_str(), newFile);
 	}
 }
-void extract_assimp_meshes(const aiScene* scene, const fs::path& input, const fs::path& outputFolder, const ConverterState& convState)
+void extract_assimp_meshes(const aiScene* scene, const fs::path& input, const fs::path& outputFolder, ConverterState& convState, MeshAliases& outAliases)
 {
+	std::vector<BakedMesh> baked(scene->mNumMeshes);
 	for (int meshindex = 0; meshindex < scene->mNumMeshes; meshindex++) {
 
 		auto mesh = scene->mMeshes[meshindex];
@@ -948,7 +2047,7 @@ void extract_assimp_meshes(const aiScene* scene, const fs::path& input, const fs
 		_vertices.resize(mesh->mNumVertices);
 		for (int v = 0; v < mesh->mNumVertices; v++)
 		{
-			VertexFormat vert;
+			VertexFormat vert{};
 			vert.position[0] = mesh->mVertices[v].x;
 			vert.position[1] = mesh->mVertices[v].y;
 			vert.position[2] = mesh->mVertices[v].z;
@@ -1018,6 +2117,7 @@ void extract_assimp_meshes(const aiScene* scene, const fs::path& input, const fs
 				memcpy(_vertices[v2].normal, &normal, sizeof(float) * 3);
 			}
 		}
+		optimize_baked_mesh(_vertices, _indices, convState);
 
 		MeshInfo meshinfo;
 		meshinfo.vertexFormat = VertexFormatEnum;
@@ -1028,15 +2128,21 @@ void extract_assimp_meshes(const aiScene* scene, const fs::path& input, const fs
 
 		meshinfo.bounds = assets::CalculateBounds(_vertices.data(), _vertices.size());
 
-		assets::AssetFile newFile = assets::pack_mesh(&meshinfo, (char*)_vertices.data(), (char*)_indices.data());
+		assets::AssetFile newFile = pack_baked_mesh(meshinfo, _vertices, _indices, convState, meshname);
+
+		if (convState.options.bCompressionReport)
+		{
+			record_mesh_compression(convState.report, meshinfo, newFile);
+		}
 
-		fs::path meshpath = outputFolder / (meshname + ".mesh");
+		baked[meshindex].path = outputFolder / (meshname + ".mesh");
+		baked[meshindex].hash = hash_asset_file(newFile);
+		baked[meshindex].file = std::move(newFile);
+	}
 
-		//save to disk
-		SaveBinaryFile(meshpath.string().c_str(), newFile);		
-	}	
+	outAliases = save_unique_meshes(baked, convState);
 }
-void extract_assimp_nodes(const aiScene* scene, const fs::path& input, const fs::path& outputFolder, const ConverterState& convState)
+void extract_assimp_nodes(const aiScene* scene, const fs::path& input, const fs::path& outputFolder, const MeshAliases& meshAliases, const ConverterState& convState)
 {
 	
 	assets::PrefabInfo prefab;
@@ -1127,6 +2233,8 @@ void extract_assimp_nodes(const aiScene* scene, const fs::path& input, const fs:
 
 	process_node(scene->mRootNode, mat,0);
 
+	alias_prefab_meshes(prefab, meshAliases);
+
 	assets::AssetFile newFile = assets::pack_prefab(prefab);
 
 	fs::path scenefilepath = (outputFolder.parent_path()) / input.stem();
@@ -1137,6 +2245,79 @@ void extract_assimp_nodes(const aiScene* scene, const fs::path& input, const fs:
 	SaveBinaryFile(scenefilepath.string().c_str(), newFile);
 }
 
+bool load_gltf(const fs::path& path, tinygltf::Model& model)
+{
+	using namespace tinygltf;
+	TinyGLTF loader;
+	std::string err;
+	std::string warn;
+
+	bool ret = loader.LoadASCIIFromFile(&model, &err, &warn, path.string().c_str());
+
+	if (!warn.empty()) {
+		printf("Warn: %s\n", warn.c_str());
+	}
+
+	if (!err.empty()) {
+		printf("Err: %s\n", err.c_str());
+	}
+
+	if (!ret) {
+		printf("Failed to parse glTF\n");
+	}
+	return ret;
+}
+
+//what the next run needs to know to skip this scene, the outputs match what the extract_gltf functions write
+BakeManifest::Scene record_gltf_scene(tinygltf::Model& model, const fs::path& input, const fs::path& outputFolder, uint64_t sceneHash, const TextureJobs& textures, const MeshAliases& meshAliases, const ConverterState& convState)
+{
+	BakeManifest::Scene scene;
+	scene.hash = sceneHash;
+
+	for (auto& buffer : model.buffers)
+	{
+		//embedded buffers are covered by the hash of the gltf itself
+		if (buffer.uri.empty() || buffer.uri.rfind("data:", 0) == 0)
+		{
+			continue;
+		}
+		fs::path bufferPath = input.parent_path() / buffer.uri;
+		uint64_t hash;
+		if (hash_file(bufferPath, hash))
+		{
+			scene.dependencies[bufferPath.lexically_proximate(convState.asset_path).generic_string()] = hash;
+		}
+	}
+
+	for (int meshindex = 0; meshindex < model.meshes.size(); meshindex++)
+	{
+		for (int primindex = 0; primindex < model.meshes[meshindex].primitives.size(); primindex++)
+		{
+			//duplicates are never written
+			fs::path meshpath = outputFolder / (calculate_gltf_mesh_name(model, meshindex, primindex) + ".mesh");
+			if (meshAliases.find(convState.convert_to_export_relative(meshpath).string()) == meshAliases.end())
+			{
+				scene.outputs.push_back(convState.convert_to_export_relative(meshpath).generic_string());
+			}
+		}
+	}
+	for (int materialindex = 0; materialindex < model.materials.size(); materialindex++)
+	{
+		fs::path materialpath = outputFolder / (calculate_gltf_material_name(model, materialindex) + ".mat");
+		scene.outputs.push_back(convState.convert_to_export_relative(materialpath).generic_string());
+	}
+	fs::path scenefilepath = outputFolder.parent_path() / input.stem();
+	scenefilepath.replace_extension(".pfb");
+	scene.outputs.push_back(convState.convert_to_export_relative(scenefilepath).generic_string());
+
+	for (auto& [texturePath, job] : textures)
+	{
+		scene.textures.push_back({ convState.convert_to_export_relative(texturePath).generic_string(),
+			job.imagePath.lexically_proximate(convState.asset_path).generic_string(), job.format });
+	}
+	return scene;
+}
+
 int main(int argc, char* argv[])
 {
 	if (argc < 2)
@@ -1158,6 +2339,27 @@ int main(int argc, char* argv[])
 		convstate.asset_path = path;
 		convstate.export_path = exported_dir;
 
+		if (!parse_baker_options(argc, argv, convstate.options))
+		{
+			return -1;
+		}
+
+		fs::path manifestPath = exported_dir / s_kBakeManifestName;
+		if (!convstate.options.bRebuild)
+		{
+			load_bake_manifest(manifestPath, convstate.cache);
+		}
+
+		if (convstate.options.jobs != 1)
+		{
+			//the thread calling ParallelFor works too
+			convstate.pool = std::make_unique<assets::ThreadPool>(convstate.options.jobs == 0 ? 0 : convstate.options.jobs - 1);
+			std::cout << "baking on " << convstate.pool->ThreadCount() + 1 << " threads" << std::endl;
+		}
+
+		//gltf scenes and the folder their assets go to
+		std::vector<std::pair<fs::path, fs::path>> scenes;
+
 		for (auto& p : fs::recursive_directory_iterator(directory))
 		{
 			std::cout << "File: " << p << std::endl;
@@ -1180,46 +2382,20 @@ int main(int argc, char* argv[])
 			//
 			//	export_path.replace_extension(".tx");
 			//
-			//	convert_image(p.path(), export_path);
+			//	convert_image(p.path(), export_path, convstate);
 			//}
 			//if (p.path().extension() == ".obj") {
 			//	std::cout << "found a mesh" << std::endl;
 			//
 			//	export_path.replace_extension(".mesh");
-			//	convert_mesh(p.path(), export_path);
+			//	convert_mesh(p.path(), export_path, convstate);
 			//}
 			if (p.path().extension() == ".gltf")
 			{
-				using namespace tinygltf;
-				Model model;
-				TinyGLTF loader;
-				std::string err;
-				std::string warn;
-			
-				bool ret = loader.LoadASCIIFromFile(&model, &err, &warn, p.path().string().c_str());
-			
-				if (!warn.empty()) {
-					printf("Warn: %s\n", warn.c_str());
-				}
-			
-				if (!err.empty()) {
-					printf("Err: %s\n", err.c_str());
-				}
-			
-				if (!ret) {
-					printf("Failed to parse glTF\n");
-					return -1;
-				}
-				else {
-					auto folder = export_path.parent_path() / (p.path().stem().string() + "_GLTF");
-					fs::create_directory(folder);
-			
-					extract_gltf_meshes(model, p.path(), folder, convstate);
-			
-					extract_gltf_materials(model, p.path(), folder, convstate);
-			
-					extract_gltf_nodes(model, p.path(), folder, convstate);
-				}
+				auto folder = export_path.parent_path() / (p.path().stem().string() + "_GLTF");
+				fs::create_directory(folder);
+
+				scenes.push_back({ p.path(), folder });
 			}
 			if (false){//p.path().extension() == ".fbx") {
 				const aiScene* scene;
@@ -1235,8 +2411,9 @@ int main(int argc, char* argv[])
 					auto folder = export_path.parent_path() / (p.path().stem().string() + "_GLTF");
 					fs::create_directory(folder);
 					extract_assimp_materials(scene, p.path(), folder, convstate);
-					extract_assimp_meshes(scene, p.path(), folder, convstate);
-					extract_assimp_nodes(scene, p.path(), folder, convstate);
+					MeshAliases meshAliases;
+					extract_assimp_meshes(scene, p.path(), folder, convstate, meshAliases);
+					extract_assimp_nodes(scene, p.path(), folder, meshAliases, convstate);
 
 					std::vector<aiMaterial*> materials;
 					std::vector<std::string> materialNames;
@@ -1254,11 +2431,140 @@ int main(int argc, char* argv[])
 			}
 		}
 
-		//else 
+		//each scene only writes inside its own folder, textures are converted once every scene has said what it needs
+		std::sort(scenes.begin(), scenes.end());
+		std::vector<TextureJobs> sceneTextures(scenes.size());
+		std::vector<BakeManifest::Scene> sceneRecords(scenes.size());
+		std::atomic<bool> failed{ false };
+		std::atomic<size_t> sceneHits{ 0 };
+
+		std::string sceneOptions = scene_bake_options(convstate.options);
+		uint64_t sceneOptionsHash = hash_bytes(sceneOptions.data(), sceneOptions.size());
+
+		auto sceneStart = std::chrono::high_resolution_clock::now();
+
+		parallel_for(convstate, scenes.size(), [&](size_t i) {
+			auto& [scenePath, folder] = scenes[i];
+
+			uint64_t gltfHash = 0;
+			hash_file(scenePath, gltfHash);
+			uint64_t sceneHash = combine_hashes(gltfHash, sceneOptionsHash);
+
+			auto cached = convstate.cache.scenes.find(scenePath.lexically_proximate(convstate.asset_path).generic_string());
+			if (cached != convstate.cache.scenes.end() && scene_up_to_date(convstate, cached->second, sceneHash))
+			{
+				std::cout << "Up to date: " << scenePath << std::endl;
+				sceneRecords[i] = cached->second;
+				restore_scene_textures(convstate, cached->second, sceneTextures[i]);
+				sceneHits++;
+				return;
+			}
+
+			tinygltf::Model model;
+			if (!load_gltf(scenePath, model))
+			{
+				failed = true;
+				return;
+			}
+
+			MeshAliases meshAliases;
+			extract_gltf_meshes(model, scenePath, folder, convstate, meshAliases);
+
+			extract_gltf_materials(model, scenePath, folder, convstate);
+
+			if (convstate.options.bBlockCompressedTextures)
+			{
+				extract_gltf_textures(model, scenePath, folder, sceneTextures[i]);
+			}
+
+			extract_gltf_nodes(model, scenePath, folder, meshAliases, convstate);
+
+			sceneRecords[i] = record_gltf_scene(model, scenePath, folder, sceneHash, sceneTextures[i], meshAliases, convstate);
+		});
+
+		auto sceneEnd = std::chrono::high_resolution_clock::now();
+		std::cout << "scenes: " << sceneHits << " up to date, " << scenes.size() - sceneHits << " baked in "
+			<< std::chrono::duration_cast<std::chrono::nanoseconds>(sceneEnd - sceneStart).count() / 1000000.0 << "ms" << std::endl;
+
+		//scenes that failed to parse never get a record and are retried next time
+		BakeManifest manifest;
+		for (size_t i = 0; i < scenes.size(); ++i)
+		{
+			if (sceneRecords[i].hash != 0)
+			{
+				manifest.scenes[scenes[i].first.lexically_proximate(convstate.asset_path).generic_string()] = std::move(sceneRecords[i]);
+			}
+		}
+
+		//merged in scene order so a texture two scenes disagree on always gets the format of the last one
+		TextureJobs textures;
+		for (auto& jobs : sceneTextures)
+		{
+			for (auto& [texturePath, job] : jobs)
+			{
+				textures[texturePath] = job;
+			}
+		}
+		TextureAliases textureAliases = convert_textures(textures, convstate, manifest);
+
+		//materials are written with the texture each slot asked for, the ones that asked for a duplicate are repointed.
+		//a cached scene whose aliases changed gets its materials written again first, the aliases on disk cant be undone
+		std::vector<std::pair<size_t, BakeManifest::Scene*>> realiasedScenes;
+		for (size_t i = 0; i < scenes.size(); ++i)
+		{
+			auto record = manifest.scenes.find(scenes[i].first.lexically_proximate(convstate.asset_path).generic_string());
+			if (record != manifest.scenes.end() && scene_texture_aliases(record->second, textureAliases) != record->second.textureAliases)
+			{
+				realiasedScenes.push_back({ i, &record->second });
+			}
+		}
+
+		parallel_for(convstate, realiasedScenes.size(), [&](size_t r) {
+			auto& [scenePath, folder] = scenes[realiasedScenes[r].first];
+			BakeManifest::Scene& scene = *realiasedScenes[r].second;
+
+			if (!scene.textureAliases.empty())
+			{
+				tinygltf::Model model;
+				if (!load_gltf(scenePath, model))
+				{
+					return;
+				}
+				extract_gltf_materials(model, scenePath, folder, convstate);
+			}
+
+			scene.textureAliases = scene_texture_aliases(scene, textureAliases);
+			alias_material_textures(scene, scene.textureAliases, convstate);
+		});
+
+		fs::create_directories(exported_dir);
+		if (!save_bake_manifest(manifestPath, manifest))
+		{
+			std::cout << "Failed to write bake manifest " << manifestPath << std::endl;
+		}
+
+		if (failed)
 		{
-			std::cout << "Invalid path: " << argv[1];
 			return -1;
 		}
+
+		print_mesh_optimization_report(convstate.meshReport);
+		print_quantization_report(convstate.quantizationReport);
+
+		if (convstate.options.bCompressionReport)
+		{
+			print_compression_report(convstate.options, convstate.report);
+		}
+
+		if (convstate.options.bPackArchive)
+		{
+			fs::path archivePath = path.parent_path() / "assets_export.pak";
+			if (!pack_export_archive(exported_dir, archivePath, convstate.options))
+			{
+				std::cout << "Failed to write archive " << archivePath << std::endl;
+				return -1;
+			}
+		}
 	}
 	//VulkanEngine engine;
 	//
@@ -0,0 +1,138 @@
+#include <iostream>
+#include <filesystem>
+#include <chrono>
+#include <functional>
+#include <map>
+
+#include <asset_loader.h>
+#include <asset_metadata.h>
+#include <mesh_asset.h>
+#include <texture_asset.h>
+#include <material_asset.h>
+#include <prefab_asset.h>
+
+namespace fs = std::filesystem;
+
+using namespace assets;
+
+//compares json and binary metadata parsing on every baked asset of a folder
+//usage: asset_benchmark <assets_export folder> [iterations]
+
+struct MetadataBenchResult {
+	int assets = 0;
+	size_t jsonBytes = 0;
+	size_t binaryBytes = 0;
+	double jsonMs = 0;
+	double binaryMs = 0;
+};
+
+struct AssetBenchmark {
+	//converts the asset metadata into both formats
+	std::function<void(const AssetView& view, std::string& outJson, std::string& outBinary)> encode;
+	//parses the metadata of the file the same way the runtime does
+	std::function<void(AssetFile& file)> read;
+};
+
+static double time_reads(const AssetBenchmark& bench, AssetFile& file, int iterations)
+{
+	auto start = std::chrono::high_resolution_clock::now();
+	for (int i = 0; i < iterations; ++i)
+	{
+		bench.read(file);
+	}
+	auto end = std::chrono::high_resolution_clock::now();
+
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count() / 1000000.0;
+}
+
+int main(int argc, char* argv[])
+{
+	if (argc < 2)
+	{
+		std::cout << "You need to put the path to the assets_export folder";
+		return -1;
+	}
+
+	fs::path directory{ argv[1] };
+	int iterations = argc > 2 ? atoi(argv[2]) : 100;
+
+	std::map<std::string, AssetBenchmark> benchmarks;
+	benchmarks[".mesh"] = {
+		[](const AssetView& view, std::string& outJson, std::string& outBinary) {
+			MeshInfo info = ReadMeshInfo(view);
+			outJson = pack_mesh_metadata(&info, MetadataFormat::Json);
+			outBinary = pack_mesh_metadata(&info, MetadataFormat::Binary);
+		},
+		[](AssetFile& file) { ReadMeshInfo(&file); }
+	};
+	benchmarks[".tx"] = {
+		[](const AssetView& view, std::string& outJson, std::string& outBinary) {
+			TextureInfo info = ReadTextureInfo(view);
+			outJson = pack_texture_metadata(&info, MetadataFormat::Json);
+			outBinary = pack_texture_metadata(&info, MetadataFormat::Binary);
+		},
+		[](AssetFile& file) { ReadTextureInfo(&file); }
+	};
+	benchmarks[".mat"] = {
+		[](const AssetView& view, std::string& outJson, std::string& outBinary) {
+			MaterialInfo info = read_material_info(view);
+			outJson = pack_material_metadata(&info, MetadataFormat::Json);
+			outBinary = pack_material_metadata(&info, MetadataFormat::Binary);
+		},
+		[](AssetFile& file) { read_material_info(&file); }
+	};
+	benchmarks[".pfb"] = {
+		[](const AssetView& view, std::string& outJson, std::string& outBinary) {
+			PrefabInfo info = ReadPrefabInfo(view);
+			outJson = pack_prefab_metadata(info, MetadataFormat::Json);
+			outBinary = pack_prefab_metadata(info, MetadataFormat::Binary);
+		},
+		[](AssetFile& file) { ReadPrefabInfo(&file); }
+	};
+
+	std::map<std::string, MetadataBenchResult> results;
+
+	for (auto& p : fs::recursive_directory_iterator(directory))
+	{
+		auto it = benchmarks.find(p.path().extension().string());
+		if (it == benchmarks.end())
+		{
+			continue;
+		}
+
+		AssetView view;
+		if (!LoadAssetView(p.path().string().c_str(), view))
+		{
+			std::cout << "Failed to load " << p.path() << std::endl;
+			continue;
+		}
+
+		AssetFile jsonFile;
+		AssetFile binaryFile;
+		memcpy(jsonFile.type, view.type, 4);
+		memcpy(binaryFile.type, view.type, 4);
+		jsonFile.version = kJsonMetadataVersion;
+		binaryFile.version = kBinaryMetadataVersion;
+
+		it->second.encode(view, jsonFile.json, binaryFile.json);
+
+		MetadataBenchResult& result = results[it->first];
+		result.assets++;
+		result.jsonBytes += jsonFile.json.size();
+		result.binaryBytes += binaryFile.json.size();
+		result.jsonMs += time_reads(it->second, jsonFile, iterations);
+		result.binaryMs += time_reads(it->second, binaryFile, iterations);
+	}
+
+	std::cout << "type,assets,json_bytes,binary_bytes,json_us_per_read,binary_us_per_read,speedup" << std::endl;
+	for (auto& [type, result] : results)
+	{
+		double reads = double(result.assets) * iterations;
+		std::cout << type << "," << result.assets << ","
+			<< result.jsonBytes << "," << result.binaryBytes << ","
+			<< result.jsonMs * 1000.0 / reads << "," << result.binaryMs * 1000.0 / reads << ","
+			<< result.jsonMs / result.binaryMs << std::endl;
+	}
+
+	return 0;
+}
@@ -0,0 +1,310 @@
+#include <iostream>
+#include <filesystem>
+#include <chrono>
+#include <algorithm>
+#include <numeric>
+
+#include <json.hpp>
+
+#include <asset_loader.h>
+#include <asset_metadata.h>
+#include <asset_archive.h>
+#include <mesh_asset.h>
+#include <texture_asset.h>
+#include <material_asset.h>
+#include <prefab_asset.h>
+
+namespace fs = std::filesystem;
+
+using namespace assets;
+
+//prints one row per baked asset of an assets_export folder or a .pak archive, decoded through the same unpackers the engine uses
+//usage: asset_inspector <assets_export folder | archive> [-json] [-iterations=N]
+
+struct InspectorOptions {
+	bool bJson = false;
+	int iterations = 10;
+};
+
+struct AssetReport {
+	std::string path;
+	std::string type;
+	int version = 0;
+	bool bBinaryMetadata = false;
+	size_t metadataBytes = 0;
+
+	//blob as stored against what the unpackers write out
+	uint64_t blobBytes = 0;
+	uint64_t originalBytes = 0;
+
+	std::string compression = "none";
+	std::string format;
+	//texture pages, independent lz4 blocks for meshes
+	size_t pages = 0;
+
+	//per load, averaged over the iterations
+	double openUs = 0;
+	double metadataUs = 0;
+	double decodeUs = 0;
+};
+
+template<typename F>
+static double time_us(int iterations, F&& f)
+{
+	auto start = std::chrono::high_resolution_clock::now();
+	for (int i = 0; i < iterations; ++i)
+	{
+		f();
+	}
+	auto end = std::chrono::high_resolution_clock::now();
+
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count() / 1000.0 / iterations;
+}
+
+static bool inspect_mesh(const AssetView& view, const InspectorOptions& options, AssetReport& report)
+{
+	MeshInfo info = ReadMeshInfo(view);
+	report.metadataUs = time_us(options.iterations, [&]() { ReadMeshInfo(view); });
+
+	report.originalBytes = info.vertexBufferSize + info.indexBufferSize;
+	report.compression = compression_profile_name({ info.compressionMode, (int)info.compressionLevel, info.chunkSize });
+	report.format = vertex_format_name(info.vertexFormat);
+	report.pages = info.chunkOffsets.size() > 1 ? info.chunkOffsets.size() - 1 : 1;
+
+	//indices right after the vertices, so single block meshes decode without a temporary like they do in the engine
+	std::vector<char> buffer(report.originalBytes);
+	if (!UnpackMesh(&info, view.binaryBlob.data(), view.binaryBlob.size(), buffer.data(), buffer.data() + info.vertexBufferSize))
+	{
+		std::cerr << "Error when decoding mesh :" << report.path << std::endl;
+		return false;
+	}
+	report.decodeUs = time_us(options.iterations, [&]() {
+		UnpackMesh(&info, view.binaryBlob.data(), view.binaryBlob.size(), buffer.data(), buffer.data() + info.vertexBufferSize);
+	});
+	return true;
+}
+
+static bool inspect_texture(const AssetView& view, const InspectorOptions& options, AssetReport& report)
+{
+	TextureInfo info = ReadTextureInfo(view);
+	report.metadataUs = time_us(options.iterations, [&]() { ReadTextureInfo(view); });
+
+	report.originalBytes = std::accumulate(info.pages.begin(), info.pages.end(), uint64_t{ 0 },
+		[](uint64_t size, const PageInfo& page) { return size + page.originalSize; });
+	report.compression = compression_profile_name({ info.compressionMode, (int)info.compressionLevel });
+	report.format = texture_format_name(info.textureFormat);
+	report.pages = info.pages.size();
+
+	std::vector<char> pixels(report.originalBytes);
+	if (!unpack_texture(&info, view.binaryBlob.data(), view.binaryBlob.size(), pixels.data()))
+	{
+		std::cerr << "Error when decoding texture :" << report.path << std::endl;
+		return false;
+	}
+	report.decodeUs = time_us(options.iterations, [&]() {
+		unpack_texture(&info, view.binaryBlob.data(), view.binaryBlob.size(), pixels.data());
+	});
+	return true;
+}
+
+static bool inspect_asset(const AssetView& view, const InspectorOptions& options, AssetReport& report)
+{
+	report.type = std::string{ view.type, 4 };
+	report.version = view.version;
+	report.bBinaryMetadata = IsBinaryMetadata(view.version);
+	report.metadataBytes = view.json.size();
+	report.blobBytes = view.binaryBlob.size();
+	report.originalBytes = report.blobBytes;
+
+	if (report.type == "MESH")
+	{
+		if (!inspect_mesh(view, options, report))
+		{
+			return false;
+		}
+	}
+	else if (report.type == "TEXI")
+	{
+		if (!inspect_texture(view, options, report))
+		{
+			return false;
+		}
+	}
+	else if (report.type == "MATX")
+	{
+		report.metadataUs = time_us(options.iterations, [&]() { read_material_info(view); });
+	}
+	else if (report.type == "PRFB")
+	{
+		//the matrices live in the blob, so this is the whole load
+		report.metadataUs = time_us(options.iterations, [&]() { ReadFlatPrefab(view); });
+	}
+	else
+	{
+		std::cerr << "Unknown asset type " << report.type << " :" << report.path << std::endl;
+		return false;
+	}
+	return true;
+}
+
+static void inspect_folder(const fs::path& directory, const InspectorOptions& options, std::vector<AssetReport>& reports)
+{
+	for (auto& p : fs::recursive_directory_iterator(directory))
+	{
+		if (!p.is_regular_file())
+		{
+			continue;
+		}
+
+		std::string path = p.path().string();
+
+		AssetReport report;
+		report.path = p.path().lexically_relative(directory).generic_string();
+
+		AssetView view;
+		if (!LoadAssetView(path.c_str(), view))
+		{
+			std::cerr << "Failed to load " << path << std::endl;
+			continue;
+		}
+		report.openUs = time_us(options.iterations, [&]() {
+			AssetView reopened;
+			LoadAssetView(path.c_str(), reopened);
+		});
+
+		if (inspect_asset(view, options, report))
+		{
+			reports.push_back(std::move(report));
+		}
+	}
+}
+
+static bool inspect_archive(const fs::path& archivePath, const InspectorOptions& options, std::vector<AssetReport>& reports)
+{
+	AssetArchive archive;
+	if (!archive.Open(archivePath.string().c_str()))
+	{
+		return false;
+	}
+
+	for (std::string_view entry : archive.EntryPaths())
+	{
+		AssetReport report;
+		report.path = std::string{ entry };
+
+		//dictionary compressed entries are decoded here, so that cost lands in open_us
+		AssetView view;
+		if (!archive.LoadAssetView(entry, view))
+		{
+			std::cerr << "Failed to load " << report.path << std::endl;
+			continue;
+		}
+		report.openUs = time_us(options.iterations, [&]() {
+			AssetView reopened;
+			archive.LoadAssetView(entry, reopened);
+		});
+
+		if (inspect_asset(view, options, report))
+		{
+			reports.push_back(std::move(report));
+		}
+	}
+	return true;
+}
+
+static double compression_ratio(const AssetReport& report)
+{
+	return report.blobBytes ? double(report.originalBytes) / double(report.blobBytes) : 1.0;
+}
+
+static void print_csv(const std::vector<AssetReport>& reports)
+{
+	std::cout << "path,type,version,metadata,metadata_bytes,blob_bytes,original_bytes,ratio,compression,format,pages,open_us,metadata_us,decode_us" << std::endl;
+	for (const AssetReport& report : reports)
+	{
+		std::cout << report.path << "," << report.type << "," << report.version << ","
+			<< (report.bBinaryMetadata ? "binary" : "json") << "," << report.metadataBytes << ","
+			<< report.blobBytes << "," << report.originalBytes << "," << compression_ratio(report) << ","
+			<< report.compression << "," << report.format << "," << report.pages << ","
+			<< report.openUs << "," << report.metadataUs << "," << report.decodeUs << std::endl;
+	}
+}
+
+static void print_json(const std::vector<AssetReport>& reports)
+{
+	nlohmann::json rows = nlohmann::json::array();
+	for (const AssetReport& report : reports)
+	{
+		nlohmann::json asset;
+		asset["path"] = report.path;
+		asset["type"] = report.type;
+		asset["version"] = report.version;
+		asset["metadata"] = report.bBinaryMetadata ? "binary" : "json";
+		asset["metadata_bytes"] = report.metadataBytes;
+		asset["blob_bytes"] = report.blobBytes;
+		asset["original_bytes"] = report.originalBytes;
+		asset["ratio"] = compression_ratio(report);
+		asset["compression"] = report.compression;
+		asset["format"] = report.format;
+		asset["pages"] = report.pages;
+		asset["open_us"] = report.openUs;
+		asset["metadata_us"] = report.metadataUs;
+		asset["decode_us"] = report.decodeUs;
+		rows.push_back(std::move(asset));
+	}
+	std::cout << rows.dump(1) << std::endl;
+}
+
+int main(int argc, char* argv[])
+{
+	if (argc < 2)
+	{
+		std::cout << "You need to put the path to the assets_export folder or an asset archive";
+		return -1;
+	}
+
+	InspectorOptions options;
+	for (int i = 2; i < argc; i++)
+	{
+		std::string arg = argv[i];
+		if (arg == "-json")
+		{
+			options.bJson = true;
+		}
+		else if (arg.rfind("-iterations=", 0) == 0)
+		{
+			options.iterations = std::max(1, atoi(arg.c_str() + arg.find('=') + 1));
+		}
+		else
+		{
+			std::cout << "Unknown option " << arg << std::endl;
+			return -1;
+		}
+	}
+
+	fs::path path{ argv[1] };
+	std::vector<AssetReport> reports;
+	if (fs::is_directory(path))
+	{
+		inspect_folder(path, options, reports);
+	}
+	else if (!inspect_archive(path, options, reports))
+	{
+		std::cerr << "Failed to open " << path << std::endl;
+		return -1;
+	}
+
+	//directory and toc order are both arbitrary
+	std::sort(reports.begin(), reports.end(), [](const AssetReport& a, const AssetReport& b) { return a.path < b.path; });
+
+	if (options.bJson)
+	{
+		print_json(reports);
+	}
+	else
+	{
+		print_csv(reports);
+	}
+
+	return 0;
+}
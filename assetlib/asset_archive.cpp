@@ -0,0 +1,419 @@
+#include <asset_archive.h>
+#include <asset_dictionary.h>
+#include <lz4.h>
+
+#include <iostream>
+#include <cstring>
+
+static const char s_kArchiveMagic[4] = { 'P','A','K','A' };
+
+//header size of version 1 archives, before the dictionary fields were added
+static const size_t s_kArchiveHeaderV1Size = 40;
+
+//the archive is built offline, so small entries get the slower hc compressor
+static const assets::CompressionProfile s_kDictionaryProfile{ assets::CompressionMode::LZ4, 9 };
+
+static char normalize_path_char(char c)
+{
+	return c == '\\' ? '/' : c;
+}
+
+static bool path_equals(std::string_view a, std::string_view b)
+{
+	if (a.size() != b.size())
+	{
+		return false;
+	}
+	for (size_t i = 0; i < a.size(); ++i)
+	{
+		if (normalize_path_char(a[i]) != normalize_path_char(b[i]))
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+//offsets and lengths come from the file, so compare without adding them
+static bool range_fits(uint64_t offset, uint64_t length, uint64_t size)
+{
+	return offset <= size && length <= size - offset;
+}
+
+uint64_t assets::hash_asset_path(std::string_view path)
+{
+	//64 bit fnv1a
+	uint64_t hash = 14695981039346656037ull;
+	for (char c : path)
+	{
+		hash ^= (uint8_t)normalize_path_char(c);
+		hash *= 1099511628211ull;
+	}
+	return hash;
+}
+
+bool assets::ArchiveWriter::Open(const char* path)
+{
+	m_File.open(path, std::ios::binary | std::ios::out | std::ios::trunc);
+	if (!m_File.is_open())
+	{
+		std::cout << "Error when trying to write archive :" << path << std::endl;
+		return false;
+	}
+
+	//header is rewritten once the toc is known
+	ArchiveHeader header{};
+	m_File.write((const char*)&header, sizeof(ArchiveHeader));
+	m_Cursor = sizeof(ArchiveHeader);
+	m_Entries.clear();
+	m_Dictionaries.clear();
+	return true;
+}
+
+void assets::ArchiveWriter::Pad(uint64_t alignment)
+{
+	static const char zeros[kArchiveAlignment] = {};
+
+	uint64_t aligned = (m_Cursor + alignment - 1) & ~(alignment - 1);
+	m_File.write(zeros, aligned - m_Cursor);
+	m_Cursor = aligned;
+}
+
+bool assets::ArchiveWriter::AddDictionary(const char type[4], const std::vector<char>& dictionary)
+{
+	if (dictionary.empty() || dictionary.size() > kMaxDictionarySize)
+	{
+		return false;
+	}
+
+	PendingDictionary pending;
+	memcpy(pending.header.type, type, 4);
+	pending.header.size = static_cast<uint32_t>(dictionary.size());
+	pending.header.offset = m_Cursor;
+	pending.data = dictionary;
+
+	m_File.write(dictionary.data(), dictionary.size());
+	m_Cursor += dictionary.size();
+
+	m_Dictionaries.push_back(std::move(pending));
+	return m_File.good();
+}
+
+bool assets::ArchiveWriter::AddEntry(std::string_view assetPath, const char* data, size_t size)
+{
+	PendingEntry entry;
+	entry.path = assetPath;
+	for (char& c : entry.path)
+	{
+		c = normalize_path_char(c);
+	}
+	entry.size = size;
+	entry.compression = ArchiveEntryCompression{ 0, 0, size };
+
+	//small entries with a dictionary of their asset type, kept only if the dictionary actually helped
+	std::vector<char> compressed;
+	for (uint32_t i = 0; i < m_Dictionaries.size() && size >= 4 && size <= kDictionaryEntryMaxSize; ++i)
+	{
+		const PendingDictionary& dictionary = m_Dictionaries[i];
+		if (memcmp(dictionary.header.type, data, 4) != 0)
+		{
+			continue;
+		}
+
+		compressed.resize(LZ4_COMPRESSBOUND(size));
+		int compressedSize = compress_lz4_dictionary(s_kDictionaryProfile, dictionary.data.data(), static_cast<int>(dictionary.data.size()),
+			data, compressed.data(), static_cast<int>(size), static_cast<int>(compressed.size()));
+
+		if (compressedSize > 0 && (size_t)compressedSize < size)
+		{
+			compressed.resize(compressedSize);
+			entry.size = compressed.size();
+			entry.compression.dictionary = i + 1;
+			data = compressed.data();
+		}
+		break;
+	}
+
+	//compressed entries are decoded into their own buffer, so they dont need to be aligned for mapping
+	Pad(entry.compression.dictionary ? 8 : kArchiveAlignment);
+	entry.offset = m_Cursor;
+
+	m_File.write(data, entry.size);
+	m_Cursor += entry.size;
+
+	m_Entries.push_back(std::move(entry));
+	return m_File.good();
+}
+
+bool assets::ArchiveWriter::AddFile(std::string_view assetPath, const char* filePath)
+{
+	std::shared_ptr<MappedFile> file = MappedFile::Open(filePath);
+	if (!file)
+	{
+		std::cout << "Error when trying to read file for archive :" << filePath << std::endl;
+		return false;
+	}
+	return AddEntry(assetPath, file->data(), file->size());
+}
+
+bool assets::ArchiveWriter::Finish()
+{
+	ArchiveHeader header{};
+	memcpy(header.magic, s_kArchiveMagic, 4);
+	header.version = kArchiveVersion;
+	header.entryCount = static_cast<uint32_t>(m_Entries.size());
+
+	//path strings
+	header.stringsOffset = m_Cursor;
+	std::vector<uint32_t> pathOffsets;
+	uint32_t stringsSize = 0;
+	for (auto& e : m_Entries)
+	{
+		pathOffsets.push_back(stringsSize);
+		m_File.write(e.path.data(), e.path.size());
+		stringsSize += static_cast<uint32_t>(e.path.size());
+	}
+	header.stringsSize = stringsSize;
+	m_Cursor += stringsSize;
+
+	//toc at half load factor
+	uint32_t slotCount = 1;
+	while (slotCount < m_Entries.size() * 2)
+	{
+		slotCount *= 2;
+	}
+	std::vector<ArchiveTocEntry> toc(slotCount, ArchiveTocEntry{});
+	std::vector<ArchiveEntryCompression> compression(slotCount, ArchiveEntryCompression{});
+
+	for (size_t i = 0; i < m_Entries.size(); ++i)
+	{
+		ArchiveTocEntry entry;
+		entry.pathHash = hash_asset_path(m_Entries[i].path);
+		entry.offset = m_Entries[i].offset;
+		entry.size = m_Entries[i].size;
+		entry.pathOffset = pathOffsets[i];
+		entry.pathSize = static_cast<uint32_t>(m_Entries[i].path.size());
+
+		uint32_t slot = entry.pathHash & (slotCount - 1);
+		while (toc[slot].pathSize != 0)
+		{
+			slot = (slot + 1) & (slotCount - 1);
+		}
+		toc[slot] = entry;
+		compression[slot] = m_Entries[i].compression;
+	}
+
+	Pad(kArchiveAlignment);
+	header.tocOffset = m_Cursor;
+	header.tocSlotCount = slotCount;
+	m_File.write((const char*)toc.data(), toc.size() * sizeof(ArchiveTocEntry));
+	m_Cursor += toc.size() * sizeof(ArchiveTocEntry);
+
+	if (!m_Dictionaries.empty())
+	{
+		header.dictionariesOffset = m_Cursor;
+		header.dictionaryCount = static_cast<uint32_t>(m_Dictionaries.size());
+		for (auto& d : m_Dictionaries)
+		{
+			m_File.write((const char*)&d.header, sizeof(ArchiveDictionary));
+		}
+		m_Cursor += m_Dictionaries.size() * sizeof(ArchiveDictionary);
+
+		header.compressionOffset = m_Cursor;
+		m_File.write((const char*)compression.data(), compression.size() * sizeof(ArchiveEntryCompression));
+		m_Cursor += compression.size() * sizeof(ArchiveEntryCompression);
+	}
+
+	m_File.seekp(0);
+	m_File.write((const char*)&header, sizeof(ArchiveHeader));
+
+	bool good = m_File.good();
+	m_File.close();
+	return good;
+}
+
+bool assets::AssetArchive::Open(const char* path)
+{
+	std::shared_ptr<MappedFile> storage = MappedFile::Open(path);
+	if (!storage || storage->size() < sizeof(ArchiveHeader))
+	{
+		return false;
+	}
+
+	ArchiveHeader header{};
+	memcpy(&header, storage->data(), s_kArchiveHeaderV1Size);
+	if (memcmp(header.magic, s_kArchiveMagic, 4) != 0 || header.version == 0 || header.version > kArchiveVersion)
+	{
+		std::cout << "Not a valid asset archive :" << path << std::endl;
+		return false;
+	}
+
+	//version 1 archives have no dictionaries
+	if (header.version >= 2)
+	{
+		memcpy(&header, storage->data(), sizeof(ArchiveHeader));
+	}
+
+	uint64_t size = storage->size();
+	if (!range_fits(header.tocOffset, (uint64_t)header.tocSlotCount * sizeof(ArchiveTocEntry), size)
+		|| !range_fits(header.stringsOffset, header.stringsSize, size)
+		|| !range_fits(header.dictionariesOffset, (uint64_t)header.dictionaryCount * sizeof(ArchiveDictionary), size)
+		|| (header.compressionOffset != 0 && !range_fits(header.compressionOffset, (uint64_t)header.tocSlotCount * sizeof(ArchiveEntryCompression), size)))
+	{
+		std::cout << "Truncated asset archive :" << path << std::endl;
+		return false;
+	}
+
+	for (uint32_t i = 0; i < header.dictionaryCount; ++i)
+	{
+		ArchiveDictionary dictionary;
+		memcpy(&dictionary, storage->data() + header.dictionariesOffset + i * sizeof(ArchiveDictionary), sizeof(ArchiveDictionary));
+		if (!range_fits(dictionary.offset, dictionary.size, size))
+		{
+			std::cout << "Truncated asset archive :" << path << std::endl;
+			return false;
+		}
+	}
+
+	//lookups mask with the slot count and probe until they hit an empty slot
+	if (header.tocSlotCount == 0 || (header.tocSlotCount & (header.tocSlotCount - 1)) != 0 || header.entryCount >= header.tocSlotCount)
+	{
+		std::cout << "Corrupt asset archive toc :" << path << std::endl;
+		return false;
+	}
+
+	uint32_t occupied = 0;
+	for (uint32_t slot = 0; slot < header.tocSlotCount; ++slot)
+	{
+		ArchiveTocEntry entry;
+		memcpy(&entry, storage->data() + header.tocOffset + slot * sizeof(ArchiveTocEntry), sizeof(ArchiveTocEntry));
+		if (entry.pathSize == 0)
+		{
+			continue;
+		}
+		occupied++;
+
+		bool valid = range_fits(entry.offset, entry.size, size) && range_fits(entry.pathOffset, entry.pathSize, header.stringsSize);
+		if (valid && header.compressionOffset != 0)
+		{
+			ArchiveEntryCompression compression;
+			memcpy(&compression, storage->data() + header.compressionOffset + slot * sizeof(ArchiveEntryCompression), sizeof(ArchiveEntryCompression));
+			valid = compression.dictionary <= header.dictionaryCount;
+
+			//the decoded size is allocated on load, the writer only uses dictionaries for small entries
+			if (compression.dictionary != 0)
+			{
+				valid = valid && compression.originalSize != 0 && compression.originalSize <= kDictionaryEntryMaxSize;
+			}
+		}
+		if (!valid)
+		{
+			std::cout << "Corrupt asset archive toc :" << path << std::endl;
+			return false;
+		}
+	}
+
+	if (occupied != header.entryCount)
+	{
+		std::cout << "Corrupt asset archive toc :" << path << std::endl;
+		return false;
+	}
+
+	m_Header = header;
+	m_Toc = (const ArchiveTocEntry*)(storage->data() + header.tocOffset);
+	m_Strings = storage->data() + header.stringsOffset;
+	m_Dictionaries = header.dictionaryCount ? (const ArchiveDictionary*)(storage->data() + header.dictionariesOffset) : nullptr;
+	m_Compression = header.compressionOffset ? (const ArchiveEntryCompression*)(storage->data() + header.compressionOffset) : nullptr;
+	m_Storage = std::move(storage);
+	return true;
+}
+
+const assets::ArchiveTocEntry* assets::AssetArchive::Find(std::string_view assetPath) const
+{
+	if (!m_Storage || m_Header.tocSlotCount == 0)
+	{
+		return nullptr;
+	}
+
+	uint64_t hash = hash_asset_path(assetPath);
+	uint32_t mask = m_Header.tocSlotCount - 1;
+	uint32_t slot = hash & mask;
+
+	while (m_Toc[slot].pathSize != 0)
+	{
+		const ArchiveTocEntry& entry = m_Toc[slot];
+		if (entry.pathHash == hash && path_equals(std::string_view{ m_Strings + entry.pathOffset, entry.pathSize }, assetPath))
+		{
+			return &entry;
+		}
+		slot = (slot + 1) & mask;
+	}
+	return nullptr;
+}
+
+bool assets::AssetArchive::Contains(std::string_view assetPath) const
+{
+	return Find(assetPath) != nullptr;
+}
+
+std::vector<std::string_view> assets::AssetArchive::EntryPaths() const
+{
+	std::vector<std::string_view> paths;
+	if (!m_Storage)
+	{
+		return paths;
+	}
+
+	paths.reserve(m_Header.entryCount);
+	for (uint32_t slot = 0; slot < m_Header.tocSlotCount; ++slot)
+	{
+		if (m_Toc[slot].pathSize != 0)
+		{
+			paths.push_back({ m_Strings + m_Toc[slot].pathOffset, m_Toc[slot].pathSize });
+		}
+	}
+	return paths;
+}
+
+bool assets::AssetArchive::LoadAssetView(std::string_view assetPath, AssetView& outputView) const
+{
+	const ArchiveTocEntry* entry = Find(assetPath);
+	if (!entry)
+	{
+		return false;
+	}
+
+	const ArchiveEntryCompression* compression = m_Compression ? &m_Compression[entry - m_Toc] : nullptr;
+	if (compression && compression->dictionary != 0)
+	{
+		if (compression->dictionary > m_Header.dictionaryCount)
+		{
+			return false;
+		}
+		const ArchiveDictionary& dictionary = m_Dictionaries[compression->dictionary - 1];
+
+		std::vector<char> decoded(compression->originalSize);
+		int decodedSize = decompress_lz4_dictionary(m_Storage->data() + dictionary.offset, static_cast<int>(dictionary.size),
+			m_Storage->data() + entry->offset, decoded.data(), static_cast<int>(entry->size), static_cast<int>(decoded.size()));
+		if (decodedSize != (int)decoded.size())
+		{
+			std::cout << "Error when decompressing archive entry :" << assetPath << std::endl;
+			return false;
+		}
+
+		std::shared_ptr<MappedFile> storage = MappedFile::FromBuffer(std::move(decoded));
+		if (!ParseAssetView(storage->data(), storage->size(), outputView))
+		{
+			return false;
+		}
+		outputView.storage = std::move(storage);
+		return true;
+	}
+
+	if (!ParseAssetView(m_Storage->data() + entry->offset, entry->size, outputView))
+	{
+		return false;
+	}
+	outputView.storage = m_Storage;
+	return true;
+}
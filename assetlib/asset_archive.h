@@ -0,0 +1,111 @@
+#pragma once
+#include <asset_loader.h>
+#include <fstream>
+
+namespace assets
+{
+	//single file archive holding many baked assets, each entry is a complete asset file (header, metadata, blob)
+	//layout: ArchiveHeader | dictionaries | entries, each aligned to kArchiveAlignment | path strings | hashed toc | dictionary table | entry compression
+	//version 2 adds shared lz4 dictionaries per asset type, small entries can be stored compressed with the one of their type
+	constexpr uint32_t kArchiveVersion = 2;
+	constexpr uint64_t kArchiveAlignment = 64;
+
+	//bigger entries compress fine on their own and stay mapped without a copy
+	constexpr uint64_t kDictionaryEntryMaxSize = 64 * 1024;
+
+	struct ArchiveHeader {
+		char magic[4];
+		uint32_t version;
+		uint64_t tocOffset;
+		uint32_t tocSlotCount;	//power of two, open addressing with linear probing
+		uint32_t entryCount;
+		uint64_t stringsOffset;
+		uint64_t stringsSize;
+		//version 2
+		uint64_t dictionariesOffset;
+		uint64_t compressionOffset;	//one ArchiveEntryCompression per toc slot, 0 when the archive has no dictionaries
+		uint32_t dictionaryCount;
+		uint32_t reserved;
+	};
+
+	struct ArchiveDictionary {
+		char type[4];	//asset type the dictionary was trained on
+		uint32_t size;
+		uint64_t offset;
+	};
+
+	struct ArchiveEntryCompression {
+		uint32_t dictionary;	//index + 1 into the dictionary table, 0 when the entry is stored as it is
+		uint32_t reserved;
+		uint64_t originalSize;
+	};
+
+	struct ArchiveTocEntry {
+		uint64_t pathHash;
+		uint64_t offset;
+		uint64_t size;
+		uint32_t pathOffset;
+		uint32_t pathSize;
+	};
+
+	//hash used for the toc, paths are normalized to forward slashes first
+	uint64_t hash_asset_path(std::string_view path);
+
+	class ArchiveWriter {
+	public:
+		bool Open(const char* path);
+
+		//entries added afterwards whose asset type matches are compressed with it when that makes them smaller
+		bool AddDictionary(const char type[4], const std::vector<char>& dictionary);
+
+		//path is the same export relative path the runtime passes to AssetPath
+		bool AddEntry(std::string_view assetPath, const char* data, size_t size);
+		bool AddFile(std::string_view assetPath, const char* filePath);
+
+		bool Finish();
+	private:
+		struct PendingEntry {
+			std::string path;
+			uint64_t offset;
+			uint64_t size;
+			ArchiveEntryCompression compression;
+		};
+
+		struct PendingDictionary {
+			ArchiveDictionary header;
+			std::vector<char> data;
+		};
+
+		std::ofstream m_File;
+		std::vector<PendingEntry> m_Entries;
+		std::vector<PendingDictionary> m_Dictionaries;
+		uint64_t m_Cursor{ 0 };
+
+		void Pad(uint64_t alignment);
+	};
+
+	class AssetArchive {
+	public:
+		bool Open(const char* path);
+		bool IsOpen() const { return m_Storage != nullptr; }
+
+		//O(1) lookup of an asset, the view shares the archive mapping. Dictionary compressed entries are decoded into their own buffer
+		bool LoadAssetView(std::string_view assetPath, AssetView& outputView) const;
+		bool Contains(std::string_view assetPath) const;
+
+		//paths of every entry in toc order, they point into the archive mapping
+		std::vector<std::string_view> EntryPaths() const;
+
+		uint32_t EntryCount() const { return m_Header.entryCount; }
+		uint32_t DictionaryCount() const { return m_Header.dictionaryCount; }
+	private:
+		const ArchiveTocEntry* Find(std::string_view assetPath) const;
+
+		std::shared_ptr<MappedFile> m_Storage;
+		ArchiveHeader m_Header{};
+		const ArchiveTocEntry* m_Toc{ nullptr };
+		const char* m_Strings{ nullptr };
+		const ArchiveDictionary* m_Dictionaries{ nullptr };
+		const ArchiveEntryCompression* m_Compression{ nullptr };
+	};
+}
@@ -0,0 +1,370 @@
+#include <asset_async_loader.h>
+#include <asset_archive.h>
+#include <mesh_asset.h>
+#include <texture_asset.h>
+
+#include <fstream>
+#include <iostream>
+#include <cstring>
+#include <algorithm>
+#include <unordered_map>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef ASSETLIB_IO_URING
+#include <liburing.h>
+#endif
+
+//reads bigger than this are split, single reads are limited to a bit under 2gb on linux
+static const uint64_t s_kMaxReadSize = 1ull << 30;
+
+struct assets::AsyncLoader::PendingLoad {
+	AsyncLoadRequest request;
+	std::promise<AsyncLoadResult> promise;
+
+	std::vector<char> buffer;
+	uint64_t bytesRead{ 0 };
+	int fd{ -1 };
+	bool bFailed{ false };
+};
+
+#ifdef ASSETLIB_IO_URING
+struct assets::AsyncLoader::IoRing {
+	io_uring ring;
+};
+static const unsigned s_kRingDepth = 64;
+#else
+struct assets::AsyncLoader::IoRing {};
+#endif
+
+//false when the blob doesnt match its metadata
+static bool decode_blob(assets::AsyncLoadResult& result)
+{
+	using namespace assets;
+	const AssetView& view = result.view;
+
+	if (memcmp(view.type, "MESH", 4) == 0)
+	{
+		MeshInfo info = ReadMeshInfo(view);
+		if (info.compressionMode == CompressionMode::None)
+		{
+			//uncompressed blobs are used straight from the view
+			return true;
+		}
+		result.decoded.resize(info.vertexBufferSize + info.indexBufferSize);
+		return UnpackMesh(&info, view.binaryBlob.data(), view.binaryBlob.size(), result.decoded.data(), result.decoded.data() + info.vertexBufferSize);
+	}
+	else if (memcmp(view.type, "TEXI", 4) == 0)
+	{
+		TextureInfo info = ReadTextureInfo(view);
+		result.decoded.resize(info.textureSize);
+
+		std::vector<size_t> offsets;
+		size_t offset = 0;
+		for (auto& page : info.pages)
+		{
+			offsets.push_back(offset);
+			offset += page.originalSize;
+		}
+		return unpack_texture_pages_parallel(&info, view.binaryBlob.data(), view.binaryBlob.size(), result.decoded.data(), offsets);
+	}
+	return true;
+}
+
+assets::AsyncLoader::AsyncLoader() = default;
+
+assets::AsyncLoader::~AsyncLoader()
+{
+	Shutdown();
+}
+
+bool assets::AsyncLoader::Init(std::string rootPath, const AssetArchive* archive, uint32_t threadCount)
+{
+	m_RootPath = std::move(rootPath);
+	m_Archive = archive;
+	m_Workers = std::make_unique<ThreadPool>(threadCount);
+	m_bStopping = false;
+
+#ifdef ASSETLIB_IO_URING
+	m_Ring = std::make_unique<IoRing>();
+	if (io_uring_queue_init(s_kRingDepth, &m_Ring->ring, 0) == 0)
+	{
+		m_bIoUring = true;
+		m_IoThread = std::thread([this]() { IoLoop(); });
+	}
+	else
+	{
+		//kernels without io_uring or with it disabled, the workers do blocking reads instead
+		m_Ring.reset();
+	}
+#endif
+	return true;
+}
+
+void assets::AsyncLoader::Shutdown()
+{
+	if (m_IoThread.joinable())
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_IoMutex);
+			m_bStopping = true;
+		}
+		m_IoCondition.notify_all();
+		m_IoThread.join();
+
+#ifdef ASSETLIB_IO_URING
+		io_uring_queue_exit(&m_Ring->ring);
+#endif
+		m_Ring.reset();
+		m_bIoUring = false;
+	}
+
+	//waits for every queued load to finish
+	m_Workers.reset();
+}
+
+std::shared_future<assets::AsyncLoadResult> assets::AsyncLoader::Request(AsyncLoadRequest request)
+{
+	auto load = std::make_shared<PendingLoad>();
+	load->request = std::move(request);
+	std::shared_future<AsyncLoadResult> future = load->promise.get_future().share();
+
+	if (m_Archive && m_Archive->Contains(load->request.path))
+	{
+		//archive entries are already mapped, the page faults happen on the worker while decoding
+		m_Workers->Submit([this, load]() { Complete(load); });
+	}
+	else if (m_bIoUring)
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_IoMutex);
+			m_IoQueue.push_back(load);
+		}
+		m_IoCondition.notify_one();
+	}
+	else
+	{
+		m_Workers->Submit([this, load]() {
+			ReadBlocking(load);
+			Complete(load);
+		});
+	}
+	return future;
+}
+
+std::vector<std::shared_future<assets::AsyncLoadResult>> assets::AsyncLoader::RequestBatch(std::vector<AsyncLoadRequest> requests)
+{
+	std::vector<std::shared_future<AsyncLoadResult>> futures;
+	futures.reserve(requests.size());
+	for (auto& request : requests)
+	{
+		futures.push_back(Request(std::move(request)));
+	}
+	return futures;
+}
+
+void assets::AsyncLoader::ReadBlocking(const std::shared_ptr<PendingLoad>& load)
+{
+	std::string fullPath = m_RootPath + load->request.path;
+
+#ifdef _WIN32
+	std::ifstream infile;
+	infile.open(fullPath, std::ios::binary | std::ios::ate);
+	if (!infile.is_open())
+	{
+		load->bFailed = true;
+		return;
+	}
+
+	size_t size = (size_t)infile.tellg();
+	infile.seekg(0);
+
+	load->buffer.resize(size);
+	infile.read(load->buffer.data(), size);
+	load->bytesRead = (uint64_t)infile.gcount();
+	load->bFailed = load->bytesRead != size;
+#else
+	int fd = open(fullPath.c_str(), O_RDONLY);
+	if (fd < 0)
+	{
+		load->bFailed = true;
+		return;
+	}
+
+	struct stat st;
+	if (fstat(fd, &st) != 0)
+	{
+		close(fd);
+		load->bFailed = true;
+		return;
+	}
+
+	load->buffer.resize((size_t)st.st_size);
+	while (load->bytesRead < load->buffer.size())
+	{
+		size_t chunk = (size_t)std::min<uint64_t>(load->buffer.size() - load->bytesRead, s_kMaxReadSize);
+		ssize_t result = pread(fd, load->buffer.data() + load->bytesRead, chunk, (off_t)load->bytesRead);
+		if (result <= 0)
+		{
+			load->bFailed = true;
+			break;
+		}
+		load->bytesRead += (uint64_t)result;
+	}
+	close(fd);
+#endif
+}
+
+void assets::AsyncLoader::Complete(const std::shared_ptr<PendingLoad>& load)
+{
+	AsyncLoadResult result;
+	result.path = load->request.path;
+
+	if (m_Archive && m_Archive->Contains(result.path))
+	{
+		result.loaded = m_Archive->LoadAssetView(result.path, result.view);
+	}
+	else if (!load->bFailed)
+	{
+		std::shared_ptr<MappedFile> storage = MappedFile::FromBuffer(std::move(load->buffer));
+		result.loaded = ParseAssetView(storage->data(), storage->size(), result.view);
+		result.view.storage = std::move(storage);
+	}
+
+	if (!result.loaded)
+	{
+		std::cout << "Error when loading asset :" << result.path << std::endl;
+	}
+	else if (load->request.bDecompress && !decode_blob(result))
+	{
+		std::cout << "Error when decoding asset :" << result.path << std::endl;
+		result.loaded = false;
+		result.decoded.clear();
+	}
+
+	if (load->request.callback)
+	{
+		load->request.callback(result);
+	}
+	load->promise.set_value(std::move(result));
+}
+
+#ifdef ASSETLIB_IO_URING
+void assets::AsyncLoader::IoLoop()
+{
+	io_uring* ring = &m_Ring->ring;
+	std::unordered_map<PendingLoad*, std::shared_ptr<PendingLoad>> inFlight;
+
+	auto submit_read = [&](const std::shared_ptr<PendingLoad>& load) {
+		io_uring_sqe* sqe = io_uring_get_sqe(ring);
+		unsigned chunk = (unsigned)std::min<uint64_t>(load->buffer.size() - load->bytesRead, s_kMaxReadSize);
+		io_uring_prep_read(sqe, load->fd, load->buffer.data() + load->bytesRead, chunk, load->bytesRead);
+		io_uring_sqe_set_data(sqe, load.get());
+		inFlight[load.get()] = load;
+	};
+
+	auto finish = [&](const std::shared_ptr<PendingLoad>& load) {
+		if (load->fd >= 0)
+		{
+			close(load->fd);
+			load->fd = -1;
+		}
+		m_Workers->Submit([this, load]() { Complete(load); });
+	};
+
+	while (true)
+	{
+		std::vector<std::shared_ptr<PendingLoad>> incoming;
+		{
+			std::unique_lock<std::mutex> lock(m_IoMutex);
+			if (inFlight.empty())
+			{
+				m_IoCondition.wait(lock, [this]() { return m_bStopping || !m_IoQueue.empty(); });
+				if (m_IoQueue.empty())
+				{
+					return;
+				}
+			}
+
+			while (!m_IoQueue.empty() && inFlight.size() + incoming.size() < s_kRingDepth)
+			{
+				incoming.push_back(std::move(m_IoQueue.front()));
+				m_IoQueue.pop_front();
+			}
+		}
+
+		for (auto& load : incoming)
+		{
+			std::string fullPath = m_RootPath + load->request.path;
+			load->fd = open(fullPath.c_str(), O_RDONLY);
+
+			struct stat st;
+			if (load->fd < 0 || fstat(load->fd, &st) != 0 || st.st_size == 0)
+			{
+				load->bFailed = true;
+				finish(load);
+				continue;
+			}
+
+			load->buffer.resize((size_t)st.st_size);
+			submit_read(load);
+		}
+
+		if (inFlight.empty())
+		{
+			continue;
+		}
+		io_uring_submit(ring);
+
+		io_uring_cqe* cqe;
+		if (io_uring_wait_cqe(ring, &cqe) != 0)
+		{
+			continue;
+		}
+
+		unsigned head;
+		unsigned completed = 0;
+		std::vector<std::shared_ptr<PendingLoad>> resubmit;
+		io_uring_for_each_cqe(ring, head, cqe)
+		{
+			PendingLoad* key = (PendingLoad*)io_uring_cqe_get_data(cqe);
+			std::shared_ptr<PendingLoad> load = std::move(inFlight[key]);
+			inFlight.erase(key);
+
+			if (cqe->res <= 0)
+			{
+				load->bFailed = true;
+				finish(load);
+			}
+			else
+			{
+				load->bytesRead += (uint64_t)cqe->res;
+				if (load->bytesRead < load->buffer.size())
+				{
+					//short read, continue where it stopped
+					resubmit.push_back(std::move(load));
+				}
+				else
+				{
+					finish(load);
+				}
+			}
+			++completed;
+		}
+		io_uring_cq_advance(ring, completed);
+
+		for (auto& load : resubmit)
+		{
+			submit_read(load);
+		}
+	}
+}
+#else
+void assets::AsyncLoader::IoLoop()
+{
+}
+#endif
@@ -0,0 +1,71 @@
+#pragma once
+#include <asset_loader.h>
+#include <asset_threadpool.h>
+#include <future>
+#include <thread>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+
+namespace assets
+{
+	class AssetArchive;
+
+	struct AsyncLoadResult {
+		std::string path;
+		bool loaded{ false };
+
+		//complete view with the blob loaded, keeps its storage alive
+		AssetView view;
+
+		//decompressed blob when the request asked for it. Meshes are the vertex buffer followed by the index buffer,
+		//textures are every page in order. Uncompressed meshes are left empty
+		std::vector<char> decoded;
+	};
+
+	//called on a loader thread once the result is ready, before the future is fulfilled
+	using AsyncLoadCallback = std::function<void(const AsyncLoadResult&)>;
+
+	struct AsyncLoadRequest {
+		std::string path;
+		bool bDecompress{ false };
+		AsyncLoadCallback callback;
+	};
+
+	//reads assets on worker threads and optionally decompresses them there too.
+	//loose files are read with io_uring when assetlib is built with it, and with blocking reads on the workers otherwise
+	class AsyncLoader {
+	public:
+		AsyncLoader();
+		~AsyncLoader();
+
+		//rootPath is prepended to loose files. Paths found in the archive are served from it instead
+		bool Init(std::string rootPath, const AssetArchive* archive = nullptr, uint32_t threadCount = 0);
+		void Shutdown();
+
+		std::shared_future<AsyncLoadResult> Request(AsyncLoadRequest request);
+		std::vector<std::shared_future<AsyncLoadResult>> RequestBatch(std::vector<AsyncLoadRequest> requests);
+
+		bool UsesIoUring() const { return m_bIoUring; }
+	private:
+		struct PendingLoad;
+		struct IoRing;
+
+		void ReadBlocking(const std::shared_ptr<PendingLoad>& load);
+		void Complete(const std::shared_ptr<PendingLoad>& load);
+		void IoLoop();
+
+		std::string m_RootPath;
+		const AssetArchive* m_Archive{ nullptr };
+		std::unique_ptr<ThreadPool> m_Workers;
+
+		//io_uring submission thread, only used when the ring could be created
+		bool m_bIoUring{ false };
+		std::unique_ptr<IoRing> m_Ring;
+		std::thread m_IoThread;
+		std::deque<std::shared_ptr<PendingLoad>> m_IoQueue;
+		std::mutex m_IoMutex;
+		std::condition_variable m_IoCondition;
+		bool m_bStopping{ false };
+	};
+}
@@ -0,0 +1,166 @@
+#include <asset_dictionary.h>
+#include <lz4.h>
+#include <lz4hc.h>
+
+#include <cstring>
+#include <algorithm>
+#include <queue>
+#include <unordered_map>
+
+//runs are scored by the 8 byte sequences they contain, and picked in segments of this size
+static const size_t s_kKmerSize = 8;
+static const size_t s_kSegmentSize = 48;
+
+//caps training time on huge exports, the first samples are plenty to find the shared bytes
+static const size_t s_kMaxTrainingBytes = 32ull << 20;
+
+struct KmerCount {
+	uint32_t samples{ 0 };
+	uint32_t lastSample{ UINT32_MAX };
+};
+
+struct DictionarySegment {
+	uint64_t score;
+	uint32_t sample;
+	uint32_t offset;
+	uint32_t size;
+
+	//ties are broken by position so the same samples always train the same dictionary
+	bool operator<(const DictionarySegment& other) const
+	{
+		if (score != other.score) return score < other.score;
+		if (sample != other.sample) return sample > other.sample;
+		return offset > other.offset;
+	}
+};
+
+static uint64_t read_kmer(const char* p)
+{
+	uint64_t kmer;
+	memcpy(&kmer, p, s_kKmerSize);
+	return kmer;
+}
+
+static uint64_t score_segment(const std::unordered_map<uint64_t, KmerCount>& counts, const char* data, uint32_t size)
+{
+	//only sequences shared between samples are worth storing
+	uint64_t score = 0;
+	for (uint32_t i = 0; i + s_kKmerSize <= size; ++i)
+	{
+		auto it = counts.find(read_kmer(data + i));
+		if (it != counts.end() && it->second.samples > 1)
+		{
+			score += it->second.samples - 1;
+		}
+	}
+	return score;
+}
+
+std::vector<char> assets::train_dictionary(const std::vector<std::string_view>& samples, size_t maxSize)
+{
+	maxSize = std::min(maxSize, kMaxDictionarySize);
+
+	//how many samples contain every sequence
+	std::unordered_map<uint64_t, KmerCount> counts;
+	size_t trainingBytes = 0;
+	uint32_t sampleCount = 0;
+	for (; sampleCount < samples.size() && trainingBytes < s_kMaxTrainingBytes; ++sampleCount)
+	{
+		std::string_view sample = samples[sampleCount];
+		for (size_t i = 0; i + s_kKmerSize <= sample.size(); ++i)
+		{
+			KmerCount& count = counts[read_kmer(sample.data() + i)];
+			if (count.lastSample != sampleCount)
+			{
+				count.lastSample = sampleCount;
+				count.samples++;
+			}
+		}
+		trainingBytes += sample.size();
+	}
+
+	std::priority_queue<DictionarySegment> candidates;
+	for (uint32_t s = 0; s < sampleCount; ++s)
+	{
+		std::string_view sample = samples[s];
+		for (size_t offset = 0; offset + s_kKmerSize <= sample.size(); offset += s_kSegmentSize / 2)
+		{
+			DictionarySegment segment;
+			segment.sample = s;
+			segment.offset = static_cast<uint32_t>(offset);
+			segment.size = static_cast<uint32_t>(std::min(s_kSegmentSize, sample.size() - offset));
+			segment.score = score_segment(counts, sample.data() + offset, segment.size);
+			if (segment.score > 0)
+			{
+				candidates.push(segment);
+			}
+		}
+	}
+
+	//lazy greedy, a segment is rescored before it is taken since the ones picked before it may already cover its bytes
+	std::vector<DictionarySegment> chosen;
+	size_t dictionarySize = 0;
+	while (!candidates.empty() && dictionarySize < maxSize)
+	{
+		DictionarySegment segment = candidates.top();
+		candidates.pop();
+
+		const char* data = samples[segment.sample].data() + segment.offset;
+		uint64_t score = score_segment(counts, data, segment.size);
+		if (score == 0)
+		{
+			continue;
+		}
+		if (score < segment.score && !candidates.empty() && score < candidates.top().score)
+		{
+			segment.score = score;
+			candidates.push(segment);
+			continue;
+		}
+
+		for (uint32_t i = 0; i + s_kKmerSize <= segment.size; ++i)
+		{
+			counts[read_kmer(data + i)].samples = 0;
+		}
+		chosen.push_back(segment);
+		dictionarySize += segment.size;
+	}
+
+	//best segments go last, lz4 keeps the end of the dictionary when it is too long
+	std::vector<char> dictionary;
+	dictionary.reserve(dictionarySize);
+	for (auto it = chosen.rbegin(); it != chosen.rend(); ++it)
+	{
+		const char* data = samples[it->sample].data() + it->offset;
+		dictionary.insert(dictionary.end(), data, data + it->size);
+	}
+	if (dictionary.size() > maxSize)
+	{
+		dictionary.erase(dictionary.begin(), dictionary.end() - maxSize);
+	}
+	return dictionary;
+}
+
+int assets::compress_lz4_dictionary(const CompressionProfile& profile, const char* dictionary, int dictionarySize, const char* source, char* destination, int sourceSize, int destinationCapacity)
+{
+	if (profile.level > 0)
+	{
+		LZ4_streamHC_t* stream = LZ4_createStreamHC();
+		LZ4_resetStreamHC_fast(stream, profile.level);
+		LZ4_loadDictHC(stream, dictionary, dictionarySize);
+		int compressedSize = LZ4_compress_HC_continue(stream, source, destination, sourceSize, destinationCapacity);
+		LZ4_freeStreamHC(stream);
+		return compressedSize;
+	}
+
+	LZ4_stream_t* stream = LZ4_createStream();
+	LZ4_loadDict(stream, dictionary, dictionarySize);
+	int compressedSize = LZ4_compress_fast_continue(stream, source, destination, sourceSize, destinationCapacity, 1);
+	LZ4_freeStream(stream);
+	return compressedSize;
+}
+
+int assets::decompress_lz4_dictionary(const char* dictionary, int dictionarySize, const char* source, char* destination, int sourceSize, int destinationCapacity)
+{
+	return LZ4_decompress_safe_usingDict(source, destination, sourceSize, destinationCapacity, dictionary, dictionarySize);
+}
@@ -0,0 +1,18 @@
+#pragma once
+#include <asset_loader.h>
+
+namespace assets
+{
+	//lz4 only ever looks back 64kb, anything bigger in a dictionary is never referenced
+	constexpr size_t kMaxDictionarySize = 64 * 1024;
+
+	//builds a shared dictionary out of many small samples of the same asset type.
+	//picks the byte runs that show up in the most samples, the most useful ones end up last so they sit closest to the data
+	std::vector<char> train_dictionary(const std::vector<std::string_view>& samples, size_t maxSize = kMaxDictionarySize);
+
+	//like compress_lz4, but every block starts with the dictionary as history. Returns the compressed size or 0 on failure
+	int compress_lz4_dictionary(const CompressionProfile& profile, const char* dictionary, int dictionarySize, const char* source, char* destination, int sourceSize, int destinationCapacity);
+
+	//returns the decompressed size or a negative number on failure
+	int decompress_lz4_dictionary(const char* dictionary, int dictionarySize, const char* source, char* destination, int sourceSize, int destinationCapacity);
+}
@@ -1,10 +1,188 @@
 #include <asset_loader.h>
+#include <lz4.h>
+#include <lz4hc.h>
 
 #include <fstream>
 #include <iostream>
+#include <cstring>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+//type and version, shared by every container version
+static const size_t s_kAssetHeaderPrefixSize = 8;
+
+static size_t asset_header_size(int version)
+{
+	return version >= assets::kWideHeaderVersion ? 24 : 16;
+}
+
+//lengths come straight from the file, so they are checked against its size before anything is allocated for them.
+//each length is at most size, so the sum cant overflow
+static bool asset_lengths_fit(uint64_t size, size_t headerSize, uint64_t jsonlen, uint64_t blobLength)
+{
+	return jsonlen <= size && blobLength <= size && headerSize + jsonlen + blobLength <= size;
+}
+
+//size of the whole stream, the read position is left where it was
+static uint64_t stream_size(std::ifstream& infile)
+{
+	std::streampos position = infile.tellg();
+	infile.seekg(0, std::ios::end);
+	std::streampos end = infile.tellg();
+	infile.seekg(position);
+	return end < 0 ? 0 : (uint64_t)end;
+}
+
+//reads the json and blob lengths of a header whose prefix is already known, data must hold asset_header_size bytes
+static void read_asset_lengths(const char* data, int version, uint64_t& jsonlen, uint64_t& blobLength)
+{
+	if (version >= assets::kWideHeaderVersion)
+	{
+		memcpy(&jsonlen, data + 8, sizeof(uint64_t));
+		memcpy(&blobLength, data + 16, sizeof(uint64_t));
+	}
+	else
+	{
+		uint32_t jsonlen32 = 0;
+		uint32_t blobLength32 = 0;
+		memcpy(&jsonlen32, data + 8, sizeof(uint32_t));
+		memcpy(&blobLength32, data + 12, sizeof(uint32_t));
+		jsonlen = jsonlen32;
+		blobLength = blobLength32;
+	}
+}
+
+assets::MappedFile::~MappedFile()
+{
+	if (!m_Mapped)
+	{
+		return;
+	}
+#ifdef _WIN32
+	UnmapViewOfFile(m_Data);
+	CloseHandle((HANDLE)m_MappingHandle);
+	CloseHandle((HANDLE)m_FileHandle);
+#else
+	munmap((void*)m_Data, m_Size);
+#endif
+}
+
+std::shared_ptr<assets::MappedFile> assets::MappedFile::Open(const char* path)
+{
+	std::shared_ptr<MappedFile> file{ new MappedFile() };
+
+#ifdef _WIN32
+	HANDLE handle = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if (handle == INVALID_HANDLE_VALUE)
+	{
+		return nullptr;
+	}
+
+	LARGE_INTEGER fileSize;
+	if (GetFileSizeEx(handle, &fileSize) && fileSize.QuadPart > 0)
+	{
+		HANDLE mapping = CreateFileMappingA(handle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		if (mapping)
+		{
+			void* view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+			if (view)
+			{
+				file->m_Data = (const char*)view;
+				file->m_Size = (size_t)fileSize.QuadPart;
+				file->m_Mapped = true;
+				file->m_FileHandle = handle;
+				file->m_MappingHandle = mapping;
+				return file;
+			}
+			CloseHandle(mapping);
+		}
+	}
+	CloseHandle(handle);
+#else
+	int fd = open(path, O_RDONLY);
+	if (fd < 0)
+	{
+		return nullptr;
+	}
+
+	struct stat st;
+	if (fstat(fd, &st) == 0 && st.st_size > 0)
+	{
+		void* view = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (view != MAP_FAILED)
+		{
+			//the mapping keeps its own reference to the file
+			close(fd);
+			madvise(view, (size_t)st.st_size, MADV_SEQUENTIAL);
+
+			file->m_Data = (const char*)view;
+			file->m_Size = (size_t)st.st_size;
+			file->m_Mapped = true;
+			return file;
+		}
+	}
+	close(fd);
+#endif
+
+	//mapping failed (empty file, special filesystem...), read the whole thing instead
+	std::ifstream infile;
+	infile.open(path, std::ios::binary | std::ios::ate);
+	if (!infile.is_open())
+	{
+		return nullptr;
+	}
+
+	size_t size = (size_t)infile.tellg();
+	infile.seekg(0);
+
+	file->m_Fallback.resize(size);
+	infile.read(file->m_Fallback.data(), size);
+
+	file->m_Data = file->m_Fallback.data();
+	file->m_Size = size;
+	return file;
+}
+
+static void write_asset_header(std::ofstream& outfile, const char type[4], int version, uint64_t jsonLength, uint64_t blobLength)
+{
+	outfile.write(type, 4);
+
+	uint32_t version32 = version;
+	outfile.write((const char*)&version32, sizeof(uint32_t));
+
+	if (version >= assets::kWideHeaderVersion)
+	{
+		outfile.write((const char*)&jsonLength, sizeof(uint64_t));
+		outfile.write((const char*)&blobLength, sizeof(uint64_t));
+	}
+	else
+	{
+		uint32_t length = static_cast<uint32_t>(jsonLength);
+		outfile.write((const char*)&length, sizeof(uint32_t));
+
+		uint32_t bloblength = static_cast<uint32_t>(blobLength);
+		outfile.write((const char*)&bloblength, sizeof(uint32_t));
+	}
+}
 
 bool assets::SaveBinaryFile(const char* path, const AssetFile& file)
 {
+	bool bWide = file.version >= kWideHeaderVersion;
+	if (!bWide && (file.json.size() > UINT32_MAX || file.binaryBlob.size() > UINT32_MAX))
+	{
+		std::cout << "Asset is too big for a version " << file.version << " container :" << path << std::endl;
+		return false;
+	}
+
 	std::ofstream outfile;
 	outfile.open(path, std::ios::binary | std::ios::out);
 	if (!outfile.is_open())
@@ -12,18 +190,9 @@ bool assets::SaveBinaryFile(const char* path, const AssetFile& file)
 		std::cout << "Error when trying to write file :" << path << std::endl;
 		return false;
 	}
-	outfile.write(file.type, 4);
-
-	uint32_t version = file.version;
-	outfile.write((const char*)&version, sizeof(uint32_t));
-
-	uint32_t length = static_cast<uint32_t>(file.json.size());
-	outfile.write((const char*)&length, sizeof(uint32_t));
-
-	uint32_t bloblength = static_cast<uint32_t>(file.binaryBlob.size());
-	outfile.write((const char*)&bloblength, sizeof(uint32_t));
+	write_asset_header(outfile, file.type, file.version, file.json.size(), file.binaryBlob.size());
 
-	outfile.write(file.json.data(), length);
+	outfile.write(file.json.data(), file.json.size());
 
 	outfile.write(file.binaryBlob.data(), file.binaryBlob.size());
 
@@ -32,6 +201,55 @@ bool assets::SaveBinaryFile(const char* path, const AssetFile& file)
 	return true;
 }
 
+bool assets::AssetFileWriter::Open(const char* path, const char type[4], int version, const std::string& json)
+{
+	m_File.open(path, std::ios::binary | std::ios::out | std::ios::trunc);
+	if (!m_File.is_open())
+	{
+		std::cout << "Error when trying to write file :" << path << std::endl;
+		return false;
+	}
+	memcpy(m_Type, type, 4);
+	m_Version = version;
+	m_JsonSize = json.size();
+	m_BlobSize = 0;
+
+	write_asset_header(m_File, m_Type, m_Version, json.size(), 0);
+	m_File.write(json.data(), json.size());
+	return m_File.good();
+}
+
+bool assets::AssetFileWriter::Write(const char* data, size_t size)
+{
+	m_File.write(data, size);
+	m_BlobSize += size;
+	return m_File.good();
+}
+
+bool assets::AssetFileWriter::Finish(const std::string& json)
+{
+	bool bWide = m_Version >= kWideHeaderVersion;
+	if (json.size() != m_JsonSize || (!bWide && m_BlobSize > UINT32_MAX))
+	{
+		std::cout << "Streamed asset metadata changed size or the blob is too big for a version " << m_Version << " container" << std::endl;
+		m_File.close();
+		return false;
+	}
+
+	m_File.seekp(0);
+	write_asset_header(m_File, m_Type, m_Version, json.size(), m_BlobSize);
+	m_File.write(json.data(), json.size());
+	m_File.close();
+	return !m_File.fail();
+}
+
+void assets::align_asset_blob(AssetFile& file, size_t alignment)
+{
+	size_t blobOffset = asset_header_size(file.version) + file.json.size();
+	size_t padding = (alignment - blobOffset % alignment) % alignment;
+	file.json.append(padding, '\0');
+}
+
 bool assets::LoadBinaryFile(const char* path, AssetFile& outputFile)
 {
 	std::ifstream infile;
@@ -42,15 +260,26 @@ bool assets::LoadBinaryFile(const char* path, AssetFile& outputFile)
 
 	infile.seekg(0);
 
-	infile.read(outputFile.type, 4);
+	char header[24];
+	infile.read(header, s_kAssetHeaderPrefixSize);
 
-	infile.read((char*)&outputFile.version, sizeof(uint32_t));
+	memcpy(outputFile.type, header, 4);
+	memcpy(&outputFile.version, header + 4, sizeof(uint32_t));
 
-	uint32_t jsonlen = 0;
-	infile.read((char*)&jsonlen, sizeof(uint32_t));
+	size_t headerSize = asset_header_size(outputFile.version);
+	infile.read(header + s_kAssetHeaderPrefixSize, headerSize - s_kAssetHeaderPrefixSize);
+	if (!infile)
+	{
+		return false;
+	}
 
-	uint32_t blobLength = 0;
-	infile.read((char*)&blobLength, sizeof(uint32_t));
+	uint64_t jsonlen = 0;
+	uint64_t blobLength = 0;
+	read_asset_lengths(header, outputFile.version, jsonlen, blobLength);
+	if (!asset_lengths_fit(stream_size(infile), headerSize, jsonlen, blobLength))
+	{
+		return false;
+	}
 
 	outputFile.json.resize(jsonlen);
 	infile.read(outputFile.json.data(), jsonlen);
@@ -61,14 +290,256 @@ bool assets::LoadBinaryFile(const char* path, AssetFile& outputFile)
 	return true;
 }
 
+std::shared_ptr<assets::MappedFile> assets::MappedFile::FromBuffer(std::vector<char>&& buffer)
+{
+	std::shared_ptr<MappedFile> file{ new MappedFile() };
+	file->m_Fallback = std::move(buffer);
+	file->m_Data = file->m_Fallback.data();
+	file->m_Size = file->m_Fallback.size();
+	return file;
+}
+
+bool assets::LoadAssetView(const char* path, AssetView& outputView)
+{
+	std::shared_ptr<MappedFile> storage = MappedFile::Open(path);
+	if (!storage)
+	{
+		return false;
+	}
+
+	if (!ParseAssetView(storage->data(), storage->size(), outputView))
+	{
+		std::cout << "Malformed asset file :" << path << std::endl;
+		return false;
+	}
+
+	outputView.storage = std::move(storage);
+	return true;
+}
+
+bool assets::ParseAssetView(const char* data, size_t size, AssetView& outputView)
+{
+	if (size < s_kAssetHeaderPrefixSize)
+	{
+		return false;
+	}
+
+	memcpy(outputView.type, data, 4);
+	memcpy(&outputView.version, data + 4, sizeof(uint32_t));
+
+	size_t headerSize = asset_header_size(outputView.version);
+	if (size < headerSize)
+	{
+		return false;
+	}
+
+	uint64_t jsonlen = 0;
+	uint64_t blobLength = 0;
+	read_asset_lengths(data, outputView.version, jsonlen, blobLength);
+
+	if (!asset_lengths_fit(size, headerSize, jsonlen, blobLength))
+	{
+		return false;
+	}
+
+	outputView.json = std::string_view{ data + headerSize, (size_t)jsonlen };
+	outputView.binaryBlob = BlobSpan{ data + headerSize + jsonlen, (size_t)blobLength };
+	outputView.blobOffset = headerSize + jsonlen;
+	outputView.blobSize = blobLength;
+
+	return true;
+}
+
+bool assets::ProbeAsset(const char* path, AssetView& outputView)
+{
+	std::ifstream infile;
+	infile.open(path, std::ios::binary);
+
+	if (!infile.is_open())
+		return false;
+
+	std::vector<char> buffer;
+	buffer.resize(s_kAssetHeaderPrefixSize);
+	infile.read(buffer.data(), s_kAssetHeaderPrefixSize);
+	if (infile.gcount() != s_kAssetHeaderPrefixSize)
+	{
+		return false;
+	}
+
+	int version = 0;
+	memcpy(&version, buffer.data() + 4, sizeof(uint32_t));
+
+	size_t headerSize = asset_header_size(version);
+	buffer.resize(headerSize);
+	infile.read(buffer.data() + s_kAssetHeaderPrefixSize, headerSize - s_kAssetHeaderPrefixSize);
+	if ((size_t)infile.gcount() != headerSize - s_kAssetHeaderPrefixSize)
+	{
+		return false;
+	}
+
+	uint64_t jsonlen = 0;
+	uint64_t blobLength = 0;
+	read_asset_lengths(buffer.data(), version, jsonlen, blobLength);
+
+	//a corrupt header would otherwise turn the probe into a huge allocation
+	if (!asset_lengths_fit(stream_size(infile), headerSize, jsonlen, blobLength))
+	{
+		std::cout << "Malformed asset file :" << path << std::endl;
+		return false;
+	}
+
+	buffer.resize(headerSize + jsonlen);
+	infile.read(buffer.data() + headerSize, jsonlen);
+	if ((uint64_t)infile.gcount() != jsonlen)
+	{
+		return false;
+	}
+
+	std::shared_ptr<MappedFile> storage = MappedFile::FromBuffer(std::move(buffer));
+
+	memcpy(outputView.type, storage->data(), 4);
+	outputView.version = version;
+	outputView.json = std::string_view{ storage->data() + headerSize, (size_t)jsonlen };
+	outputView.binaryBlob = BlobSpan{};
+	outputView.blobOffset = headerSize + jsonlen;
+	outputView.blobSize = blobLength;
+	outputView.storage = std::move(storage);
+
+	return true;
+}
+
+bool assets::LoadAssetBlob(const char* path, AssetView& view)
+{
+	if (view.IsBlobLoaded())
+	{
+		return true;
+	}
+
+	AssetView fullView;
+	if (!LoadAssetView(path, fullView))
+	{
+		return false;
+	}
+
+	//the file changed on disk since it was probed
+	if (memcmp(fullView.type, view.type, 4) != 0 || fullView.blobOffset != view.blobOffset || fullView.blobSize != view.blobSize || fullView.json.size() != view.json.size())
+	{
+		std::cout << "Asset changed since it was probed :" << path << std::endl;
+		return false;
+	}
+
+	view = std::move(fullView);
+	return true;
+}
+
+bool assets::ReadAssetBlob(const char* path, const AssetView& view, char* destination)
+{
+	if (view.IsBlobLoaded())
+	{
+		memcpy(destination, view.binaryBlob.data(), view.binaryBlob.size());
+		return true;
+	}
+
+	std::ifstream infile;
+	infile.open(path, std::ios::binary);
+
+	if (!infile.is_open())
+		return false;
+
+	//the file may have shrunk since it was probed
+	uint64_t size = stream_size(infile);
+	if (view.blobOffset > size || view.blobSize > size - view.blobOffset)
+	{
+		std::cout << "Asset changed since it was probed :" << path << std::endl;
+		return false;
+	}
+
+	infile.seekg(view.blobOffset);
+	infile.read(destination, view.blobSize);
+
+	return (uint64_t)infile.gcount() == view.blobSize;
+}
+
 assets::CompressionMode assets::parse_compression(const char* f)
 {
 	if (strcmp(f, "LZ4") == 0)
 	{
 		return assets::CompressionMode::LZ4;
 	}
+	else if (strcmp(f, "MeshCodec") == 0)
+	{
+		return assets::CompressionMode::MeshCodec;
+	}
 	else
 	{
 		return assets::CompressionMode::None;
 	}
 }
+
+const char* assets::compression_name(CompressionMode mode)
+{
+	switch (mode)
+	{
+	case CompressionMode::LZ4:
+		return "LZ4";
+	case CompressionMode::MeshCodec:
+		return "MeshCodec";
+	default:
+		return "None";
+	}
+}
+
+bool assets::parse_compression_profile(const char* f, CompressionProfile& outProfile)
+{
+	if (strcmp(f, "none") == 0)
+	{
+		outProfile.mode = CompressionMode::None;
+		outProfile.level = 0;
+		return true;
+	}
+	if (strcmp(f, "fast") == 0)
+	{
+		outProfile.mode = CompressionMode::LZ4;
+		outProfile.level = 0;
+		return true;
+	}
+	if (strncmp(f, "hc", 2) == 0)
+	{
+		int level = LZ4HC_CLEVEL_DEFAULT;
+		if (f[2] != '\0')
+		{
+			level = atoi(f + 2);
+		}
+		if (level < 1 || level > LZ4HC_CLEVEL_MAX)
+		{
+			return false;
+		}
+		outProfile.mode = CompressionMode::LZ4;
+		outProfile.level = level;
+		return true;
+	}
+	return false;
+}
+
+std::string assets::compression_profile_name(const CompressionProfile& profile)
+{
+	if (profile.mode == CompressionMode::None)
+	{
+		return "none";
+	}
+	std::string name = profile.mode == CompressionMode::MeshCodec ? "codec+" : "";
+	if (profile.level == 0)
+	{
+		return name + "fast";
+	}
+	return name + "hc" + std::to_string(profile.level);
+}
+
+int assets::compress_lz4(const CompressionProfile& profile, const char* source, char* destination, int sourceSize, int destinationCapacity)
+{
+	if (profile.level > 0)
+	{
+		return LZ4_compress_HC(source, destination, sourceSize, destinationCapacity, profile.level);
+	}
+	return LZ4_compress_default(source, destination, sourceSize, destinationCapacity);
+}
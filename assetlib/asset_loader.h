@@ -1,10 +1,17 @@
 #pragma once
 #include <vector>
 #include <string>
+#include <string_view>
 #include <unordered_map>
+#include <memory>
+#include <fstream>
+#include <cstdint>
 
 namespace assets
 {
+	//version 1 and 2 containers store the json and blob lengths as 32 bit, from version 3 on they are 64 bit
+	constexpr int kWideHeaderVersion = 3;
+
 	struct AssetFile {
 		char type[4];
 		int version;
@@ -12,14 +19,118 @@ namespace assets
 		std::vector<char> binaryBlob;
 	};
 
+	//non-owning view over a range of bytes, mirrors the data()/size() api of std::vector so unpackers can take either
+	struct BlobSpan {
+		const char* ptr{ nullptr };
+		size_t length{ 0 };
+
+		const char* data() const { return ptr; }
+		size_t size() const { return length; }
+		bool empty() const { return length == 0; }
+	};
+
+	//read only backing storage for an AssetView, either a memory mapping of the file or a heap copy if mapping failed
+	class MappedFile {
+	public:
+		~MappedFile();
+
+		static std::shared_ptr<MappedFile> Open(const char* path);
+		static std::shared_ptr<MappedFile> FromBuffer(std::vector<char>&& buffer);
+
+		const char* data() const { return m_Data; }
+		size_t size() const { return m_Size; }
+		bool IsMapped() const { return m_Mapped; }
+	private:
+		const char* m_Data{ nullptr };
+		size_t m_Size{ 0 };
+		bool m_Mapped{ false };
+
+		//fallback storage when the file couldnt be mapped
+		std::vector<char> m_Fallback;
+
+		void* m_FileHandle{ nullptr };
+		void* m_MappingHandle{ nullptr };
+	};
+
+	//zero-copy version of AssetFile. json and binaryBlob point straight into the mapped file,
+	//so they are only valid while the view (or a copy of it) is alive
+	struct AssetView {
+		char type[4];
+		int version;
+		std::string_view json;
+		BlobSpan binaryBlob;
+
+		//location of the blob inside the file, binaryBlob is empty until loaded when the view comes from ProbeAsset
+		uint64_t blobOffset{ 0 };
+		uint64_t blobSize{ 0 };
+
+		bool IsBlobLoaded() const { return binaryBlob.size() == blobSize; }
+
+		std::shared_ptr<MappedFile> storage;
+	};
+
 	enum class CompressionMode : uint32_t {
 		None,
 		LZ4,
+		MeshCodec,	//meshes only, zigzag delta indices and byte shuffled vertices ahead of lz4
+	};
+
+	//how the baker compresses a blob. Every LZ4 level decodes with the same LZ4_decompress_safe path
+	struct CompressionProfile {
+		CompressionMode mode = CompressionMode::LZ4;
+		int level = 0;	//0 uses the fast compressor, 1 to 12 are lz4hc levels
+
+		//split blobs bigger than this into independent lz4 blocks that can be decoded in parallel, 0 keeps a single block
+		uint32_t chunkSize = 0;
 	};
 
 	bool SaveBinaryFile(const char* path, const AssetFile& file);
 
+	//writes an asset whose blob is produced in pieces, straight to the file. Finish writes the header and the metadata again,
+	//so the metadata passed to Open has to be a placeholder of the final size
+	class AssetFileWriter {
+	public:
+		bool Open(const char* path, const char type[4], int version, const std::string& json);
+		bool Write(const char* data, size_t size);
+		bool Finish(const std::string& json);
+
+		uint64_t BlobSize() const { return m_BlobSize; }
+	private:
+		std::ofstream m_File;
+		char m_Type[4];
+		int m_Version{ 0 };
+		uint64_t m_JsonSize{ 0 };
+		uint64_t m_BlobSize{ 0 };
+	};
+
+	//pads the metadata so the blob starts at a multiple of alignment in the saved file. Binary metadata ignores the trailing bytes
+	void align_asset_blob(AssetFile& file, size_t alignment);
+
 	bool LoadBinaryFile(const char* path, AssetFile& outputFile);
 
+	bool LoadAssetView(const char* path, AssetView& outputView);
+
+	//reads only the header and the json, the blob can be brought in later with LoadAssetBlob or ReadAssetBlob
+	bool ProbeAsset(const char* path, AssetView& outputView);
+
+	//maps the whole file behind a probed view, json and binaryBlob are repointed to the mapping
+	bool LoadAssetBlob(const char* path, AssetView& view);
+
+	//copies the blob of a probed view straight into caller memory, destination must hold view.blobSize bytes
+	bool ReadAssetBlob(const char* path, const AssetView& view, char* destination);
+
+	//parses the asset header out of an already loaded memory range, used by LoadAssetView
+	bool ParseAssetView(const char* data, size_t size, AssetView& outputView);
+
 	assets::CompressionMode parse_compression(const char* f);
-}
\ No newline at end of file
+
+	const char* compression_name(CompressionMode mode);
+
+	//accepts none, fast, hc (default hc level) or hcN. The mesh codec is chosen on top of a profile by setting its mode
+	bool parse_compression_profile(const char* f, CompressionProfile& outProfile);
+
+	std::string compression_profile_name(const CompressionProfile& profile);
+
+	//compresses with the profile into destination, returns the compressed size or 0 on failure
+	int compress_lz4(const CompressionProfile& profile, const char* source, char* destination, int sourceSize, int destinationCapacity);
+}
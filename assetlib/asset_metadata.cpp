@@ -0,0 +1,75 @@
+#include <asset_metadata.h>
+
+assets::MetaString assets::MetadataWriter::AddString(std::string_view s)
+{
+	MetaString string;
+	string.offset = static_cast<uint32_t>(m_Strings.size());
+	string.size = static_cast<uint32_t>(s.size());
+
+	m_Strings.append(s.data(), s.size());
+	return string;
+}
+
+std::string assets::MetadataWriter::Finish(const char tag[4], uint32_t layoutVersion, const void* fixed, size_t fixedSize)
+{
+	MetadataHeader header;
+	memcpy(header.tag, tag, 4);
+	header.layoutVersion = layoutVersion;
+	header.fixedSize = static_cast<uint32_t>(fixedSize);
+	header.payloadSize = static_cast<uint32_t>(m_Payload.size());
+	header.stringsSize = static_cast<uint32_t>(m_Strings.size());
+
+	std::string section;
+	section.reserve(sizeof(MetadataHeader) + fixedSize + m_Payload.size() + m_Strings.size());
+	section.append((const char*)&header, sizeof(MetadataHeader));
+	section.append((const char*)fixed, fixedSize);
+	section.append(m_Payload.data(), m_Payload.size());
+	section.append(m_Strings);
+
+	return section;
+}
+
+bool assets::MetadataReader::Open(std::string_view section, const char tag[4])
+{
+	if (section.size() < sizeof(MetadataHeader))
+	{
+		return false;
+	}
+
+	memcpy(&m_Header, section.data(), sizeof(MetadataHeader));
+	if (memcmp(m_Header.tag, tag, 4) != 0)
+	{
+		return false;
+	}
+
+	size_t total = sizeof(MetadataHeader) + (size_t)m_Header.fixedSize + m_Header.payloadSize + m_Header.stringsSize;
+	if (total > section.size())
+	{
+		return false;
+	}
+
+	m_Fixed = section.data() + sizeof(MetadataHeader);
+	m_Payload = m_Fixed + m_Header.fixedSize;
+	m_Strings = m_Payload + m_Header.payloadSize;
+	return true;
+}
+
+std::string_view assets::MetadataReader::GetString(MetaString s) const
+{
+	if ((size_t)s.offset + s.size > m_Header.stringsSize)
+	{
+		return {};
+	}
+	return std::string_view{ m_Strings + s.offset, s.size };
+}
+
+bool assets::MetadataReader::ValidArray(MetaArray array, size_t elementSize) const
+{
+	//64 bit, a 32 bit count times the element size cant overflow it
+	return (uint64_t)array.offset + (uint64_t)array.count * elementSize <= m_Header.payloadSize;
+}
+
+bool assets::IsBinaryMetadata(int assetVersion)
+{
+	return assetVersion >= kBinaryMetadataVersion;
+}
@@ -0,0 +1,116 @@
+#pragma once
+#include <asset_loader.h>
+#include <cstring>
+#include <algorithm>
+
+namespace assets
+{
+	//asset versions 2 and up store their metadata in a compact binary section instead of json
+	//layout: MetadataHeader | fixed struct | payload (arrays) | string table
+	constexpr int kJsonMetadataVersion = 1;
+	constexpr int kBinaryMetadataVersion = 2;
+
+	//what the packers write, binary metadata in a container with 64 bit lengths
+	constexpr int kCurrentAssetVersion = kWideHeaderVersion;
+
+	enum class MetadataFormat : uint32_t {
+		Json,
+		Binary,
+	};
+
+	struct MetadataHeader {
+		char tag[4];
+		uint32_t layoutVersion;
+		uint32_t fixedSize;
+		uint32_t payloadSize;
+		uint32_t stringsSize;
+	};
+
+	//reference into the string table of the metadata section
+	struct MetaString {
+		uint32_t offset;
+		uint32_t size;
+	};
+
+	//reference into the payload of the metadata section
+	struct MetaArray {
+		uint32_t offset;
+		uint32_t count;
+	};
+
+	class MetadataWriter {
+	public:
+		MetaString AddString(std::string_view s);
+
+		template<typename T>
+		MetaArray AddArray(const T* data, size_t count);
+
+		//builds the final section, fixed is the per-type struct written right after the header
+		std::string Finish(const char tag[4], uint32_t layoutVersion, const void* fixed, size_t fixedSize);
+	private:
+		std::vector<char> m_Payload;
+		std::string m_Strings;
+	};
+
+	//reads a binary metadata section in place, nothing is allocated
+	class MetadataReader {
+	public:
+		bool Open(std::string_view section, const char tag[4]);
+
+		uint32_t LayoutVersion() const { return m_Header.layoutVersion; }
+
+		//copies the fixed struct out. Fields appended by newer layouts are zeroed when reading older sections
+		template<typename T>
+		void ReadFixed(T& out) const;
+
+		//false when the array runs past the payload. Counts come from the file, so check this before sizing anything by them
+		bool ValidArray(MetaArray array, size_t elementSize) const;
+
+		//elements outside the payload read as zero
+		template<typename T>
+		T ReadElement(MetaArray array, uint32_t index) const;
+
+		std::string_view GetString(MetaString s) const;
+	private:
+		MetadataHeader m_Header{};
+		const char* m_Fixed{ nullptr };
+		const char* m_Payload{ nullptr };
+		const char* m_Strings{ nullptr };
+	};
+
+	bool IsBinaryMetadata(int assetVersion);
+
+	template<typename T>
+	MetaArray MetadataWriter::AddArray(const T* data, size_t count)
+	{
+		MetaArray array;
+		array.offset = static_cast<uint32_t>(m_Payload.size());
+		array.count = static_cast<uint32_t>(count);
+
+		m_Payload.resize(m_Payload.size() + sizeof(T) * count);
+		memcpy(m_Payload.data() + array.offset, data, sizeof(T) * count);
+		return array;
+	}
+
+	template<typename T>
+	void MetadataReader::ReadFixed(T& out) const
+	{
+		memset(&out, 0, sizeof(T));
+		memcpy(&out, m_Fixed, std::min<size_t>(sizeof(T), m_Header.fixedSize));
+	}
+
+	template<typename T>
+	T MetadataReader::ReadElement(MetaArray array, uint32_t index) const
+	{
+		//payload has no alignment guarantees, copy out instead of casting
+		T element;
+		uint64_t offset = (uint64_t)array.offset + (uint64_t)sizeof(T) * index;
+		if (offset + sizeof(T) > m_Header.payloadSize)
+		{
+			memset(&element, 0, sizeof(T));
+			return element;
+		}
+		memcpy(&element, m_Payload + offset, sizeof(T));
+		return element;
+	}
+}
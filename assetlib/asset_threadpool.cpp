@@ -0,0 +1,124 @@
+#include <asset_threadpool.h>
+
+#include <atomic>
+#include <algorithm>
+#include <memory>
+
+assets::ThreadPool::ThreadPool(uint32_t threadCount)
+{
+	if (threadCount == 0)
+	{
+		uint32_t hardwareThreads = std::thread::hardware_concurrency();
+		threadCount = hardwareThreads > 1 ? hardwareThreads - 1 : 1;
+	}
+
+	m_Workers.reserve(threadCount);
+	for (uint32_t i = 0; i < threadCount; ++i)
+	{
+		m_Workers.emplace_back([this]() { WorkerLoop(); });
+	}
+}
+
+assets::ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		m_Stopping = true;
+	}
+	m_Condition.notify_all();
+
+	for (auto& worker : m_Workers)
+	{
+		worker.join();
+	}
+}
+
+void assets::ThreadPool::Submit(std::function<void()> task)
+{
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		m_Tasks.push_back(std::move(task));
+	}
+	m_Condition.notify_one();
+}
+
+void assets::ThreadPool::WorkerLoop()
+{
+	while (true)
+	{
+		std::function<void()> task;
+		{
+			std::unique_lock<std::mutex> lock(m_Mutex);
+			m_Condition.wait(lock, [this]() { return m_Stopping || !m_Tasks.empty(); });
+
+			if (m_Stopping && m_Tasks.empty())
+			{
+				return;
+			}
+
+			task = std::move(m_Tasks.front());
+			m_Tasks.pop_front();
+		}
+		task();
+	}
+}
+
+void assets::ThreadPool::ParallelFor(size_t count, const std::function<void(size_t)>& function)
+{
+	if (count == 0)
+	{
+		return;
+	}
+	if (count == 1 || m_Workers.empty())
+	{
+		for (size_t i = 0; i < count; ++i)
+		{
+			function(i);
+		}
+		return;
+	}
+
+	//helpers that start after the loop is finished find no index left and never touch function
+	struct Batch {
+		std::atomic<size_t> next{ 0 };
+		std::atomic<size_t> finished{ 0 };
+		size_t count{ 0 };
+		const std::function<void(size_t)>* function{ nullptr };
+		std::mutex mutex;
+		std::condition_variable done;
+	};
+
+	auto batch = std::make_shared<Batch>();
+	batch->count = count;
+	batch->function = &function;
+
+	auto run = [](Batch& b) {
+		size_t index;
+		while ((index = b.next.fetch_add(1)) < b.count)
+		{
+			(*b.function)(index);
+			if (b.finished.fetch_add(1) + 1 == b.count)
+			{
+				std::lock_guard<std::mutex> lock(b.mutex);
+				b.done.notify_all();
+			}
+		}
+	};
+
+	size_t helpers = std::min<size_t>(count - 1, m_Workers.size());
+	for (size_t i = 0; i < helpers; ++i)
+	{
+		Submit([batch, run]() { run(*batch); });
+	}
+
+	run(*batch);
+
+	std::unique_lock<std::mutex> lock(batch->mutex);
+	batch->done.wait(lock, [&]() { return batch->finished.load() == batch->count; });
+}
+
+assets::ThreadPool& assets::GetDecodeThreadPool()
+{
+	static ThreadPool pool;
+	return pool;
+}
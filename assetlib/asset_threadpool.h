@@ -0,0 +1,41 @@
+#pragma once
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <cstdint>
+
+namespace assets
+{
+	//fixed size worker pool used to spread decompression of a single asset over several cores
+	class ThreadPool {
+	public:
+		//0 threads uses one worker per hardware thread minus the caller
+		explicit ThreadPool(uint32_t threadCount = 0);
+		~ThreadPool();
+
+		ThreadPool(const ThreadPool&) = delete;
+		ThreadPool& operator=(const ThreadPool&) = delete;
+
+		void Submit(std::function<void()> task);
+
+		//runs function(0..count-1) across the workers. The calling thread works too and only returns once every index is done,
+		//so it is safe to call from inside a pool task
+		void ParallelFor(size_t count, const std::function<void(size_t)>& function);
+
+		uint32_t ThreadCount() const { return static_cast<uint32_t>(m_Workers.size()); }
+	private:
+		void WorkerLoop();
+
+		std::vector<std::thread> m_Workers;
+		std::deque<std::function<void()>> m_Tasks;
+		std::mutex m_Mutex;
+		std::condition_variable m_Condition;
+		bool m_Stopping{ false };
+	};
+
+	//pool shared by the unpack functions, created on first use
+	ThreadPool& GetDecodeThreadPool();
+}
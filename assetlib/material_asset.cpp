@@ -1,6 +1,8 @@
 #include <material_asset.h>
+#include <asset_metadata.h>
 #include <lz4.h>
 #include <json.hpp>
+#include <algorithm>
 
 using nlohmann::json;
 
@@ -15,7 +17,22 @@ static const char* s_TransparenyModeName[] = {
 	"Masked",
 };
 
-assets::TransparencyMode parse_transparency(const char* s)
+static const char s_kMaterialTag[4] = { 'M','A','T','X' };
+
+struct MaterialEntryBinary {
+	assets::MetaString key;
+	assets::MetaString value;
+};
+
+//fixed part of the binary metadata, only ever append fields to keep older assets readable
+struct MaterialMetadataBinary {
+	assets::MetaString baseEffect;
+	uint32_t transparency;
+	assets::MetaArray textures;
+	assets::MetaArray customProperties;
+};
+
+static assets::TransparencyMode parse_transparency(const char* s)
 {
 	for (int i = 0; i < (int)(assets::TransparencyMode::Count); ++i)
 	{
@@ -27,11 +44,11 @@ assets::TransparencyMode parse_transparency(const char* s)
 	return assets::TransparencyMode::Opaque;
 }
 
-assets::MaterialInfo assets::read_material_info(AssetFile* file)
+static assets::MaterialInfo read_material_info_json(std::string_view jsonString)
 {
 	assets::MaterialInfo info;
 
-	json metadata = json::parse(file->json);
+	json metadata = json::parse(jsonString.begin(), jsonString.end());
 	info.baseEffect = metadata[s_kBaseEffect];
 
 	for (auto& [key, value] : metadata[s_kTextures].items())
@@ -49,23 +66,111 @@ assets::MaterialInfo assets::read_material_info(AssetFile* file)
 	return info;
 }
 
-assets::AssetFile assets::pack_material(MaterialInfo* info)
+static void read_material_entries(const assets::MetadataReader& reader, assets::MetaArray array, std::unordered_map<std::string, std::string>& outEntries)
+{
+	outEntries.reserve(array.count);
+	for (uint32_t i = 0; i < array.count; ++i)
+	{
+		MaterialEntryBinary entry = reader.ReadElement<MaterialEntryBinary>(array, i);
+		outEntries.emplace(reader.GetString(entry.key), reader.GetString(entry.value));
+	}
+}
+
+static assets::MaterialInfo read_material_info_binary(std::string_view metadata)
+{
+	assets::MaterialInfo info{};
+
+	assets::MetadataReader reader;
+	if (!reader.Open(metadata, s_kMaterialTag))
+	{
+		return info;
+	}
+
+	MaterialMetadataBinary fixed;
+	reader.ReadFixed(fixed);
+
+	if (!reader.ValidArray(fixed.textures, sizeof(MaterialEntryBinary)) || !reader.ValidArray(fixed.customProperties, sizeof(MaterialEntryBinary)))
+	{
+		return info;
+	}
+
+	info.baseEffect = reader.GetString(fixed.baseEffect);
+	info.transparency = (assets::TransparencyMode)fixed.transparency;
+	read_material_entries(reader, fixed.textures, info.textures);
+	read_material_entries(reader, fixed.customProperties, info.customProperties);
+
+	return info;
+}
+
+static assets::MaterialInfo read_material_info(std::string_view metadata, int version)
+{
+	if (assets::IsBinaryMetadata(version))
+	{
+		return read_material_info_binary(metadata);
+	}
+	return read_material_info_json(metadata);
+}
+
+//entries are sorted by key so the same material always bakes to the same bytes
+static assets::MetaArray write_material_entries(assets::MetadataWriter& writer, const std::unordered_map<std::string, std::string>& entries)
 {
-	json metadata;
-	metadata[s_kBaseEffect] = info->baseEffect;
-	metadata[s_kTextures] = info->textures;
-	metadata[s_kCustomProperties] = info->customProperties;
+	std::vector<std::pair<std::string, std::string>> sorted{ entries.begin(), entries.end() };
+	std::sort(sorted.begin(), sorted.end());
 
-	metadata[s_kTransparency] = s_TransparenyModeName[(int)info->transparency];
+	std::vector<MaterialEntryBinary> binaryEntries;
+	binaryEntries.reserve(sorted.size());
+	for (auto& [key, value] : sorted)
+	{
+		binaryEntries.push_back({ writer.AddString(key), writer.AddString(value) });
+	}
+	return writer.AddArray(binaryEntries.data(), binaryEntries.size());
+}
+
+assets::MaterialInfo assets::read_material_info(AssetFile* file)
+{
+	return ::read_material_info(file->json, file->version);
+}
+
+assets::MaterialInfo assets::read_material_info(const AssetView& view)
+{
+	return ::read_material_info(view.json, view.version);
+}
 
+assets::AssetFile assets::pack_material(MaterialInfo* info)
+{
 	AssetFile file;
 	file.type[0] = 'M';
 	file.type[1] = 'A';
 	file.type[2] = 'T';
 	file.type[3] = 'X';
+	file.version = kCurrentAssetVersion;
 
-	std::string jsonstr = metadata.dump();
-	file.json = jsonstr;
+	file.json = pack_material_metadata(info, MetadataFormat::Binary);
 
 	return file;
 }
+
+std::string assets::pack_material_metadata(const MaterialInfo* info, MetadataFormat format)
+{
+	if (format == MetadataFormat::Json)
+	{
+		json metadata;
+		metadata[s_kBaseEffect] = info->baseEffect;
+		metadata[s_kTextures] = info->textures;
+		metadata[s_kCustomProperties] = info->customProperties;
+
+		metadata[s_kTransparency] = s_TransparenyModeName[(int)info->transparency];
+
+		return metadata.dump();
+	}
+
+	MetadataWriter writer;
+
+	MaterialMetadataBinary fixed{};
+	fixed.baseEffect = writer.AddString(info->baseEffect);
+	fixed.transparency = (uint32_t)info->transparency;
+	fixed.textures = write_material_entries(writer, info->textures);
+	fixed.customProperties = write_material_entries(writer, info->customProperties);
+
+	return writer.Finish(s_kMaterialTag, 1, &fixed, sizeof(fixed));
+}
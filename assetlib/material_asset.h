@@ -1,6 +1,7 @@
 #pragma once
 
 #include <asset_loader.h>
+#include <asset_metadata.h>
 
 namespace assets
 {
@@ -19,6 +20,10 @@ namespace assets
 	};
 
 	MaterialInfo read_material_info(AssetFile* file);
+	MaterialInfo read_material_info(const AssetView& view);
 
 	AssetFile pack_material(MaterialInfo* info);
+
+	//encodes the metadata section on its own, pack_material always writes the binary format
+	std::string pack_material_metadata(const MaterialInfo* info, MetadataFormat format);
 }
\ No newline at end of file
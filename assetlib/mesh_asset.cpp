@@ -1,6 +1,12 @@
 #include <mesh_asset.h>
+#include <asset_metadata.h>
+#include <asset_threadpool.h>
 #include <json.hpp>
 #include <lz4.h>
+#include <atomic>
+#include <numeric>
+#include <algorithm>
+#include <cmath>
 
 using nlohmann::json;
 
@@ -11,14 +17,47 @@ static const char* s_kOriginalFile = "original_file";
 static const char* s_kCompression = "compression";
 static const char* s_kBounds = "bounds";
 static const char* s_kVertexForamt = "vertex_format";
+static const char* s_kChunkSize = "chunk_size";
+static const char* s_kChunkOffsets = "chunk_offsets";
+static const char* s_kSectionAlignment = "section_alignment";
 
 static const char* s_FormatNames[] = {
 	"None",
 	"PNCV_F32",
 	"P32N8C8V16",
+	"P32O8C8V32",
 };
 
-assets::VertexFormat parse_format(const char* f)
+static const char s_kMeshTag[4] = { 'M','E','S','H' };
+
+//fixed part of the binary metadata, only ever append fields to keep older assets readable
+struct MeshMetadataBinary {
+	uint64_t vertexBufferSize;
+	uint64_t indexBufferSize;
+	float bounds[7];
+	uint32_t vertexFormat;
+	uint32_t compressionMode;
+	uint32_t indexSize;
+	assets::MetaString originalFile;
+	//layout 2
+	uint32_t compressionLevel;
+	//layout 3
+	uint32_t chunkSize;
+	assets::MetaArray chunkOffsets;
+	//layout 4
+	uint32_t sectionAlignment;
+	//layout 5
+	assets::MetaArray meshlets;
+	//layout 6
+	assets::MetaArray lods;
+};
+
+static const uint32_t s_kMeshLayoutVersion = 6;
+
+//lz4 blocks are limited to a bit under 2gb, bigger meshes are always chunked at this size
+static const uint64_t s_kMaxBlockSize = 1ull << 30;
+
+static assets::VertexFormat parse_format(const char* f)
 {
 	for (int i = 1; i < (int)assets::VertexFormat::Count; ++i)
 	{
@@ -30,12 +69,22 @@ assets::VertexFormat parse_format(const char* f)
 	return assets::VertexFormat::Unknown;
 }
 
+const char* assets::vertex_format_name(VertexFormat format)
+{
+	if (format >= VertexFormat::Count)
+	{
+		return s_FormatNames[0];
+	}
+	return s_FormatNames[(int)format];
+}
 
-assets::MeshInfo assets::ReadMeshInfo(AssetFile* file)
+
+static assets::MeshInfo read_mesh_info_json(std::string_view jsonString)
 {
+	using namespace assets;
 	MeshInfo info;
 
-	json metadata = json::parse(file->json);
+	json metadata = json::parse(jsonString.begin(), jsonString.end());
 
 	info.vertexBufferSize = metadata[s_kVertexBufferSize];
 	info.indexBufferSize = metadata[s_kIndexBufferSize];
@@ -44,6 +93,16 @@ assets::MeshInfo assets::ReadMeshInfo(AssetFile* file)
 
 	std::string compressionString = metadata[s_kCompression];
 	info.compressionMode = parse_compression(compressionString.c_str());
+	info.compressionLevel = 0;
+
+	info.chunkSize = 0;
+	if (metadata.contains(s_kChunkSize))
+	{
+		info.chunkSize = metadata[s_kChunkSize];
+		info.chunkOffsets = metadata[s_kChunkOffsets].get<std::vector<uint64_t>>();
+	}
+
+	info.sectionAlignment = metadata.value(s_kSectionAlignment, 0u);
 
 	std::vector<float> boundsData;
 	boundsData.reserve(7);
@@ -56,60 +115,530 @@ assets::MeshInfo assets::ReadMeshInfo(AssetFile* file)
 	return info;
 }
 
-void assets::UnpackMesh(MeshInfo* info, const char* sourceBuffer, size_t sourceSize, char* vertexBuffer, char* indexBuffer)
+static assets::MeshInfo read_mesh_info_binary(std::string_view metadata)
+{
+	using namespace assets;
+	MeshInfo info{};
+
+	MetadataReader reader;
+	if (!reader.Open(metadata, s_kMeshTag))
+	{
+		return info;
+	}
+
+	MeshMetadataBinary fixed;
+	reader.ReadFixed(fixed);
+
+	if (!reader.ValidArray(fixed.chunkOffsets, sizeof(uint64_t)) || !reader.ValidArray(fixed.meshlets, sizeof(Meshlet))
+		|| !reader.ValidArray(fixed.lods, sizeof(MeshLod)))
+	{
+		return info;
+	}
+
+	info.vertexBufferSize = fixed.vertexBufferSize;
+	info.indexBufferSize = fixed.indexBufferSize;
+	memcpy(info.bounds.origin, &fixed.bounds[0], sizeof(float) * 3);
+	info.bounds.radius = fixed.bounds[3];
+	memcpy(info.bounds.extents, &fixed.bounds[4], sizeof(float) * 3);
+	info.vertexFormat = (VertexFormat)fixed.vertexFormat;
+	info.compressionMode = (CompressionMode)fixed.compressionMode;
+	info.indexSize = (char)fixed.indexSize;
+	info.originalFile = reader.GetString(fixed.originalFile);
+	info.compressionLevel = fixed.compressionLevel;
+
+	info.chunkSize = fixed.chunkSize;
+	info.chunkOffsets.resize(fixed.chunkOffsets.count);
+	for (uint32_t i = 0; i < fixed.chunkOffsets.count; ++i)
+	{
+		info.chunkOffsets[i] = reader.ReadElement<uint64_t>(fixed.chunkOffsets, i);
+	}
+	info.sectionAlignment = fixed.sectionAlignment;
+
+	info.meshlets.resize(fixed.meshlets.count);
+	for (uint32_t i = 0; i < fixed.meshlets.count; ++i)
+	{
+		info.meshlets[i] = reader.ReadElement<Meshlet>(fixed.meshlets, i);
+	}
+
+	info.lods.resize(fixed.lods.count);
+	for (uint32_t i = 0; i < fixed.lods.count; ++i)
+	{
+		info.lods[i] = reader.ReadElement<MeshLod>(fixed.lods, i);
+	}
+
+	return info;
+}
+
+static assets::MeshInfo read_mesh_info(std::string_view metadata, int version)
+{
+	if (assets::IsBinaryMetadata(version))
+	{
+		return read_mesh_info_binary(metadata);
+	}
+	return read_mesh_info_json(metadata);
+}
+
+assets::MeshInfo assets::ReadMeshInfo(AssetFile* file)
+{
+	return read_mesh_info(file->json, file->version);
+}
+
+assets::MeshInfo assets::ReadMeshInfo(const AssetView& view)
+{
+	return read_mesh_info(view.json, view.version);
+}
+
+static size_t vertex_format_size(assets::VertexFormat format)
+{
+	switch (format)
+	{
+	case assets::VertexFormat::PNCV_F32:
+		return sizeof(assets::Vertex_f32_PNCV);
+	case assets::VertexFormat::P32N8C8V16:
+		return sizeof(assets::Vertex_P32N8C8V16);
+	case assets::VertexFormat::P32O8C8V32:
+		return sizeof(assets::Vertex_P32O8C8V32);
+	default:
+		return 1;
+	}
+}
+
+//mesh codec filters. Vertices are transposed into one plane per byte of the vertex struct, so the slowly changing
+//high bytes of floats line up. Indices are stored as zigzag deltas from the previous index, then transposed the same way
+static void shuffle_bytes(const char* source, char* destination, size_t count, size_t stride)
+{
+	for (size_t b = 0; b < stride; ++b)
+	{
+		char* plane = destination + b * count;
+		for (size_t i = 0; i < count; ++i)
+		{
+			plane[i] = source[i * stride + b];
+		}
+	}
+}
+
+static void unshuffle_bytes(const char* source, char* destination, size_t count, size_t stride)
+{
+	for (size_t b = 0; b < stride; ++b)
+	{
+		const char* plane = source + b * count;
+		for (size_t i = 0; i < count; ++i)
+		{
+			destination[i * stride + b] = plane[i];
+		}
+	}
+}
+
+template<typename T>
+static void encode_indices(const char* source, char* destination, size_t count, std::vector<char>& scratch)
+{
+	using S = std::make_signed_t<T>;
+
+	scratch.resize(count * sizeof(T));
+	T* deltas = reinterpret_cast<T*>(scratch.data());
+
+	T previous = 0;
+	for (size_t i = 0; i < count; ++i)
+	{
+		T index;
+		memcpy(&index, source + i * sizeof(T), sizeof(T));
+		S delta = static_cast<S>(index - previous);
+		deltas[i] = static_cast<T>((T(delta) << 1) ^ T(delta >> (sizeof(T) * 8 - 1)));
+		previous = index;
+	}
+	shuffle_bytes(scratch.data(), destination, count, sizeof(T));
+}
+
+template<typename T>
+static void decode_indices(const char* source, char* destination, size_t count)
+{
+	unshuffle_bytes(source, destination, count, sizeof(T));
+
+	T previous = 0;
+	for (size_t i = 0; i < count; ++i)
+	{
+		T zigzag;
+		memcpy(&zigzag, destination + i * sizeof(T), sizeof(T));
+		T delta = (zigzag >> 1) ^ (T(0) - (zigzag & 1));
+		previous = static_cast<T>(previous + delta);
+		memcpy(destination + i * sizeof(T), &previous, sizeof(T));
+	}
+}
+
+static void encode_stream(const char* source, char* destination, size_t size, size_t stride, bool bIndices, std::vector<char>& scratch)
+{
+	if (!bIndices)
+	{
+		shuffle_bytes(source, destination, size / stride, stride);
+	}
+	else if (stride == sizeof(uint16_t))
+	{
+		encode_indices<uint16_t>(source, destination, size / stride, scratch);
+	}
+	else
+	{
+		encode_indices<uint32_t>(source, destination, size / stride, scratch);
+	}
+}
+
+static void decode_stream(const char* source, char* destination, size_t size, size_t stride, bool bIndices)
+{
+	if (!bIndices)
+	{
+		unshuffle_bytes(source, destination, size / stride, stride);
+	}
+	else if (stride == sizeof(uint16_t))
+	{
+		decode_indices<uint16_t>(source, destination, size / stride);
+	}
+	else
+	{
+		decode_indices<uint32_t>(source, destination, size / stride);
+	}
+}
+
+//the vertex stream is split first and the index stream after it, no block crosses from one to the other
+static size_t chunk_count(uint64_t size, uint32_t chunkSize)
+{
+	return static_cast<size_t>(size / chunkSize + (size % chunkSize != 0 ? 1 : 0));
+}
+
+static uint64_t chunk_original_size(const assets::MeshInfo* info, size_t chunk, size_t vertexChunks)
+{
+	bool bIndices = chunk >= vertexChunks;
+	uint64_t streamSize = bIndices ? info->indexBufferSize : info->vertexBufferSize;
+	uint64_t start = (bIndices ? chunk - vertexChunks : chunk) * uint64_t(info->chunkSize);
+	return std::min<uint64_t>(info->chunkSize, streamSize - start);
+}
+
+//the table comes from the file, every block has to fit in the blob and in its stream
+static bool valid_chunk_table(const assets::MeshInfo* info, size_t sourceSize)
+{
+	size_t vertexChunks = chunk_count(info->vertexBufferSize, info->chunkSize);
+	size_t totalChunks = vertexChunks + chunk_count(info->indexBufferSize, info->chunkSize);
+	if (info->chunkOffsets.size() != totalChunks + 1 || info->chunkOffsets.back() > sourceSize)
+	{
+		return false;
+	}
+
+	for (size_t chunk = 0; chunk < totalChunks; ++chunk)
+	{
+		uint64_t start = info->chunkOffsets[chunk];
+		uint64_t end = info->chunkOffsets[chunk + 1];
+		if (end < start || end - start > chunk_original_size(info, chunk, vertexChunks))
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+//the codec filters whole vertices and indices, so every block and both streams hold a whole number of them
+static bool valid_mesh_codec(const assets::MeshInfo* info)
+{
+	bool bKnownFormat = info->vertexFormat > assets::VertexFormat::Unknown && info->vertexFormat < assets::VertexFormat::Count;
+	if (!bKnownFormat || (info->indexSize != 2 && info->indexSize != 4) || info->chunkSize == 0)
+	{
+		return false;
+	}
+
+	size_t vertexSize = vertex_format_size(info->vertexFormat);
+	size_t indexSize = (size_t)info->indexSize;
+	return info->chunkSize % std::lcm(vertexSize, indexSize) == 0
+		&& info->vertexBufferSize % vertexSize == 0 && info->indexBufferSize % indexSize == 0;
+}
+
+static bool unpack_mesh_chunked(assets::MeshInfo* info, const char* sourceBuffer, size_t sourceSize, char* vertexBuffer, char* indexBuffer)
 {
+	if (!valid_chunk_table(info, sourceSize))
+	{
+		return false;
+	}
+
+	size_t vertexChunks = chunk_count(info->vertexBufferSize, info->chunkSize);
+	size_t totalChunks = info->chunkOffsets.size() - 1;
+	bool bCodec = info->compressionMode == assets::CompressionMode::MeshCodec;
+
+	std::atomic<bool> bFailed{ false };
+	assets::GetDecodeThreadPool().ParallelFor(totalChunks, [&](size_t chunk) {
+		bool bIndices = chunk >= vertexChunks;
+		uint64_t start = (bIndices ? chunk - vertexChunks : chunk) * uint64_t(info->chunkSize);
+		char* destination = (bIndices ? indexBuffer : vertexBuffer) + start;
+		uint64_t originalSize = chunk_original_size(info, chunk, vertexChunks);
+
+		const char* source = sourceBuffer + info->chunkOffsets[chunk];
+		uint64_t compressedSize = info->chunkOffsets[chunk + 1] - info->chunkOffsets[chunk];
+
+		//filtered blocks are decompressed next to the destination and unfiltered into it
+		thread_local std::vector<char> filtered;
+		char* target = destination;
+		if (bCodec)
+		{
+			filtered.resize(originalSize);
+			target = filtered.data();
+		}
+
+		//blocks that didnt compress are stored raw
+		if (compressedSize == originalSize)
+		{
+			memcpy(target, source, originalSize);
+		}
+		else if (LZ4_decompress_safe(source, target, static_cast<int>(compressedSize), static_cast<int>(originalSize)) != (int)originalSize)
+		{
+			bFailed = true;
+			return;
+		}
+
+		if (bCodec)
+		{
+			size_t stride = bIndices ? (size_t)info->indexSize : vertex_format_size(info->vertexFormat);
+			decode_stream(target, destination, originalSize, stride, bIndices);
+		}
+	});
+	return !bFailed;
+}
+
+bool assets::UnpackMesh(MeshInfo* info, const char* sourceBuffer, size_t sourceSize, char* vertexBuffer, char* indexBuffer)
+{
+	if (info->compressionMode == CompressionMode::None)
+	{
+		//both sections are copied straight out of the blob, the vertex size is checked first so the aligned offset cant wrap
+		if (info->vertexBufferSize > sourceSize)
+		{
+			return false;
+		}
+		uint64_t indexOffset = mesh_index_offset(info);
+		if (indexOffset > sourceSize || info->indexBufferSize > sourceSize - indexOffset)
+		{
+			return false;
+		}
+
+		memcpy(vertexBuffer, sourceBuffer, info->vertexBufferSize);
+		memcpy(indexBuffer, sourceBuffer + indexOffset, info->indexBufferSize);
+		return true;
+	}
+
+	if (info->compressionMode == CompressionMode::MeshCodec && !valid_mesh_codec(info))
+	{
+		return false;
+	}
+
+	//mesh codec blobs are always chunked
+	if (info->chunkSize != 0)
+	{
+		return unpack_mesh_chunked(info, sourceBuffer, sourceSize, vertexBuffer, indexBuffer);
+	}
+
+	//single blocks are limited to what lz4 can decode in one call
+	uint64_t blockSize = info->vertexBufferSize + info->indexBufferSize;
+	if (blockSize < info->vertexBufferSize || blockSize > LZ4_MAX_INPUT_SIZE)
+	{
+		return false;
+	}
+	int fullSize = static_cast<int>(blockSize);
+
+	//callers that place the indices right after the vertices get the single block decoded in place
+	if (indexBuffer == vertexBuffer + info->vertexBufferSize)
+	{
+		return LZ4_decompress_safe(sourceBuffer, vertexBuffer, static_cast<int>(sourceSize), fullSize) == fullSize;
+	}
+
 	std::vector<char> decompressedBuffer;
-	decompressedBuffer.reserve(info->vertexBufferSize + info->indexBufferSize);
+	decompressedBuffer.resize(info->vertexBufferSize + info->indexBufferSize);
 
-	LZ4_decompress_safe(sourceBuffer, decompressedBuffer.data(), static_cast<int>(sourceSize), static_cast<int>(decompressedBuffer.size()));
+	if (LZ4_decompress_safe(sourceBuffer, decompressedBuffer.data(), static_cast<int>(sourceSize), fullSize) != fullSize)
+	{
+		return false;
+	}
 
 	memcpy(vertexBuffer, decompressedBuffer.data(), info->vertexBufferSize);
 
 	memcpy(indexBuffer, decompressedBuffer.data() + info->vertexBufferSize, info->indexBufferSize);
+	return true;
+}
+
+uint64_t assets::mesh_index_offset(const MeshInfo* info)
+{
+	if (info->compressionMode != CompressionMode::None || info->sectionAlignment <= 1)
+	{
+		return info->vertexBufferSize;
+	}
+	uint64_t alignment = info->sectionAlignment;
+	return (info->vertexBufferSize + alignment - 1) / alignment * alignment;
+}
+
+static void pack_mesh_chunks(assets::MeshInfo* info, const assets::CompressionProfile& profile, const char* stream, uint64_t streamSize, bool bIndices, std::vector<char>& blob)
+{
+	std::vector<char> staging(LZ4_compressBound(static_cast<int>(info->chunkSize)));
+	std::vector<char> filtered;
+	std::vector<char> scratch;
+
+	bool bCodec = profile.mode == assets::CompressionMode::MeshCodec;
+	size_t stride = bIndices ? (size_t)info->indexSize : vertex_format_size(info->vertexFormat);
+
+	for (uint64_t start = 0; start < streamSize; start += info->chunkSize)
+	{
+		int originalSize = static_cast<int>(std::min<uint64_t>(info->chunkSize, streamSize - start));
+
+		const char* source = stream + start;
+		if (bCodec)
+		{
+			filtered.resize(originalSize);
+			encode_stream(source, filtered.data(), originalSize, stride, bIndices, scratch);
+			source = filtered.data();
+		}
+
+		int compressedSize = assets::compress_lz4(profile, source, staging.data(), originalSize, static_cast<int>(staging.size()));
+
+		info->chunkOffsets.push_back(blob.size());
+		if (compressedSize <= 0 || compressedSize >= originalSize)
+		{
+			blob.insert(blob.end(), source, source + originalSize);
+		}
+		else
+		{
+			blob.insert(blob.end(), staging.data(), staging.data() + compressedSize);
+		}
+	}
 }
 
-assets::AssetFile assets::pack_mesh(MeshInfo* info, char* vertexData, char* indexData)
+assets::AssetFile assets::pack_mesh(MeshInfo* info, char* vertexData, char* indexData, const CompressionProfile& profile)
 {
 	AssetFile file;
 	file.type[0] = 'M';
 	file.type[1] = 'E';
 	file.type[2] = 'S';
 	file.type[3] = 'H';
-	file.version = 1;
+	file.version = kCurrentAssetVersion;
 
-	json metadata;
-	metadata[s_kVertexForamt] = s_FormatNames[(int)info->vertexFormat];
-	metadata[s_kVertexBufferSize] = info->vertexBufferSize;
-	metadata[s_kIndexBufferSize] = info->indexBufferSize;
-	metadata[s_kOriginalFile] = info->originalFile;
+	size_t fullsize = info->vertexBufferSize + info->indexBufferSize;
 
-	std::vector<float> boundsData;
-	info->bounds.ToFloatArray(boundsData);
-	metadata[s_kBounds] = boundsData;
+	info->compressionMode = profile.mode;
+	info->compressionLevel = profile.level;
+	info->chunkSize = 0;
+	info->chunkOffsets.clear();
+	info->sectionAlignment = 0;
+
+	//the codec works on whole vertices and indices, so its chunks are a multiple of both strides.
+	//without a chunk size it uses a single chunk per stream
+	if (profile.mode == CompressionMode::MeshCodec)
+	{
+		size_t vertexSize = vertex_format_size(info->vertexFormat);
+		size_t stride = std::lcm(vertexSize, (size_t)info->indexSize);
+
+		uint64_t chunkSize = profile.chunkSize ? profile.chunkSize : std::max(info->vertexBufferSize, info->indexBufferSize);
+		chunkSize = std::min(chunkSize, s_kMaxBlockSize);
+		chunkSize = std::max<uint64_t>(stride, (chunkSize + stride - 1) / stride * stride);
+		info->chunkSize = static_cast<uint32_t>(chunkSize);
+	}
+	//small meshes stay a single block, splitting them only adds overhead
+	else if (profile.mode == CompressionMode::LZ4 && profile.chunkSize != 0 && fullsize > profile.chunkSize)
+	{
+		info->chunkSize = profile.chunkSize;
+	}
+	else if (profile.mode == CompressionMode::LZ4 && fullsize > s_kMaxBlockSize)
+	{
+		info->chunkSize = static_cast<uint32_t>(s_kMaxBlockSize);
+	}
+
+	if (info->chunkSize != 0)
+	{
+		pack_mesh_chunks(info, profile, vertexData, info->vertexBufferSize, false, file.binaryBlob);
+		pack_mesh_chunks(info, profile, indexData, info->indexBufferSize, true, file.binaryBlob);
+		info->chunkOffsets.push_back(file.binaryBlob.size());
+
+		file.json = pack_mesh_metadata(info, MetadataFormat::Binary);
+		return file;
+	}
+
+	if (profile.mode == CompressionMode::None)
+	{
+		//both sections start 16 byte aligned so the runtime can copy or map them without touching the data
+		info->sectionAlignment = kMeshSectionAlignment;
+		uint64_t indexOffset = mesh_index_offset(info);
+
+		file.binaryBlob.resize(indexOffset + info->indexBufferSize);
+		memcpy(file.binaryBlob.data(), vertexData, info->vertexBufferSize);
+		memcpy(file.binaryBlob.data() + indexOffset, indexData, info->indexBufferSize);
+
+		file.json = pack_mesh_metadata(info, MetadataFormat::Binary);
+		align_asset_blob(file, kMeshSectionAlignment);
+		return file;
+	}
 
-	size_t fullsize = info->vertexBufferSize + info->indexBufferSize;
 	std::vector<char> mergedBuffer;
 	mergedBuffer.resize(fullsize);
 	memcpy(mergedBuffer.data(), vertexData, info->vertexBufferSize);
 	memcpy(mergedBuffer.data() + info->vertexBufferSize, indexData, info->indexBufferSize);
 
 	size_t compressStaging = LZ4_compressBound(static_cast<int>(fullsize));
-	file.binaryBlob.reserve(compressStaging);
-	int compressedSize = LZ4_compress_default(mergedBuffer.data(), file.binaryBlob.data(), static_cast<int>(mergedBuffer.size()), static_cast<int>(compressStaging));
+	file.binaryBlob.resize(compressStaging);
+	int compressedSize = compress_lz4(profile, mergedBuffer.data(), file.binaryBlob.data(), static_cast<int>(mergedBuffer.size()), static_cast<int>(compressStaging));
 
-	file.binaryBlob.reserve(compressedSize);
-	metadata[s_kCompression] = "LZ4";
+	file.binaryBlob.resize(compressedSize);
 
-	file.json = metadata.dump();
+	file.json = pack_mesh_metadata(info, MetadataFormat::Binary);
 
 	return file;
 }
 
+std::string assets::pack_mesh_metadata(const MeshInfo* info, MetadataFormat format)
+{
+	if (format == MetadataFormat::Json)
+	{
+		json metadata;
+		metadata[s_kVertexForamt] = s_FormatNames[(int)info->vertexFormat];
+		metadata[s_kVertexBufferSize] = info->vertexBufferSize;
+		metadata[s_kIndexBufferSize] = info->indexBufferSize;
+		metadata[s_kIndexSize] = info->indexSize;
+		metadata[s_kOriginalFile] = info->originalFile;
+		metadata[s_kCompression] = compression_name(info->compressionMode);
+
+		std::vector<float> boundsData;
+		MeshBounds bounds = info->bounds;
+		bounds.ToFloatArray(boundsData);
+		metadata[s_kBounds] = boundsData;
+
+		if (info->chunkSize != 0)
+		{
+			metadata[s_kChunkSize] = info->chunkSize;
+			metadata[s_kChunkOffsets] = info->chunkOffsets;
+		}
+		if (info->sectionAlignment != 0)
+		{
+			metadata[s_kSectionAlignment] = info->sectionAlignment;
+		}
+
+		return metadata.dump();
+	}
+
+	MetadataWriter writer;
+
+	MeshMetadataBinary fixed{};
+	fixed.vertexBufferSize = info->vertexBufferSize;
+	fixed.indexBufferSize = info->indexBufferSize;
+	memcpy(&fixed.bounds[0], info->bounds.origin, sizeof(float) * 3);
+	fixed.bounds[3] = info->bounds.radius;
+	memcpy(&fixed.bounds[4], info->bounds.extents, sizeof(float) * 3);
+	fixed.vertexFormat = (uint32_t)info->vertexFormat;
+	fixed.compressionMode = (uint32_t)info->compressionMode;
+	fixed.indexSize = (uint32_t)info->indexSize;
+	fixed.originalFile = writer.AddString(info->originalFile);
+	fixed.compressionLevel = info->compressionLevel;
+	fixed.chunkSize = info->chunkSize;
+	fixed.chunkOffsets = writer.AddArray(info->chunkOffsets.data(), info->chunkOffsets.size());
+	fixed.sectionAlignment = info->sectionAlignment;
+	fixed.meshlets = writer.AddArray(info->meshlets.data(), info->meshlets.size());
+	fixed.lods = writer.AddArray(info->lods.data(), info->lods.size());
+
+	return writer.Finish(s_kMeshTag, s_kMeshLayoutVersion, &fixed, sizeof(fixed));
+}
+
 assets::MeshBounds assets::CalculateBounds(Vertex_f32_PNCV* vertices, size_t count)
 {
 	MeshBounds bounds;
 	float min[3] = { std::numeric_limits<float>::max(),std::numeric_limits<float>::max() ,std::numeric_limits<float>::max() };
-	float max[3] = { std::numeric_limits<float>::min(),std::numeric_limits<float>::min() ,std::numeric_limits<float>::min() };
+	float max[3] = { std::numeric_limits<float>::lowest(),std::numeric_limits<float>::lowest() ,std::numeric_limits<float>::lowest() };
 
 	for (int i = 0; i < count; ++i)
 	{
@@ -134,7 +663,7 @@ assets::MeshBounds assets::CalculateBounds(Vertex_f32_PNCV* vertices, size_t cou
 		float distanceSqr = 0;
 		for (int j = 0; j < 3; ++j)
 		{
-			float offset = vertices[i].position[j] = bounds.origin[j];
+			float offset = vertices[i].position[j] - bounds.origin[j];
 			distanceSqr += offset * offset;
 		}
 		r2 = std::max(r2, distanceSqr);
@@ -144,6 +673,180 @@ assets::MeshBounds assets::CalculateBounds(Vertex_f32_PNCV* vertices, size_t cou
 	return bounds;
 }
 
+//same math as the engine Vertex::PackNormal, so baked and converted vertices are bit identical.
+//rounding 0.5 rounds to the nearest step instead of truncating like the engine does
+static void oct_normal_encode(const float n[3], uint8_t out[2], float rounding = 0.f)
+{
+	float sum = std::abs(n[0]) + std::abs(n[1]) + std::abs(n[2]);
+	//degenerate normals encode as +Z instead of dividing by zero
+	if (!(sum > 0.f))
+	{
+		out[0] = 128;
+		out[1] = 128;
+		return;
+	}
+
+	float x = n[0] / sum;
+	float y = n[1] / sum;
+	float z = n[2] / sum;
+
+	float rx = x;
+	float ry = y;
+	if (z < 0)
+	{
+		rx = (1.0f - std::abs(y)) * (x > 0.f ? 1.f : -1.f);
+		ry = (1.0f - std::abs(x)) * (y > 0.f ? 1.f : -1.f);
+	}
+
+	out[0] = uint8_t(std::clamp((rx * 0.5f + 0.5f) * 255 + rounding, 0.f, 255.f));
+	out[1] = uint8_t(std::clamp((ry * 0.5f + 0.5f) * 255 + rounding, 0.f, 255.f));
+}
+
+//same as OctNormalDecode in the vertex shaders
+static void oct_normal_decode(const uint8_t encoded[2], float out[3])
+{
+	float x = encoded[0] / 255.f * 2.f - 1.f;
+	float y = encoded[1] / 255.f * 2.f - 1.f;
+	float z = 1.f - std::abs(x) - std::abs(y);
+	float t = std::clamp(-z, 0.f, 1.f);
+
+	x += x >= 0.f ? -t : t;
+	y += y >= 0.f ? -t : t;
+
+	float length = std::sqrt(x * x + y * y + z * z);
+	out[0] = x / length;
+	out[1] = y / length;
+	out[2] = z / length;
+}
+
+void assets::pack_runtime_vertices(const Vertex_f32_PNCV* source, Vertex_P32O8C8V32* destination, size_t count)
+{
+	for (size_t i = 0; i < count; ++i)
+	{
+		Vertex_P32O8C8V32& vertex = destination[i];
+		memset(&vertex, 0, sizeof(Vertex_P32O8C8V32));
+
+		memcpy(vertex.position, source[i].position, sizeof(float) * 3);
+		oct_normal_encode(source[i].normal, vertex.octNormal);
+		for (int j = 0; j < 3; ++j)
+		{
+			vertex.color[j] = uint8_t(source[i].color[j] * 255);
+		}
+		memcpy(vertex.uv, source[i].uv, sizeof(float) * 2);
+	}
+}
+
+assets::QuantizationError assets::pack_quantized_vertices(const Vertex_f32_PNCV* source, Vertex_P32N8C8V16* destination, size_t count)
+{
+	QuantizationError error{ 0.f, 0.f };
+	for (size_t i = 0; i < count; ++i)
+	{
+		Vertex_P32N8C8V16& vertex = destination[i];
+
+		memcpy(vertex.position, source[i].position, sizeof(float) * 3);
+		oct_normal_encode(source[i].normal, vertex.octNormal, 0.5f);
+		for (int j = 0; j < 4; ++j)
+		{
+			vertex.color[j] = uint8_t(std::clamp(source[i].color[j], 0.f, 1.f) * 255 + 0.5f);
+		}
+		vertex.uv[0] = float_to_half(source[i].uv[0]);
+		vertex.uv[1] = float_to_half(source[i].uv[1]);
+
+		//zero normals have no direction to lose
+		const float* n = source[i].normal;
+		float length = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+		if (length > 0.f)
+		{
+			float decoded[3];
+			oct_normal_decode(vertex.octNormal, decoded);
+
+			float cosine = (n[0] * decoded[0] + n[1] * decoded[1] + n[2] * decoded[2]) / length;
+			float degrees = std::acos(std::clamp(cosine, -1.f, 1.f)) * (180.f / 3.14159265f);
+			error.normalDegrees = std::max(error.normalDegrees, degrees);
+		}
+
+		for (int j = 0; j < 2; ++j)
+		{
+			error.uv = std::max(error.uv, std::abs(half_to_float(vertex.uv[j]) - source[i].uv[j]));
+		}
+	}
+	return error;
+}
+
+uint16_t assets::float_to_half(float value)
+{
+	uint32_t bits;
+	memcpy(&bits, &value, sizeof(float));
+
+	uint16_t sign = uint16_t((bits >> 16) & 0x8000);
+	int32_t exponent = int32_t((bits >> 23) & 0xff) - 127 + 15;
+	uint32_t mantissa = bits & 0x7fffff;
+
+	//infinity and nan, nan keeps a mantissa bit
+	if ((bits & 0x7fffffff) >= 0x7f800000)
+	{
+		return sign | 0x7c00 | (mantissa ? 0x200 : 0);
+	}
+	if (exponent >= 31)
+	{
+		return sign | 0x7c00;
+	}
+
+	uint32_t half;
+	uint32_t shift;
+	if (exponent <= 0)
+	{
+		//subnormal, the implicit leading bit becomes part of the mantissa
+		if (exponent < -10)
+		{
+			return sign;
+		}
+		mantissa |= 0x800000;
+		shift = 14 - exponent;
+		half = mantissa >> shift;
+	}
+	else
+	{
+		shift = 13;
+		half = (uint32_t(exponent) << 10) | (mantissa >> shift);
+	}
+
+	//a carry out of the mantissa correctly bumps the exponent
+	uint32_t remainder = mantissa & ((1u << shift) - 1);
+	uint32_t halfway = 1u << (shift - 1);
+	if (remainder > halfway || (remainder == halfway && (half & 1)))
+	{
+		half++;
+	}
+	return sign | uint16_t(half);
+}
+
+float assets::half_to_float(uint16_t value)
+{
+	uint32_t sign = uint32_t(value & 0x8000) << 16;
+	uint32_t exponent = (value >> 10) & 0x1f;
+	uint32_t mantissa = value & 0x3ff;
+
+	uint32_t bits;
+	if (exponent == 0)
+	{
+		float subnormal = std::ldexp(float(mantissa), -24);
+		return sign ? -subnormal : subnormal;
+	}
+	else if (exponent == 31)
+	{
+		bits = sign | 0x7f800000 | (mantissa << 13);
+	}
+	else
+	{
+		bits = sign | ((exponent + 127 - 15) << 23) | (mantissa << 13);
+	}
+
+	float result;
+	memcpy(&result, &bits, sizeof(float));
+	return result;
+}
+
 void assets::MeshBounds::FromFloatArray(const std::vector<float>& floatArray)
 {
 	origin[0] = floatArray[0];
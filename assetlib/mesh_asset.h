@@ -1,6 +1,7 @@
 #pragma once
 
 #include <asset_loader.h>
+#include <asset_metadata.h>
 
 namespace assets {
 	struct Vertex_f32_PNCV
@@ -11,18 +12,32 @@ namespace assets {
 		float uv[2];
 	};
 
+	//packed without padding, 22 bytes. The normal uses the octahedral encoding of the runtime layout, uvs are half floats
+#pragma pack(push, 1)
 	struct Vertex_P32N8C8V16
 	{
 		float position[3];
-		uint8_t normal[3];
+		uint8_t octNormal[2];
 		uint8_t color[4];
+		uint16_t uv[2];
+	};
+#pragma pack(pop)
+
+	//exact layout of the engine Vertex, so blobs in this format are copied to the gpu as they are
+	struct Vertex_P32O8C8V32
+	{
+		float position[3];
+		uint8_t octNormal[2];
+		uint8_t color[3];
+		uint8_t padding[3];
 		float uv[2];
 	};
 
 	enum class VertexFormat : uint32_t {
 		Unknown = 0,
 		PNCV_F32,	//everything at 32 bits
-		P32N8C8V16,	//position at 32 bits, octNormal at 8 bits, color at 8 bits, uvs at 16bits float
+		P32N8C8V16,	//position at 32 bits, octahedral normal at 8 bits, rgba color at 8 bits, uvs at 16 bits float
+		P32O8C8V32,	//runtime layout, position at 32 bits, octahedral normal at 8 bits, color at 8 bits, uvs at 32 bits
 		Count,
 	};
 
@@ -35,6 +50,30 @@ namespace assets {
 		void ToFloatArray(std::vector<float>& floatArray);
 	};
 
+	//cluster of triangles that is culled on its own, its triangles are a contiguous range of the index buffer
+	struct Meshlet {
+		uint32_t firstIndex;
+		uint32_t indexCount;
+
+		//bounding sphere of the meshlet vertices
+		float center[3];
+		float radius;
+
+		//normal cone, every triangle faces away from a viewer at v when dot(center - v, coneAxis) >= coneCutoff * length(center - v) + radius.
+		//coneCutoff is 1 when the triangles face too many directions for that to happen
+		float coneAxis[3];
+		float coneCutoff;
+	};
+
+	//index range of one level of detail, they all share the vertex buffer
+	struct MeshLod {
+		uint32_t firstIndex;
+		uint32_t indexCount;
+
+		//largest distance between this level and the full mesh surface, in mesh units
+		float error;
+	};
+
 	struct MeshInfo {
 		uint64_t vertexBufferSize;
 		uint64_t indexBufferSize;
@@ -42,14 +81,60 @@ namespace assets {
 		VertexFormat vertexFormat;
 		char indexSize;
 		CompressionMode compressionMode;
+		uint32_t compressionLevel;
 		std::string originalFile;
+
+		//chunked blobs store the vertex and index streams as independent lz4 blocks of chunkSize uncompressed bytes.
+		//chunkOffsets holds the blob offset of every block plus the blob end, chunkSize 0 means a single block
+		uint32_t chunkSize;
+		std::vector<uint64_t> chunkOffsets;
+
+		//uncompressed blobs start the index section at a multiple of this, 0 for older assets that pack it right after the vertices
+		uint32_t sectionAlignment;
+
+		//in index order, empty for older assets and json metadata
+		std::vector<Meshlet> meshlets;
+
+		//lod 0 is the full mesh at the start of the index buffer, empty for meshes baked without lods
+		std::vector<MeshLod> lods;
 	};
 
+	//alignment of both sections of uncompressed meshes, in the blob and in the file
+	constexpr uint32_t kMeshSectionAlignment = 16;
+
+	const char* vertex_format_name(VertexFormat format);
+
 	MeshInfo ReadMeshInfo(AssetFile* file);
+	MeshInfo ReadMeshInfo(const AssetView& view);
+
+	//chunked meshes are decoded on the decode thread pool straight into vertexBuffer and indexBuffer.
+	//single block meshes need a temporary unless indexBuffer directly follows vertexBuffer.
+	//returns false when the blob doesnt match the metadata
+	bool UnpackMesh(MeshInfo* info, const char* sourceBuffer, size_t sourceSize, char* vertexBuffer, char* indexBuffer);
 
-	void UnpackMesh(MeshInfo* info, const char* sourceBuffer, size_t sourceSize, char* vertexBuffer, char* indexBuffer);
+	//blob offset of the index section of an uncompressed mesh
+	uint64_t mesh_index_offset(const MeshInfo* info);
 
-	AssetFile pack_mesh(MeshInfo* info, char* vertexData, char* indexData);
+	AssetFile pack_mesh(MeshInfo* info, char* vertexData, char* indexData, const CompressionProfile& profile = {});
+
+	//encodes the metadata section on its own, pack_mesh always writes the binary format
+	std::string pack_mesh_metadata(const MeshInfo* info, MetadataFormat format);
 
 	MeshBounds CalculateBounds(Vertex_f32_PNCV* vertices, size_t count);
+
+	//converts to the runtime layout with the same octahedral encoding the engine uses
+	void pack_runtime_vertices(const Vertex_f32_PNCV* source, Vertex_P32O8C8V32* destination, size_t count);
+
+	//largest difference between quantized vertices and their source
+	struct QuantizationError {
+		float normalDegrees;
+		float uv;
+	};
+
+	//converts to the quantized layout and measures what it lost, the normals decode the way the shaders do
+	QuantizationError pack_quantized_vertices(const Vertex_f32_PNCV* source, Vertex_P32N8C8V16* destination, size_t count);
+
+	//ieee half floats, rounded to nearest even. Values past the half range become infinity
+	uint16_t float_to_half(float value);
+	float half_to_float(uint16_t value);
 }
\ No newline at end of file
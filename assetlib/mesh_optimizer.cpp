@@ -0,0 +1,690 @@
+#include <mesh_optimizer.h>
+
+#include <vector>
+#include <string_view>
+#include <unordered_map>
+#include <algorithm>
+#include <cstring>
+#include <cmath>
+#include <cfloat>
+
+//forsyth's scoring, vertices used by the last triangle get a flat score so the next one doesnt just turn back on itself
+static const float s_kCacheDecayPower = 1.5f;
+static const float s_kLastTriangleScore = 0.75f;
+static const float s_kValenceBoostScale = 2.0f;
+static const float s_kValenceBoostPower = 0.5f;
+
+size_t assets::weld_vertices(void* vertices, size_t vertexCount, size_t vertexSize, uint32_t* indices, size_t indexCount)
+{
+	char* data = static_cast<char*>(vertices);
+
+	//unique vertices are moved to the front before they are keyed, so the keys never point at bytes that get overwritten later
+	std::unordered_map<std::string_view, uint32_t> unique;
+	unique.reserve(vertexCount);
+
+	std::vector<uint32_t> remap(vertexCount);
+	size_t uniqueCount = 0;
+	for (size_t i = 0; i < vertexCount; ++i)
+	{
+		auto it = unique.find(std::string_view{ data + i * vertexSize, vertexSize });
+		if (it != unique.end())
+		{
+			remap[i] = it->second;
+			continue;
+		}
+
+		char* destination = data + uniqueCount * vertexSize;
+		if (uniqueCount != i)
+		{
+			memcpy(destination, data + i * vertexSize, vertexSize);
+		}
+		unique.emplace(std::string_view{ destination, vertexSize }, static_cast<uint32_t>(uniqueCount));
+		remap[i] = static_cast<uint32_t>(uniqueCount++);
+	}
+
+	for (size_t i = 0; i < indexCount; ++i)
+	{
+		indices[i] = remap[indices[i]];
+	}
+	return uniqueCount;
+}
+
+static float vertex_score(int cachePosition, uint32_t remainingTriangles)
+{
+	if (remainingTriangles == 0)
+	{
+		return -1.f;
+	}
+
+	float score = 0.f;
+	if (cachePosition >= 0)
+	{
+		if (cachePosition < 3)
+		{
+			score = s_kLastTriangleScore;
+		}
+		else
+		{
+			float scaler = 1.f / (assets::kVertexCacheSize - 3);
+			score = std::pow(1.f - (cachePosition - 3) * scaler, s_kCacheDecayPower);
+		}
+	}
+
+	//vertices with few triangles left are worth finishing so they drop out of the cache for good
+	score += s_kValenceBoostScale * std::pow(static_cast<float>(remainingTriangles), -s_kValenceBoostPower);
+	return score;
+}
+
+void assets::optimize_vertex_cache(uint32_t* indices, size_t indexCount, size_t vertexCount)
+{
+	size_t triangleCount = indexCount / 3;
+	if (triangleCount == 0)
+	{
+		return;
+	}
+
+	//triangles of every vertex, live ones are kept at the front of each range
+	std::vector<uint32_t> remaining(vertexCount, 0);
+	for (size_t i = 0; i < triangleCount * 3; ++i)
+	{
+		remaining[indices[i]]++;
+	}
+
+	std::vector<uint32_t> adjacencyOffsets(vertexCount + 1, 0);
+	for (size_t v = 0; v < vertexCount; ++v)
+	{
+		adjacencyOffsets[v + 1] = adjacencyOffsets[v] + remaining[v];
+	}
+
+	std::vector<uint32_t> adjacency(triangleCount * 3);
+	std::vector<uint32_t> fill(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+	for (size_t t = 0; t < triangleCount; ++t)
+	{
+		for (int k = 0; k < 3; ++k)
+		{
+			adjacency[fill[indices[t * 3 + k]]++] = static_cast<uint32_t>(t);
+		}
+	}
+
+	std::vector<int> cachePositions(vertexCount, -1);
+	std::vector<float> vertexScores(vertexCount);
+	for (size_t v = 0; v < vertexCount; ++v)
+	{
+		vertexScores[v] = vertex_score(-1, remaining[v]);
+	}
+
+	std::vector<float> triangleScores(triangleCount);
+	std::vector<char> emitted(triangleCount, 0);
+	for (size_t t = 0; t < triangleCount; ++t)
+	{
+		const uint32_t* tri = indices + t * 3;
+		triangleScores[t] = vertexScores[tri[0]] + vertexScores[tri[1]] + vertexScores[tri[2]];
+	}
+
+	std::vector<uint32_t> output(triangleCount * 3);
+
+	//the last 3 slots hold vertices that are being pushed out, their scores still have to drop
+	std::vector<uint32_t> cache;
+	std::vector<uint32_t> nextCache;
+	cache.reserve(kVertexCacheSize + 3);
+	nextCache.reserve(kVertexCacheSize + 3);
+
+	size_t bestTriangle = std::max_element(triangleScores.begin(), triangleScores.end()) - triangleScores.begin();
+	size_t inputCursor = 0;
+
+	for (size_t emittedCount = 0; emittedCount < triangleCount; ++emittedCount)
+	{
+		if (bestTriangle == SIZE_MAX)
+		{
+			//nothing in the cache has triangles left, continue with the next one in input order
+			while (emitted[inputCursor])
+			{
+				inputCursor++;
+			}
+			bestTriangle = inputCursor;
+		}
+
+		const uint32_t* tri = indices + bestTriangle * 3;
+		memcpy(&output[emittedCount * 3], tri, sizeof(uint32_t) * 3);
+		emitted[bestTriangle] = 1;
+
+		for (int k = 0; k < 3; ++k)
+		{
+			uint32_t v = tri[k];
+			uint32_t* begin = &adjacency[adjacencyOffsets[v]];
+			uint32_t* end = begin + remaining[v];
+			uint32_t* found = std::find(begin, end, static_cast<uint32_t>(bestTriangle));
+			if (found != end)
+			{
+				*found = *(end - 1);
+				remaining[v]--;
+			}
+		}
+
+		nextCache.assign(tri, tri + 3);
+		for (uint32_t v : cache)
+		{
+			if (v != tri[0] && v != tri[1] && v != tri[2] && nextCache.size() < kVertexCacheSize + 3)
+			{
+				nextCache.push_back(v);
+			}
+		}
+		std::swap(cache, nextCache);
+
+		for (size_t i = 0; i < cache.size(); ++i)
+		{
+			uint32_t v = cache[i];
+			cachePositions[v] = i < kVertexCacheSize ? static_cast<int>(i) : -1;
+			vertexScores[v] = vertex_score(cachePositions[v], remaining[v]);
+		}
+
+		bestTriangle = SIZE_MAX;
+		float bestScore = -1.f;
+		for (uint32_t v : cache)
+		{
+			for (uint32_t a = adjacencyOffsets[v]; a < adjacencyOffsets[v] + remaining[v]; ++a)
+			{
+				uint32_t t = adjacency[a];
+				const uint32_t* candidate = indices + t * 3;
+				triangleScores[t] = vertexScores[candidate[0]] + vertexScores[candidate[1]] + vertexScores[candidate[2]];
+				if (triangleScores[t] > bestScore)
+				{
+					bestScore = triangleScores[t];
+					bestTriangle = t;
+				}
+			}
+		}
+
+		//evicted vertices keep the score they were given on the way out
+		if (cache.size() > kVertexCacheSize)
+		{
+			cache.resize(kVertexCacheSize);
+		}
+	}
+
+	memcpy(indices, output.data(), output.size() * sizeof(uint32_t));
+}
+
+size_t assets::optimize_vertex_fetch(void* vertices, size_t vertexCount, size_t vertexSize, uint32_t* indices, size_t indexCount)
+{
+	std::vector<uint32_t> remap(vertexCount, UINT32_MAX);
+	uint32_t next = 0;
+	for (size_t i = 0; i < indexCount; ++i)
+	{
+		uint32_t& target = remap[indices[i]];
+		if (target == UINT32_MAX)
+		{
+			target = next++;
+		}
+		indices[i] = target;
+	}
+
+	char* data = static_cast<char*>(vertices);
+	std::vector<char> ordered(static_cast<size_t>(next) * vertexSize);
+	for (size_t v = 0; v < vertexCount; ++v)
+	{
+		if (remap[v] != UINT32_MAX)
+		{
+			memcpy(ordered.data() + remap[v] * vertexSize, data + v * vertexSize, vertexSize);
+		}
+	}
+	memcpy(data, ordered.data(), ordered.size());
+	return next;
+}
+
+float assets::calculate_acmr(const uint32_t* indices, size_t indexCount, size_t vertexCount, uint32_t cacheSize)
+{
+	size_t triangleCount = indexCount / 3;
+	if (triangleCount == 0)
+	{
+		return 0.f;
+	}
+
+	//a vertex is still cached while fewer than cacheSize misses happened since it was loaded
+	std::vector<uint64_t> loadedAt(vertexCount, 0);
+	uint64_t misses = 0;
+	for (size_t i = 0; i < triangleCount * 3; ++i)
+	{
+		uint64_t& loaded = loadedAt[indices[i]];
+		if (loaded == 0 || misses - loaded >= cacheSize)
+		{
+			misses++;
+			loaded = misses;
+		}
+	}
+	return static_cast<float>(misses) / static_cast<float>(triangleCount);
+}
+
+static const float* vertex_position(const float* positions, size_t vertexStride, uint32_t index)
+{
+	return reinterpret_cast<const float*>(reinterpret_cast<const char*>(positions) + index * vertexStride);
+}
+
+static void calculate_meshlet_bounds(assets::Meshlet& meshlet, const uint32_t* indices, const float* positions, size_t vertexStride)
+{
+	float min[3] = { FLT_MAX, FLT_MAX, FLT_MAX };
+	float max[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+	for (uint32_t i = 0; i < meshlet.indexCount; ++i)
+	{
+		const float* p = vertex_position(positions, vertexStride, indices[meshlet.firstIndex + i]);
+		for (int j = 0; j < 3; ++j)
+		{
+			min[j] = std::min(min[j], p[j]);
+			max[j] = std::max(max[j], p[j]);
+		}
+	}
+
+	float r2 = 0.f;
+	for (int j = 0; j < 3; ++j)
+	{
+		meshlet.center[j] = (min[j] + max[j]) * 0.5f;
+	}
+	for (uint32_t i = 0; i < meshlet.indexCount; ++i)
+	{
+		const float* p = vertex_position(positions, vertexStride, indices[meshlet.firstIndex + i]);
+		float dx = p[0] - meshlet.center[0];
+		float dy = p[1] - meshlet.center[1];
+		float dz = p[2] - meshlet.center[2];
+		r2 = std::max(r2, dx * dx + dy * dy + dz * dz);
+	}
+	meshlet.radius = std::sqrt(r2);
+
+	//the cone axis is the average face normal, its spread the face that deviates the most
+	std::vector<float> normals;
+	normals.reserve(meshlet.indexCount);
+	float axis[3] = { 0.f, 0.f, 0.f };
+	for (uint32_t t = 0; t < meshlet.indexCount; t += 3)
+	{
+		const uint32_t* tri = indices + meshlet.firstIndex + t;
+		const float* p0 = vertex_position(positions, vertexStride, tri[0]);
+		const float* p1 = vertex_position(positions, vertexStride, tri[1]);
+		const float* p2 = vertex_position(positions, vertexStride, tri[2]);
+
+		float e1[3] = { p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2] };
+		float e2[3] = { p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2] };
+		float n[3] = { e1[1] * e2[2] - e1[2] * e2[1], e1[2] * e2[0] - e1[0] * e2[2], e1[0] * e2[1] - e1[1] * e2[0] };
+
+		float length = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+		if (length == 0.f)
+		{
+			//degenerate triangles dont rasterize, they cant keep the meshlet visible
+			continue;
+		}
+		for (int j = 0; j < 3; ++j)
+		{
+			n[j] /= length;
+			axis[j] += n[j];
+			normals.push_back(n[j]);
+		}
+	}
+
+	float axisLength = std::sqrt(axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2]);
+	float minDot = 1.f;
+	if (axisLength > 0.f)
+	{
+		for (int j = 0; j < 3; ++j)
+		{
+			axis[j] /= axisLength;
+		}
+		for (size_t n = 0; n < normals.size(); n += 3)
+		{
+			minDot = std::min(minDot, normals[n] * axis[0] + normals[n + 1] * axis[1] + normals[n + 2] * axis[2]);
+		}
+	}
+	else
+	{
+		minDot = -1.f;
+	}
+
+	memcpy(meshlet.coneAxis, axis, sizeof(axis));
+
+	//a cone wider than a hemisphere always has a front facing triangle
+	meshlet.coneCutoff = minDot <= 0.f ? 1.f : std::sqrt(1.f - minDot * minDot);
+}
+
+std::vector<assets::Meshlet> assets::build_meshlets(const uint32_t* indices, size_t indexCount, const float* positions, size_t vertexCount, size_t vertexStride,
+	uint32_t maxVertices, uint32_t maxTriangles)
+{
+	std::vector<Meshlet> meshlets;
+
+	//meshlet that last used every vertex, so each one is counted once per meshlet
+	std::vector<uint32_t> usedBy(vertexCount, UINT32_MAX);
+
+	auto count_new_vertices = [&](const uint32_t* tri, uint32_t meshletId) {
+		uint32_t count = 0;
+		for (int k = 0; k < 3; ++k)
+		{
+			bool repeated = (k > 0 && tri[k] == tri[0]) || (k > 1 && tri[k] == tri[1]);
+			if (!repeated && usedBy[tri[k]] != meshletId)
+			{
+				count++;
+			}
+		}
+		return count;
+	};
+
+	Meshlet current{};
+	uint32_t meshletVertices = 0;
+	size_t triangleCount = indexCount / 3;
+	for (size_t t = 0; t < triangleCount; ++t)
+	{
+		const uint32_t* tri = indices + t * 3;
+		uint32_t meshletId = static_cast<uint32_t>(meshlets.size());
+		uint32_t newVertices = count_new_vertices(tri, meshletId);
+
+		if (current.indexCount > 0 && (meshletVertices + newVertices > maxVertices || current.indexCount / 3 + 1 > maxTriangles))
+		{
+			calculate_meshlet_bounds(current, indices, positions, vertexStride);
+			meshlets.push_back(current);
+
+			current = Meshlet{};
+			current.firstIndex = static_cast<uint32_t>(t * 3);
+			meshletVertices = 0;
+			meshletId++;
+			newVertices = count_new_vertices(tri, meshletId);
+		}
+
+		for (int k = 0; k < 3; ++k)
+		{
+			usedBy[tri[k]] = meshletId;
+		}
+		meshletVertices += newVertices;
+		current.indexCount += 3;
+	}
+
+	if (current.indexCount > 0)
+	{
+		calculate_meshlet_bounds(current, indices, positions, vertexStride);
+		meshlets.push_back(current);
+	}
+	return meshlets;
+}
+
+//plane distance quadric, error(p) = p^T A p + 2 b.p + c. Planes are weighted by triangle area and the error divided
+//by the summed weight, so it stays a squared distance no matter how finely the surface was tessellated
+struct Quadric {
+	double a00, a01, a02, a11, a12, a22;
+	double b0, b1, b2;
+	double c;
+	double weight;
+
+	void add(const Quadric& other)
+	{
+		a00 += other.a00; a01 += other.a01; a02 += other.a02;
+		a11 += other.a11; a12 += other.a12; a22 += other.a22;
+		b0 += other.b0; b1 += other.b1; b2 += other.b2;
+		c += other.c;
+		weight += other.weight;
+	}
+
+	double error(const float* p) const
+	{
+		double x = p[0], y = p[1], z = p[2];
+		double e = a00 * x * x + a11 * y * y + a22 * z * z
+			+ 2 * (a01 * x * y + a02 * x * z + a12 * y * z)
+			+ 2 * (b0 * x + b1 * y + b2 * z) + c;
+		return weight > 0 ? std::max(e, 0.0) / weight : 0.0;
+	}
+};
+
+static void triangle_normal(const float* p0, const float* p1, const float* p2, double n[3])
+{
+	double e1[3] = { double(p1[0]) - p0[0], double(p1[1]) - p0[1], double(p1[2]) - p0[2] };
+	double e2[3] = { double(p2[0]) - p0[0], double(p2[1]) - p0[1], double(p2[2]) - p0[2] };
+	n[0] = e1[1] * e2[2] - e1[2] * e2[1];
+	n[1] = e1[2] * e2[0] - e1[0] * e2[2];
+	n[2] = e1[0] * e2[1] - e1[1] * e2[0];
+}
+
+static Quadric plane_quadric(const float* p0, const float* p1, const float* p2)
+{
+	double n[3];
+	triangle_normal(p0, p1, p2, n);
+
+	Quadric q{};
+	double length = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+	if (length == 0.0)
+	{
+		return q;
+	}
+
+	double area = length * 0.5;
+	double a = n[0] / length, b = n[1] / length, c = n[2] / length;
+	double d = -(a * p0[0] + b * p0[1] + c * p0[2]);
+
+	q.a00 = a * a * area; q.a01 = a * b * area; q.a02 = a * c * area;
+	q.a11 = b * b * area; q.a12 = b * c * area; q.a22 = c * c * area;
+	q.b0 = a * d * area; q.b1 = b * d * area; q.b2 = c * d * area;
+	q.c = d * d * area;
+	q.weight = area;
+	return q;
+}
+
+std::vector<uint32_t> assets::simplify_mesh(const uint32_t* indices, size_t indexCount, const float* positions, size_t vertexCount, size_t vertexStride,
+	size_t targetIndexCount, float targetError, float* resultError)
+{
+	std::vector<uint32_t> result(indices, indices + indexCount / 3 * 3);
+	if (resultError)
+	{
+		*resultError = 0.f;
+	}
+
+	//vertices split by normals or uvs share a position, they are found by their position bytes
+	std::unordered_map<std::string_view, uint32_t> positionIds;
+	positionIds.reserve(vertexCount);
+	std::vector<uint32_t> positionId(vertexCount);
+	std::vector<uint32_t> positionUses;
+	for (size_t v = 0; v < vertexCount; ++v)
+	{
+		const char* key = reinterpret_cast<const char*>(vertex_position(positions, vertexStride, static_cast<uint32_t>(v)));
+		auto it = positionIds.emplace(std::string_view{ key, sizeof(float) * 3 }, static_cast<uint32_t>(positionUses.size())).first;
+		if (it->second == positionUses.size())
+		{
+			positionUses.push_back(0);
+		}
+		positionId[v] = it->second;
+		positionUses[it->second]++;
+	}
+
+	//seams and open borders stay where they are, moving them tears the mesh or changes its outline.
+	//an edge is on the border when no triangle uses it in the other direction
+	std::vector<char> locked(vertexCount, 0);
+	{
+		std::unordered_map<uint64_t, uint32_t> edges;
+		edges.reserve(result.size());
+		for (size_t i = 0; i < result.size(); i += 3)
+		{
+			for (int k = 0; k < 3; ++k)
+			{
+				uint64_t a = positionId[result[i + k]];
+				uint64_t b = positionId[result[i + (k + 1) % 3]];
+				edges[(a << 32) | b]++;
+			}
+		}
+		std::vector<char> border(positionUses.size(), 0);
+		for (auto& [edge, count] : edges)
+		{
+			uint64_t reverse = (edge << 32) | (edge >> 32);
+			if (edges.find(reverse) == edges.end())
+			{
+				border[edge >> 32] = 1;
+				border[edge & 0xffffffff] = 1;
+			}
+		}
+		for (size_t v = 0; v < vertexCount; ++v)
+		{
+			locked[v] = border[positionId[v]] || positionUses[positionId[v]] > 1;
+		}
+	}
+
+	std::vector<Quadric> quadrics(vertexCount, Quadric{});
+	for (size_t i = 0; i < result.size(); i += 3)
+	{
+		Quadric q = plane_quadric(vertex_position(positions, vertexStride, result[i]),
+			vertex_position(positions, vertexStride, result[i + 1]),
+			vertex_position(positions, vertexStride, result[i + 2]));
+		for (int k = 0; k < 3; ++k)
+		{
+			quadrics[result[i + k]].add(q);
+		}
+	}
+
+	struct Collapse {
+		uint32_t from;
+		uint32_t to;
+		double error;
+	};
+	std::vector<Collapse> collapses;
+	std::vector<uint32_t> adjacencyOffsets(vertexCount + 1);
+	std::vector<uint32_t> adjacency;
+	std::vector<uint32_t> collapseTarget(vertexCount);
+	std::vector<char> touched(vertexCount);
+
+	double maxError = 0.0;
+	double errorLimit = double(targetError) * double(targetError);
+
+	//every pass collapses the cheapest edges it can without two collapses touching the same triangles
+	while (result.size() > targetIndexCount)
+	{
+		size_t triangleCount = result.size() / 3;
+
+		std::fill(adjacencyOffsets.begin(), adjacencyOffsets.end(), 0);
+		for (uint32_t index : result)
+		{
+			adjacencyOffsets[index + 1]++;
+		}
+		for (size_t v = 0; v < vertexCount; ++v)
+		{
+			adjacencyOffsets[v + 1] += adjacencyOffsets[v];
+		}
+		adjacency.resize(result.size());
+		std::vector<uint32_t> fill(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+		for (size_t t = 0; t < triangleCount; ++t)
+		{
+			for (int k = 0; k < 3; ++k)
+			{
+				adjacency[fill[result[t * 3 + k]]++] = static_cast<uint32_t>(t);
+			}
+		}
+
+		collapses.clear();
+		for (size_t t = 0; t < triangleCount; ++t)
+		{
+			for (int k = 0; k < 3; ++k)
+			{
+				uint32_t a = result[t * 3 + k];
+				uint32_t b = result[t * 3 + (k + 1) % 3];
+				if (a == b)
+				{
+					continue;
+				}
+				for (int direction = 0; direction < 2; ++direction)
+				{
+					uint32_t from = direction ? b : a;
+					uint32_t to = direction ? a : b;
+					if (locked[from])
+					{
+						continue;
+					}
+					Quadric q = quadrics[from];
+					q.add(quadrics[to]);
+					collapses.push_back({ from, to, q.error(vertex_position(positions, vertexStride, to)) });
+				}
+			}
+		}
+		std::sort(collapses.begin(), collapses.end(), [](const Collapse& a, const Collapse& b) { return a.error < b.error; });
+
+		for (size_t v = 0; v < vertexCount; ++v)
+		{
+			collapseTarget[v] = static_cast<uint32_t>(v);
+		}
+		std::fill(touched.begin(), touched.end(), 0);
+
+		size_t trianglesToRemove = (result.size() - targetIndexCount + 2) / 3;
+		size_t removed = 0;
+		size_t applied = 0;
+		for (const Collapse& collapse : collapses)
+		{
+			if (collapse.error > errorLimit || removed >= trianglesToRemove)
+			{
+				break;
+			}
+			if (touched[collapse.from] || touched[collapse.to])
+			{
+				continue;
+			}
+
+			//moving the vertex must not turn any of its remaining triangles around
+			const float* target = vertex_position(positions, vertexStride, collapse.to);
+			bool flips = false;
+			size_t collapsedTriangles = 0;
+			for (uint32_t a = adjacencyOffsets[collapse.from]; a < adjacencyOffsets[collapse.from + 1] && !flips; ++a)
+			{
+				const uint32_t* tri = &result[adjacency[a] * 3];
+				if (tri[0] == collapse.to || tri[1] == collapse.to || tri[2] == collapse.to)
+				{
+					collapsedTriangles++;
+					continue;
+				}
+
+				const float* p[3];
+				const float* moved[3];
+				for (int k = 0; k < 3; ++k)
+				{
+					p[k] = vertex_position(positions, vertexStride, tri[k]);
+					moved[k] = tri[k] == collapse.from ? target : p[k];
+				}
+				double before[3], after[3];
+				triangle_normal(p[0], p[1], p[2], before);
+				triangle_normal(moved[0], moved[1], moved[2], after);
+				flips = before[0] * after[0] + before[1] * after[1] + before[2] * after[2] < 0.0;
+			}
+			if (flips)
+			{
+				continue;
+			}
+
+			//the triangles around the moved vertex change shape, so nothing else may collapse into them this pass
+			for (uint32_t a = adjacencyOffsets[collapse.from]; a < adjacencyOffsets[collapse.from + 1]; ++a)
+			{
+				const uint32_t* tri = &result[adjacency[a] * 3];
+				touched[tri[0]] = touched[tri[1]] = touched[tri[2]] = 1;
+			}
+			touched[collapse.to] = 1;
+
+			collapseTarget[collapse.from] = collapse.to;
+			quadrics[collapse.to].add(quadrics[collapse.from]);
+			maxError = std::max(maxError, collapse.error);
+			removed += collapsedTriangles;
+			applied++;
+		}
+
+		if (applied == 0)
+		{
+			break;
+		}
+
+		//collapsed triangles end up with two corners at the same position
+		size_t write = 0;
+		for (size_t t = 0; t < triangleCount; ++t)
+		{
+			uint32_t a = collapseTarget[result[t * 3 + 0]];
+			uint32_t b = collapseTarget[result[t * 3 + 1]];
+			uint32_t c = collapseTarget[result[t * 3 + 2]];
+			if (positionId[a] == positionId[b] || positionId[b] == positionId[c] || positionId[a] == positionId[c])
+			{
+				continue;
+			}
+			result[write++] = a;
+			result[write++] = b;
+			result[write++] = c;
+		}
+		result.resize(write);
+	}
+
+	if (resultError)
+	{
+		*resultError = static_cast<float>(std::sqrt(maxError));
+	}
+	return result;
+}
@@ -0,0 +1,38 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <mesh_asset.h>
+
+namespace assets
+{
+	//cache size the triangle order is tuned for and acmr is measured with
+	constexpr uint32_t kVertexCacheSize = 16;
+
+	//meshlet limits that also fit mesh shader outputs, 124 triangles leaves the index array of a meshlet under 512 bytes
+	constexpr uint32_t kMeshletMaxVertices = 64;
+	constexpr uint32_t kMeshletMaxTriangles = 124;
+
+	//merges vertices whose bytes are identical and remaps the indices. Returns the new vertex count, the unique vertices are packed at the front
+	size_t weld_vertices(void* vertices, size_t vertexCount, size_t vertexSize, uint32_t* indices, size_t indexCount);
+
+	//reorders the triangles so vertices are reused while they are still in the post transform cache (Forsyth's linear speed algorithm)
+	void optimize_vertex_cache(uint32_t* indices, size_t indexCount, size_t vertexCount);
+
+	//moves vertices into the order the indices first use them so vertex fetch walks memory linearly, unused vertices are dropped.
+	//returns the new vertex count
+	size_t optimize_vertex_fetch(void* vertices, size_t vertexCount, size_t vertexSize, uint32_t* indices, size_t indexCount);
+
+	//average cache miss ratio, vertices transformed per triangle with a fifo cache. 3 is the worst case, 0.5 about the best on a regular grid
+	float calculate_acmr(const uint32_t* indices, size_t indexCount, size_t vertexCount, uint32_t cacheSize = kVertexCacheSize);
+
+	//splits the triangles in index order, so the meshlets of a cache optimized mesh keep its vertex reuse and need no index reordering.
+	//positions points at the first vertex position, vertexStride is the distance in bytes between two of them
+	std::vector<Meshlet> build_meshlets(const uint32_t* indices, size_t indexCount, const float* positions, size_t vertexCount, size_t vertexStride,
+		uint32_t maxVertices = kMeshletMaxVertices, uint32_t maxTriangles = kMeshletMaxTriangles);
+
+	//quadric edge collapse down to targetIndexCount indices, or until the next collapse would move the surface further than targetError.
+	//vertices on seams and open borders are never moved. resultError gets the largest distance of the result to the source, in mesh units
+	std::vector<uint32_t> simplify_mesh(const uint32_t* indices, size_t indexCount, const float* positions, size_t vertexCount, size_t vertexStride,
+		size_t targetIndexCount, float targetError, float* resultError = nullptr);
+}
@@ -1,5 +1,7 @@
 #include <prefab_asset.h>
+#include <asset_metadata.h>
 #include <json.hpp>
+#include <algorithm>
 
 using nlohmann::json;
 static const char* s_kNodeMatrices = "node_matrices";
@@ -9,10 +11,61 @@ static const char* s_kNodeMeshes = "node_meshes";
 static const char* s_kMeshPath = "mesh_path";
 static const char* s_kMaterialPath = "material_path";
 
-assets::PrefabInfo assets::ReadPrefabInfo(AssetFile* file)
+static const char s_kPrefabTag[4] = { 'P','R','F','B' };
+
+struct PrefabNodeMatrixBinary {
+	uint64_t node;
+	uint64_t matrix;
+};
+
+struct PrefabNodeNameBinary {
+	uint64_t node;
+	assets::MetaString name;
+};
+
+struct PrefabNodeParentBinary {
+	uint64_t node;
+	uint64_t parent;
+};
+
+struct PrefabNodeMeshBinary {
+	uint64_t node;
+	assets::MetaString meshPath;
+	assets::MetaString materialPath;
+};
+
+struct PrefabNodeBinary {
+	assets::PrefabNode node;
+	assets::MetaString name;
+};
+
+//fixed part of the binary metadata, only ever append fields to keep older assets readable
+struct PrefabMetadataBinary {
+	//layout 1, node maps. Left empty from layout 2 on
+	assets::MetaArray nodeMatrices;
+	assets::MetaArray nodeNames;
+	assets::MetaArray nodeParents;
+	assets::MetaArray nodeMeshes;
+	//layout 2, flattened nodes
+	assets::MetaArray nodes;
+	assets::MetaArray meshPaths;
+	assets::MetaArray materialPaths;
+};
+
+static const uint32_t s_kPrefabLayoutVersion = 2;
+
+static void read_prefab_matrices(std::vector<std::array<float, 16>>& matrices, const char* blob, size_t blobSize)
+{
+	size_t nMaterices = blobSize / (sizeof(float) * 16);
+	matrices.resize(nMaterices);
+	memcpy(matrices.data(), blob, nMaterices * sizeof(float) * 16);
+}
+
+static assets::PrefabInfo read_prefab_info_json(std::string_view jsonString, const char* blob, size_t blobSize)
 {
+	using namespace assets;
 	PrefabInfo info;
-	json metadata = json::parse(file->json);
+	json metadata = json::parse(jsonString.begin(), jsonString.end());
 
 	for (auto& [key, value] : metadata[s_kNodeMatrices].items())
 	{
@@ -36,41 +89,397 @@ assets::PrefabInfo assets::ReadPrefabInfo(AssetFile* file)
 		info.node_meshes[pair.first] = node;
 	}
 
-	size_t nMaterices = file->binaryBlob.size() / (sizeof(float) * 16);
-	info.matrices.resize(nMaterices);
-	memcpy(info.matrices.data(), file->binaryBlob.data(), file->binaryBlob.size());
+	read_prefab_matrices(info.matrices, blob, blobSize);
 
 	return info;
 }
 
-assets::AssetFile assets::pack_prefab(const PrefabInfo& info)
+static assets::PrefabInfo read_prefab_maps_binary(const assets::MetadataReader& reader, const PrefabMetadataBinary& fixed, const char* blob, size_t blobSize)
+{
+	using namespace assets;
+	PrefabInfo info;
+
+	if (!reader.ValidArray(fixed.nodeMatrices, sizeof(PrefabNodeMatrixBinary)) || !reader.ValidArray(fixed.nodeNames, sizeof(PrefabNodeNameBinary))
+		|| !reader.ValidArray(fixed.nodeParents, sizeof(PrefabNodeParentBinary)) || !reader.ValidArray(fixed.nodeMeshes, sizeof(PrefabNodeMeshBinary)))
+	{
+		return info;
+	}
+
+	info.node_matrices.reserve(fixed.nodeMatrices.count);
+	for (uint32_t i = 0; i < fixed.nodeMatrices.count; ++i)
+	{
+		PrefabNodeMatrixBinary entry = reader.ReadElement<PrefabNodeMatrixBinary>(fixed.nodeMatrices, i);
+		info.node_matrices[entry.node] = (int)entry.matrix;
+	}
+
+	info.node_names.reserve(fixed.nodeNames.count);
+	for (uint32_t i = 0; i < fixed.nodeNames.count; ++i)
+	{
+		PrefabNodeNameBinary entry = reader.ReadElement<PrefabNodeNameBinary>(fixed.nodeNames, i);
+		info.node_names[entry.node] = reader.GetString(entry.name);
+	}
+
+	info.node_parents.reserve(fixed.nodeParents.count);
+	for (uint32_t i = 0; i < fixed.nodeParents.count; ++i)
+	{
+		PrefabNodeParentBinary entry = reader.ReadElement<PrefabNodeParentBinary>(fixed.nodeParents, i);
+		info.node_parents[entry.node] = entry.parent;
+	}
+
+	info.node_meshes.reserve(fixed.nodeMeshes.count);
+	for (uint32_t i = 0; i < fixed.nodeMeshes.count; ++i)
+	{
+		PrefabNodeMeshBinary entry = reader.ReadElement<PrefabNodeMeshBinary>(fixed.nodeMeshes, i);
+
+		PrefabInfo::NodeMesh node;
+		node.mesh_path = reader.GetString(entry.meshPath);
+		node.material_path = reader.GetString(entry.materialPath);
+		info.node_meshes[entry.node] = node;
+	}
+
+	read_prefab_matrices(info.matrices, blob, blobSize);
+
+	return info;
+}
+
+static assets::FlatPrefab read_flat_prefab_binary(const assets::MetadataReader& reader, const PrefabMetadataBinary& fixed, const char* blob, size_t blobSize)
+{
+	using namespace assets;
+	FlatPrefab prefab;
+
+	if (!reader.ValidArray(fixed.nodes, sizeof(PrefabNodeBinary)) || !reader.ValidArray(fixed.meshPaths, sizeof(MetaString))
+		|| !reader.ValidArray(fixed.materialPaths, sizeof(MetaString)))
+	{
+		return prefab;
+	}
+
+	prefab.nodes.resize(fixed.nodes.count);
+	prefab.nodeNames.resize(fixed.nodes.count);
+	for (uint32_t i = 0; i < fixed.nodes.count; ++i)
+	{
+		PrefabNodeBinary entry = reader.ReadElement<PrefabNodeBinary>(fixed.nodes, i);
+		prefab.nodes[i] = entry.node;
+		prefab.nodeNames[i] = reader.GetString(entry.name);
+	}
+
+	prefab.meshPaths.resize(fixed.meshPaths.count);
+	for (uint32_t i = 0; i < fixed.meshPaths.count; ++i)
+	{
+		prefab.meshPaths[i] = reader.GetString(reader.ReadElement<MetaString>(fixed.meshPaths, i));
+	}
+
+	prefab.materialPaths.resize(fixed.materialPaths.count);
+	for (uint32_t i = 0; i < fixed.materialPaths.count; ++i)
+	{
+		prefab.materialPaths[i] = reader.GetString(reader.ReadElement<MetaString>(fixed.materialPaths, i));
+	}
+
+	read_prefab_matrices(prefab.matrices, blob, blobSize);
+
+	//the flat layout is indexed directly, so a bad index drops the whole prefab
+	for (int32_t i = 0; i < (int32_t)prefab.nodes.size(); ++i)
+	{
+		const PrefabNode& node = prefab.nodes[i];
+		bool valid = node.parent >= -1 && node.parent < i
+			&& node.matrix >= -1 && node.matrix < (int64_t)prefab.matrices.size()
+			&& node.mesh >= -1;
+		if (valid && node.mesh >= 0)
+		{
+			valid = node.mesh < (int64_t)prefab.meshPaths.size()
+				&& node.material >= 0 && node.material < (int64_t)prefab.materialPaths.size();
+		}
+		if (!valid)
+		{
+			return FlatPrefab{};
+		}
+	}
+
+	return prefab;
+}
+
+//node ids of the expanded maps are the flat indices
+static assets::PrefabInfo expand_flat_prefab(assets::FlatPrefab&& prefab)
+{
+	using namespace assets;
+	PrefabInfo info;
+
+	for (uint32_t i = 0; i < prefab.nodes.size(); ++i)
+	{
+		const PrefabNode& node = prefab.nodes[i];
+		info.node_names[i] = std::move(prefab.nodeNames[i]);
+		if (node.matrix >= 0)
+		{
+			info.node_matrices[i] = node.matrix;
+		}
+		if (node.parent >= 0)
+		{
+			info.node_parents[i] = (uint64_t)node.parent;
+		}
+		if (node.mesh >= 0)
+		{
+			info.node_meshes[i] = { prefab.meshPaths[node.mesh], prefab.materialPaths[node.material] };
+		}
+	}
+	info.matrices = std::move(prefab.matrices);
+
+	return info;
+}
+
+static assets::PrefabInfo read_prefab_info_binary(std::string_view metadata, const char* blob, size_t blobSize)
+{
+	using namespace assets;
+
+	MetadataReader reader;
+	if (!reader.Open(metadata, s_kPrefabTag))
+	{
+		return PrefabInfo{};
+	}
+
+	PrefabMetadataBinary fixed;
+	reader.ReadFixed(fixed);
+
+	if (reader.LayoutVersion() >= 2)
+	{
+		return expand_flat_prefab(read_flat_prefab_binary(reader, fixed, blob, blobSize));
+	}
+	return read_prefab_maps_binary(reader, fixed, blob, blobSize);
+}
+
+static assets::PrefabInfo read_prefab_info(std::string_view metadata, int version, const char* blob, size_t blobSize)
+{
+	if (assets::IsBinaryMetadata(version))
+	{
+		return read_prefab_info_binary(metadata, blob, blobSize);
+	}
+	return read_prefab_info_json(metadata, blob, blobSize);
+}
+
+assets::PrefabInfo assets::ReadPrefabInfo(AssetFile* file)
+{
+	return read_prefab_info(file->json, file->version, file->binaryBlob.data(), file->binaryBlob.size());
+}
+
+assets::PrefabInfo assets::ReadPrefabInfo(const AssetView& view)
+{
+	return read_prefab_info(view.json, view.version, view.binaryBlob.data(), view.binaryBlob.size());
+}
+
+static assets::FlatPrefab read_flat_prefab(std::string_view metadata, int version, const char* blob, size_t blobSize)
 {
-	json metadata;
-	metadata[s_kNodeMatrices] = info.node_matrices;
-	metadata[s_kNodeNames] = info.node_names;
-	metadata[s_kNodeParents] = info.node_parents;
+	using namespace assets;
+	if (!IsBinaryMetadata(version))
+	{
+		return flatten_prefab(read_prefab_info_json(metadata, blob, blobSize));
+	}
+
+	MetadataReader reader;
+	if (!reader.Open(metadata, s_kPrefabTag))
+	{
+		return FlatPrefab{};
+	}
 
-	std::unordered_map<uint64_t, json> meshnodes;
-	for (auto pair : info.node_meshes)
+	PrefabMetadataBinary fixed;
+	reader.ReadFixed(fixed);
+
+	if (reader.LayoutVersion() >= 2)
 	{
-		json node;
-		node[s_kMeshPath] = pair.second.mesh_path;
-		node[s_kMaterialPath] = pair.second.material_path;
-		meshnodes[pair.first] = node;
+		return read_flat_prefab_binary(reader, fixed, blob, blobSize);
 	}
+	return flatten_prefab(read_prefab_maps_binary(reader, fixed, blob, blobSize));
+}
+
+assets::FlatPrefab assets::ReadFlatPrefab(AssetFile* file)
+{
+	return read_flat_prefab(file->json, file->version, file->binaryBlob.data(), file->binaryBlob.size());
+}
 
-	metadata[s_kNodeMeshes] = meshnodes;
+assets::FlatPrefab assets::ReadFlatPrefab(const AssetView& view)
+{
+	return read_flat_prefab(view.json, view.version, view.binaryBlob.data(), view.binaryBlob.size());
+}
+
+template<typename T>
+static void collect_nodes(const std::unordered_map<uint64_t, T>& map, std::vector<uint64_t>& nodes)
+{
+	for (auto& [k, v] : map)
+	{
+		nodes.push_back(k);
+	}
+}
+
+static int32_t intern_path(const std::string& path, std::vector<std::string>& paths, std::unordered_map<std::string, int32_t>& indices)
+{
+	auto [it, inserted] = indices.try_emplace(path, (int32_t)paths.size());
+	if (inserted)
+	{
+		paths.push_back(path);
+	}
+	return it->second;
+}
+
+assets::FlatPrefab assets::flatten_prefab(const PrefabInfo& info)
+{
+	//every node any of the maps knows about, in id order so the same prefab always flattens the same way
+	std::vector<uint64_t> ids;
+	collect_nodes(info.node_matrices, ids);
+	collect_nodes(info.node_names, ids);
+	collect_nodes(info.node_parents, ids);
+	collect_nodes(info.node_meshes, ids);
+	std::sort(ids.begin(), ids.end());
+	ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+
+	std::unordered_map<uint64_t, std::vector<uint64_t>> children;
+	std::vector<uint64_t> roots;
+	for (uint64_t id : ids)
+	{
+		auto parentIt = info.node_parents.find(id);
+		if (parentIt != info.node_parents.end() && std::binary_search(ids.begin(), ids.end(), parentIt->second))
+		{
+			children[parentIt->second].push_back(id);
+		}
+		else
+		{
+			roots.push_back(id);
+		}
+	}
+
+	//depth first from the roots, keeps every subtree contiguous
+	std::vector<uint64_t> order;
+	order.reserve(ids.size());
+	std::unordered_map<uint64_t, int32_t> flatIndex;
+	std::vector<uint64_t> stack(roots.rbegin(), roots.rend());
+	while (!stack.empty())
+	{
+		uint64_t id = stack.back();
+		stack.pop_back();
 
+		flatIndex[id] = (int32_t)order.size();
+		order.push_back(id);
+
+		auto childIt = children.find(id);
+		if (childIt != children.end())
+		{
+			stack.insert(stack.end(), childIt->second.rbegin(), childIt->second.rend());
+		}
+	}
+
+	//anything left over sits in a parent cycle and can never be reached from a root
+	for (uint64_t id : ids)
+	{
+		if (flatIndex.find(id) == flatIndex.end())
+		{
+			flatIndex[id] = (int32_t)order.size();
+			order.push_back(id);
+		}
+	}
+
+	FlatPrefab prefab;
+	prefab.nodes.reserve(order.size());
+	prefab.nodeNames.reserve(order.size());
+	std::unordered_map<std::string, int32_t> meshIndices;
+	std::unordered_map<std::string, int32_t> materialIndices;
+
+	for (uint64_t id : order)
+	{
+		PrefabNode node{ -1, -1, -1, -1 };
+
+		auto parentIt = info.node_parents.find(id);
+		if (parentIt != info.node_parents.end())
+		{
+			auto indexIt = flatIndex.find(parentIt->second);
+			if (indexIt != flatIndex.end() && indexIt->second < (int32_t)prefab.nodes.size())
+			{
+				node.parent = indexIt->second;
+			}
+		}
+
+		auto matrixIt = info.node_matrices.find(id);
+		if (matrixIt != info.node_matrices.end())
+		{
+			node.matrix = matrixIt->second;
+		}
+
+		auto meshIt = info.node_meshes.find(id);
+		if (meshIt != info.node_meshes.end())
+		{
+			node.mesh = intern_path(meshIt->second.mesh_path, prefab.meshPaths, meshIndices);
+			node.material = intern_path(meshIt->second.material_path, prefab.materialPaths, materialIndices);
+		}
+
+		auto nameIt = info.node_names.find(id);
+		prefab.nodeNames.push_back(nameIt != info.node_names.end() ? nameIt->second : std::string{});
+		prefab.nodes.push_back(node);
+	}
+
+	prefab.matrices = info.matrices;
+	return prefab;
+}
+
+assets::AssetFile assets::pack_prefab(const PrefabInfo& info)
+{
 	AssetFile file;
 	file.type[0] = 'P';
 	file.type[1] = 'R';
 	file.type[2] = 'F';
 	file.type[3] = 'B';
+	file.version = kCurrentAssetVersion;
 
 	file.binaryBlob.resize(info.matrices.size() * sizeof(float) * 16);
 	memcpy(file.binaryBlob.data(), info.matrices.data(), info.matrices.size() * sizeof(float) * 16);
 
-	std::string jsonstr = metadata.dump();
-	file.json = jsonstr;
+	file.json = pack_prefab_metadata(info, MetadataFormat::Binary);
 	return file;
 }
+
+std::string assets::pack_prefab_metadata(const PrefabInfo& info, MetadataFormat format)
+{
+	if (format == MetadataFormat::Json)
+	{
+		json metadata;
+		metadata[s_kNodeMatrices] = info.node_matrices;
+		metadata[s_kNodeNames] = info.node_names;
+		metadata[s_kNodeParents] = info.node_parents;
+
+		std::unordered_map<uint64_t, json> meshnodes;
+		for (auto pair : info.node_meshes)
+		{
+			json node;
+			node[s_kMeshPath] = pair.second.mesh_path;
+			node[s_kMaterialPath] = pair.second.material_path;
+			meshnodes[pair.first] = node;
+		}
+
+		metadata[s_kNodeMeshes] = meshnodes;
+
+		return metadata.dump();
+	}
+
+	FlatPrefab prefab = flatten_prefab(info);
+
+	MetadataWriter writer;
+	PrefabMetadataBinary fixed{};
+
+	std::vector<PrefabNodeBinary> nodes;
+	nodes.reserve(prefab.nodes.size());
+	for (size_t i = 0; i < prefab.nodes.size(); ++i)
+	{
+		nodes.push_back({ prefab.nodes[i], writer.AddString(prefab.nodeNames[i]) });
+	}
+	fixed.nodes = writer.AddArray(nodes.data(), nodes.size());
+
+	std::vector<MetaString> meshPaths;
+	for (auto& path : prefab.meshPaths)
+	{
+		meshPaths.push_back(writer.AddString(path));
+	}
+	fixed.meshPaths = writer.AddArray(meshPaths.data(), meshPaths.size());
+
+	std::vector<MetaString> materialPaths;
+	for (auto& path : prefab.materialPaths)
+	{
+		materialPaths.push_back(writer.AddString(path));
+	}
+	fixed.materialPaths = writer.AddArray(materialPaths.data(), materialPaths.size());
+
+	return writer.Finish(s_kPrefabTag, s_kPrefabLayoutVersion, &fixed, sizeof(fixed));
+}
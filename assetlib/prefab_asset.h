@@ -1,5 +1,7 @@
 #pragma once
 #include <asset_loader.h>
+#include <asset_metadata.h>
+#include <array>
 
 namespace assets {
 	struct PrefabInfo
@@ -19,7 +21,39 @@ namespace assets {
 		std::vector<std::array<float, 16>> matrices;
 	};
 
+	struct PrefabNode {
+		int32_t parent;		//index into nodes, -1 for root nodes
+		int32_t matrix;		//index into matrices, -1 for identity
+		int32_t mesh;		//index into meshPaths, -1 when the node draws nothing
+		int32_t material;	//index into materialPaths, only set together with mesh
+	};
+
+	//prefab as flat arrays with every parent before its children, so world matrices resolve in a single pass
+	struct FlatPrefab
+	{
+		std::vector<PrefabNode> nodes;
+		std::vector<std::string> nodeNames;
+
+		//deduplicated, several nodes can point at the same path
+		std::vector<std::string> meshPaths;
+		std::vector<std::string> materialPaths;
+
+		std::vector<std::array<float, 16>> matrices;
+	};
+
 	PrefabInfo ReadPrefabInfo(AssetFile* file);
+	PrefabInfo ReadPrefabInfo(const AssetView& view);
+
+	//older prefabs are flattened on load
+	FlatPrefab ReadFlatPrefab(AssetFile* file);
+	FlatPrefab ReadFlatPrefab(const AssetView& view);
 
+	//sorts the nodes topologically. Nodes caught in a parent cycle become roots
+	FlatPrefab flatten_prefab(const PrefabInfo& info);
+
+	//binary prefabs are always stored flattened
 	AssetFile pack_prefab(const PrefabInfo& info);
+
+	//encodes the metadata section on its own, pack_prefab always writes the binary format
+	std::string pack_prefab_metadata(const PrefabInfo& info, MetadataFormat format);
 }
\ No newline at end of file
@@ -1,6 +1,9 @@
 #include <texture_asset.h>
+#include <asset_metadata.h>
+#include <asset_threadpool.h>
 #include <json.hpp>
 #include <lz4.h>
+#include <atomic>
 
 using nlohmann::json;
 
@@ -13,28 +16,134 @@ static const char* s_kOriginalSize = "original_size";
 static const char* s_kWidth = "width";
 static const char* s_kHeight = "height";
 static const char* s_kPage = "pages";
-assets::TextureFormat parse_format(const char* f)
+
+static const char s_kTextureTag[4] = { 'T','E','X','I' };
+
+static const char* s_FormatNames[] = {
+    "Unknown",
+    "RGBA8",
+    "BC1",
+    "BC3",
+    "BC4",
+    "BC5",
+    "BC7",
+};
+
+//fixed part of the binary metadata, only ever append fields to keep older assets readable
+struct TextureMetadataBinary {
+    uint64_t textureSize;
+    uint32_t textureFormat;
+    uint32_t compressionMode;
+    assets::MetaString originalFile;
+    assets::MetaArray pages;
+    //layout 2
+    uint32_t compressionLevel;
+};
+
+static const uint32_t s_kTextureLayoutVersion = 2;
+
+static assets::TextureFormat parse_format(const char* f)
 {
-    if (strcmp(f, "RGBA8") == 0)
+    for (int i = 1; i < (int)assets::TextureFormat::Count; ++i)
     {
-        return assets::TextureFormat::RGBA8;
+        if (strcmp(f, s_FormatNames[i]) == 0)
+        {
+            return (assets::TextureFormat)i;
+        }
     }
-    else
+    return assets::TextureFormat::Unknown;
+}
+
+const char* assets::texture_format_name(TextureFormat format)
+{
+    if (format >= TextureFormat::Count)
     {
-        return assets::TextureFormat::Unknown;
+        return s_FormatNames[0];
     }
+    return s_FormatNames[(int)format];
 }
-assets::TextureInfo assets::ReadTextureInfo(AssetFile* file)
+
+bool assets::IsBlockCompressed(TextureFormat format)
+{
+    return format >= TextureFormat::BC1 && format < TextureFormat::Count;
+}
+
+uint64_t assets::texture_page_size(TextureFormat format, uint32_t width, uint32_t height)
 {
+    uint64_t blocks = uint64_t((width + 3) / 4) * ((height + 3) / 4);
+    switch (format)
+    {
+    case TextureFormat::RGBA8:
+        return uint64_t(width) * height * 4;
+    case TextureFormat::BC1:
+    case TextureFormat::BC4:
+        return blocks * 8;
+    case TextureFormat::BC3:
+    case TextureFormat::BC5:
+    case TextureFormat::BC7:
+        return blocks * 16;
+    default:
+        return 0;
+    }
+}
+static void calculate_page_offsets(assets::TextureInfo& info)
+{
+    info.pageOffsets.resize(info.pages.size());
+
+    uint64_t offset = 0;
+    for (size_t i = 0; i < info.pages.size(); ++i)
+    {
+        info.pageOffsets[i] = offset;
+        offset += info.pages[i].compressedSize;
+    }
+}
+
+//the page table comes from the file, callers size their destination from textureSize
+static bool valid_texture_pages(const assets::TextureInfo* info, size_t sourceSize)
+{
+    uint64_t textureSize = 0;
+    for (auto& page : info->pages)
+    {
+        //raw pages are read with their original size
+        if (info->compressionMode != assets::CompressionMode::LZ4 && page.compressedSize != page.originalSize)
+        {
+            return false;
+        }
+        textureSize += page.originalSize;
+    }
+
+    if (textureSize != info->textureSize || info->pageOffsets.size() != info->pages.size())
+    {
+        return false;
+    }
+    return info->pages.empty() || info->pageOffsets.back() + info->pages.back().compressedSize <= sourceSize;
+}
+
+static bool unpack_page(const assets::TextureInfo* info, const assets::PageInfo& page, const char* source, char* destination)
+{
+    //pages that didnt compress well are stored raw
+    if (info->compressionMode == assets::CompressionMode::LZ4 && page.compressedSize != page.originalSize)
+    {
+        return LZ4_decompress_safe(source, destination, page.compressedSize, page.originalSize) == (int)page.originalSize;
+    }
+
+    memcpy(destination, source, page.originalSize);
+    return true;
+}
+
+static assets::TextureInfo read_texture_info_json(std::string_view jsonString)
+{
+    using namespace assets;
     TextureInfo info;
 
-    json texture_metadata = json::parse(file->json);
+    json texture_metadata = json::parse(jsonString.begin(), jsonString.end());
 
     std::string formatString = texture_metadata[s_kFormat];
     info.textureFormat = parse_format(formatString.c_str());
 
     std::string compressionString = texture_metadata[s_kCompression];
     info.compressionMode = parse_compression(compressionString.c_str());
+    info.compressionLevel = 0;
 
     info.textureSize = texture_metadata[s_kBufferSize];
     info.originalFile = texture_metadata[s_kOriginalFile];
@@ -51,52 +160,134 @@ assets::TextureInfo assets::ReadTextureInfo(AssetFile* file)
         info.pages.push_back(page);
     }
 
+    calculate_page_offsets(info);
+
     return info;
 }
 
-void assets::unpack_texture(TextureInfo* info, const char* sourceBuffer, size_t sourceSize, char* destination)
+static assets::TextureInfo read_texture_info_binary(std::string_view metadata)
 {
-    if (info->compressionMode == CompressionMode::LZ4)
+    using namespace assets;
+    TextureInfo info{};
+
+    MetadataReader reader;
+    if (!reader.Open(metadata, s_kTextureTag))
     {
-        for (auto& page : info->pages)
-        {
-            LZ4_decompress_safe(sourceBuffer, destination, page.compressedSize, page.originalSize);
-            sourceBuffer += page.compressedSize;
-            destination += page.originalSize;
-        }
+        return info;
     }
-    else
+
+    TextureMetadataBinary fixed;
+    reader.ReadFixed(fixed);
+
+    if (!reader.ValidArray(fixed.pages, sizeof(PageInfo)))
     {
-        memcpy(destination, sourceBuffer, sourceSize);
+        return info;
     }
+
+    info.textureSize = fixed.textureSize;
+    info.textureFormat = (TextureFormat)fixed.textureFormat;
+    info.compressionMode = (CompressionMode)fixed.compressionMode;
+    info.originalFile = reader.GetString(fixed.originalFile);
+    info.compressionLevel = fixed.compressionLevel;
+
+    info.pages.resize(fixed.pages.count);
+    for (uint32_t i = 0; i < fixed.pages.count; ++i)
+    {
+        info.pages[i] = reader.ReadElement<PageInfo>(fixed.pages, i);
+    }
+
+    calculate_page_offsets(info);
+
+    return info;
 }
 
-void assets::unpack_texture_page(TextureInfo* info, int pageIndex, char* sourceBuffer, char* destination)
+static assets::TextureInfo read_texture_info(std::string_view metadata, int version)
 {
-    char* source = sourceBuffer;
-    for (int i = 0; i < pageIndex; ++i)
+    if (assets::IsBinaryMetadata(version))
     {
-        source += info->pages[i].compressedSize;
+        return read_texture_info_binary(metadata);
     }
+    return read_texture_info_json(metadata);
+}
+
+assets::TextureInfo assets::ReadTextureInfo(AssetFile* file)
+{
+    return read_texture_info(file->json, file->version);
+}
 
-    if (info->compressionMode == CompressionMode::LZ4)
+assets::TextureInfo assets::ReadTextureInfo(const AssetView& view)
+{
+    return read_texture_info(view.json, view.version);
+}
+
+bool assets::unpack_texture(TextureInfo* info, const char* sourceBuffer, size_t sourceSize, char* destination)
+{
+    if (!valid_texture_pages(info, sourceSize))
     {
-        if (info->pages[pageIndex].compressedSize != info->pages[pageIndex].originalSize)
+        return false;
+    }
+
+    for (size_t i = 0; i < info->pages.size(); ++i)
+    {
+        if (!unpack_page(info, info->pages[i], sourceBuffer + info->pageOffsets[i], destination))
         {
-            LZ4_decompress_safe(source, destination, info->pages[pageIndex].compressedSize, info->pages[pageIndex].originalSize);
+            return false;
         }
-        else
+        destination += info->pages[i].originalSize;
+    }
+    return true;
+}
+
+bool assets::unpack_texture_page(TextureInfo* info, int pageIndex, const char* sourceBuffer, size_t sourceSize, char* destination)
+{
+    if (pageIndex < 0 || pageIndex >= (int)info->pages.size() || !valid_texture_pages(info, sourceSize))
+    {
+        return false;
+    }
+    return unpack_page(info, info->pages[pageIndex], sourceBuffer + info->pageOffsets[pageIndex], destination);
+}
+
+bool assets::unpack_texture_pages_parallel(TextureInfo* info, const char* sourceBuffer, size_t sourceSize, char* destination, const std::vector<size_t>& destinationOffsets)
+{
+    if (destinationOffsets.size() != info->pages.size() || !valid_texture_pages(info, sourceSize))
+    {
+        return false;
+    }
+
+    std::atomic<bool> bFailed{ false };
+    GetDecodeThreadPool().ParallelFor(info->pages.size(), [&](size_t i) {
+        if (!unpack_page(info, info->pages[i], sourceBuffer + info->pageOffsets[i], destination + destinationOffsets[i]))
         {
-            memcpy(destination, source, info->pages[pageIndex].originalSize);
+            bFailed = true;
         }
+    });
+    return !bFailed;
+}
+
+//compresses a page into staging, returns the bytes to store for it. Pages that dont compress well are stored as they are
+static assets::BlobSpan compress_page(const assets::CompressionProfile& profile, const char* pixels, uint32_t originalSize, std::vector<char>& staging)
+{
+    int compressedSize = 0;
+    if (profile.mode == assets::CompressionMode::LZ4)
+    {
+        int compressStaging = LZ4_compressBound(originalSize);
+
+        staging.resize(compressStaging);
+
+        compressedSize = assets::compress_lz4(profile, pixels, staging.data(), originalSize, compressStaging);
     }
-    else
+
+    float compression_rate = float(compressedSize) / float(originalSize);
+
+    //if the compression is more than 80% of the original page size, its not worth to use it
+    if (compressedSize == 0 || compression_rate > 0.8)
     {
-        memcpy(destination, source, info->pages[pageIndex].originalSize);
+        return { pixels, originalSize };
     }
+    return { staging.data(), size_t(compressedSize) };
 }
 
-assets::AssetFile assets::pack_texture(TextureInfo* info, void* pixelData)
+assets::AssetFile assets::pack_texture(TextureInfo* info, void* pixelData, const CompressionProfile& profile)
 {
     AssetFile file;
     
@@ -105,61 +296,103 @@ assets::AssetFile assets::pack_texture(TextureInfo* info, void* pixelData)
     file.type[2] = 'X';
     file.type[3] = 'I';
 
-    file.version = 1;
+    file.version = kCurrentAssetVersion;
 
     char* pixels = (char*)pixelData;
     std::vector<char> page_buffer;
 
     for (auto& p : info->pages)
     {
-        page_buffer.resize(p.originalSize);
+        BlobSpan page = compress_page(profile, pixels, p.originalSize, page_buffer);
+
+        p.compressedSize = static_cast<uint32_t>(page.size());
+        file.binaryBlob.insert(file.binaryBlob.end(), page.data(), page.data() + page.size());
 
-        int compressStaging = LZ4_compressBound(p.originalSize);
+        pixels += p.originalSize;
+    }
 
-        page_buffer.resize(compressStaging);
+    info->compressionMode = profile.mode;
+    info->compressionLevel = profile.level;
+    calculate_page_offsets(*info);
+    file.json = pack_texture_metadata(info, MetadataFormat::Binary);
 
-        int compressedSize = LZ4_compress_default(pixels, page_buffer.data(), p.originalSize, compressStaging);
+    return file;
+}
 
-        float compression_rate = float(compressedSize) / float(info->textureSize);
+bool assets::TextureWriter::Open(const char* path, TextureInfo* info, const CompressionProfile& profile)
+{
+    m_Info = info;
+    m_Profile = profile;
+    m_NextPage = 0;
 
-        //if the compression is more than 80% of the originalObjectId size, its not worth to use it
-        if (compression_rate > 0.8)
-        {
-            compressedSize = p.originalSize;
-            page_buffer.resize(compressedSize);
-            memcpy(page_buffer.data(), pixels, compressedSize);
-        }
-        else
-        {
-            page_buffer.resize(compressedSize);
-        }
-        p.compressedSize = compressedSize;
-        file.binaryBlob.insert(file.binaryBlob.end(), page_buffer.begin(), page_buffer.end());
+    //the binary metadata only grows with the page count and the file name, so the sizes filled in later keep its size
+    info->compressionMode = profile.mode;
+    info->compressionLevel = profile.level;
+    for (auto& p : info->pages)
+    {
+        p.compressedSize = 0;
+    }
+    return m_File.Open(path, s_kTextureTag, kCurrentAssetVersion, pack_texture_metadata(info, MetadataFormat::Binary));
+}
 
-        pixels += p.originalSize;
+bool assets::TextureWriter::WritePage(const char* pixels)
+{
+    if (m_NextPage >= m_Info->pages.size())
+    {
+        return false;
     }
+    PageInfo& p = m_Info->pages[m_NextPage++];
 
-    json texture_metadata;
-    texture_metadata[s_kFormat] = "RGBA8";
+    BlobSpan page = compress_page(m_Profile, pixels, p.originalSize, m_Staging);
+    p.compressedSize = static_cast<uint32_t>(page.size());
+    return m_File.Write(page.data(), page.size());
+}
 
-    texture_metadata[s_kBufferSize] = info->textureSize;
-    texture_metadata[s_kOriginalFile] = info->originalFile;
-    texture_metadata[s_kCompression] = "LZ4";
+bool assets::TextureWriter::Finish()
+{
+    if (m_NextPage != m_Info->pages.size())
+    {
+        return false;
+    }
+    calculate_page_offsets(*m_Info);
+    return m_File.Finish(pack_texture_metadata(m_Info, MetadataFormat::Binary));
+}
 
-    std::vector<json> page_json;
-    for (auto& p : info->pages)
+std::string assets::pack_texture_metadata(const TextureInfo* info, MetadataFormat format)
+{
+    if (format == MetadataFormat::Json)
     {
-        json page;
-        page[s_kCompressedSize] = p.compressedSize;
-        page[s_kOriginalSize] = p.originalSize;
-        page[s_kWidth] = p.width;
-        page[s_kHeight] = p.height;
-        page_json.push_back(page);
+        json texture_metadata;
+        texture_metadata[s_kFormat] = s_FormatNames[(int)info->textureFormat];
+
+        texture_metadata[s_kBufferSize] = info->textureSize;
+        texture_metadata[s_kOriginalFile] = info->originalFile;
+        texture_metadata[s_kCompression] = compression_name(info->compressionMode);
+
+        std::vector<json> page_json;
+        for (auto& p : info->pages)
+        {
+            json page;
+            page[s_kCompressedSize] = p.compressedSize;
+            page[s_kOriginalSize] = p.originalSize;
+            page[s_kWidth] = p.width;
+            page[s_kHeight] = p.height;
+            page_json.push_back(page);
+        }
+        texture_metadata[s_kPage] = page_json;
+
+        return texture_metadata.dump();
     }
-    texture_metadata[s_kPage] = page_json;
 
-    std::string jsonstr = texture_metadata.dump();
-    file.json = jsonstr;
+    MetadataWriter writer;
 
-    return file;
+    TextureMetadataBinary fixed{};
+    fixed.textureSize = info->textureSize;
+    fixed.textureFormat = (uint32_t)info->textureFormat;
+    fixed.compressionMode = (uint32_t)info->compressionMode;
+    fixed.originalFile = writer.AddString(info->originalFile);
+    fixed.pages = writer.AddArray(info->pages.data(), info->pages.size());
+    fixed.compressionLevel = info->compressionLevel;
+
+    return writer.Finish(s_kTextureTag, s_kTextureLayoutVersion, &fixed, sizeof(fixed));
 }
@@ -1,11 +1,19 @@
 #pragma once
 #include <asset_loader.h>
+#include <asset_metadata.h>
 
 namespace assets {
 	enum class TextureFormat : uint32_t
 	{
 		Unknown = 0,
 		RGBA8,
+		//block compressed, pages hold whole 4x4 blocks
+		BC1,	//rgb, 1 bit alpha
+		BC3,	//rgba
+		BC4,	//single channel masks
+		BC5,	//two channel, tangent space normals
+		BC7,	//high quality rgba
+		Count,
 	};
 
 	struct PageInfo {
@@ -20,16 +28,54 @@ namespace assets {
 		uint64_t textureSize;
 		TextureFormat textureFormat;
 		CompressionMode compressionMode;
+		uint32_t compressionLevel;
 
 		std::string originalFile;
 		std::vector<PageInfo> pages;
+
+		//blob offset of every page, filled when the info is read or packed
+		std::vector<uint64_t> pageOffsets;
 	};
 
+	bool IsBlockCompressed(TextureFormat format);
+
+	const char* texture_format_name(TextureFormat format);
+
+	//bytes of a width x height page in the format, block formats round up to whole blocks
+	uint64_t texture_page_size(TextureFormat format, uint32_t width, uint32_t height);
+
 	TextureInfo ReadTextureInfo(AssetFile* file);
+	TextureInfo ReadTextureInfo(const AssetView& view);
+
+	//the unpack functions return false when the pages dont add up to textureSize or dont fit in the blob
+	bool unpack_texture(TextureInfo* info, const char* sourceBuffer, size_t sourceSize, char* destination);
 
-	void unpack_texture(TextureInfo* info, const char* sourceBuffer, size_t sourceSize, char* destination);
+	bool unpack_texture_page(TextureInfo* info, int pageIndex, const char* sourceBuffer, size_t sourceSize, char* destination);
 
-	void unpack_texture_page(TextureInfo* info, int pageIndex, char* sourceBuffer, char* destination);
+	//decodes every page on the decode thread pool, page i is written to destination + destinationOffsets[i]
+	bool unpack_texture_pages_parallel(TextureInfo* info, const char* sourceBuffer, size_t sourceSize, char* destination, const std::vector<size_t>& destinationOffsets);
+
+	AssetFile pack_texture(TextureInfo* info, void* pixelData, const CompressionProfile& profile = {});
+
+	//same file as pack_texture and SaveBinaryFile, but every page is compressed and written as soon as it is given,
+	//so only one page is held at a time. The width, height and originalSize of every page have to be filled before Open
+	class TextureWriter {
+	public:
+		bool Open(const char* path, TextureInfo* info, const CompressionProfile& profile = {});
+
+		//pages in order, pixels holds originalSize bytes
+		bool WritePage(const char* pixels);
+
+		//fails if a page is missing
+		bool Finish();
+	private:
+		AssetFileWriter m_File;
+		TextureInfo* m_Info{ nullptr };
+		CompressionProfile m_Profile;
+		size_t m_NextPage{ 0 };
+		std::vector<char> m_Staging;
+	};
 
-	AssetFile pack_texture(TextureInfo* info, void* pixelData);
+	//encodes the metadata section on its own, pack_texture always writes the binary format
+	std::string pack_texture_metadata(const TextureInfo* info, MetadataFormat format);
 }
\ No newline at end of file
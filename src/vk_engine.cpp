@@ -109,6 +109,12 @@ void VulkanEngine::Init()
 
 	InitPipelines();
 
+	if (m_AssetArchive.Open(AssetArchivePath().c_str()))
+	{
+		LOG_SUCCESS("Asset archive loaded with {} assets", m_AssetArchive.EntryCount());
+	}
+	m_AsyncLoader.Init(AssetPath(""), m_AssetArchive.IsOpen() ? &m_AssetArchive : nullptr);
+
 	LoadImages();
 
 	LoadMeshes();
@@ -136,6 +142,8 @@ void VulkanEngine::Cleanup()
 			vkWaitForFences(m_Device, 1, &m_Frames[i].renderFence, true, TIMEOUT_1SEC);
 		}
 		
+		m_AsyncLoader.Shutdown();
+
 		m_MainDeletionQueue.flush();
 
 		for (auto& frame : m_Frames)
@@ -196,7 +204,7 @@ void VulkanEngine::draw()
 				for (int o = 0; o < objectCount; ++o)
 				{
 					out.print(" Draw:{}-------------\n", o);
-					out.print(" Object Graphics Count:{}\n", m_RenderScene.m_Passes[MeshpassType::Forward].indirectBatches[o].count);
+					out.print(" Object Graphics Count:{}\n", m_RenderScene.m_Passes[MeshpassType::Forward].indirectBatches[objects[o].batchId].count);
 					out.print(" Visible Count:{}\n", objects[o].command.instanceCount);
 					out.print(" First: {}\n", objects[o].command.firstInstance);
 					out.print(" Indices: {}\n", objects[o].command.indexCount);
@@ -263,8 +271,12 @@ void VulkanEngine::draw()
 	forwardCull.occlusionCull = true;
 	forwardCull.drawDist = (float)CVAR_DrawDistance.Get();
 	forwardCull.aabb = false;
+	forwardCull.coneCull = true;
+	forwardCull.lod = true;
 
 	ExecuteComputeCull(cmd, m_RenderScene.GetMeshPass(MeshpassType::Forward), forwardCull);
+	//transparent objects are drawn without backface culling
+	forwardCull.coneCull = false;
 	ExecuteComputeCull(cmd, m_RenderScene.GetMeshPass(MeshpassType::Transparency), forwardCull);
 
 	CullParams shadowCull;
@@ -274,6 +286,8 @@ void VulkanEngine::draw()
 	shadowCull.occlusionCull = false;
 	shadowCull.drawDist = 999999;
 	shadowCull.aabb = true;
+	shadowCull.coneCull = false;
+	shadowCull.lod = false;
 
 	glm::vec3 aabbcenter = m_MainLight.lightPosition;
 	glm::vec3 aabbExtent = m_MainLight.shadowExtent * 1.5f;
@@ -287,7 +301,7 @@ void VulkanEngine::draw()
 		}
 	}
 
-	vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, 0, 0, nullptr, (uint32_t)m_PostCullBarriers.size(), m_PostCullBarriers.data(), 0, nullptr);
+	vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT, 0, 0, nullptr, (uint32_t)m_PostCullBarriers.size(), m_PostCullBarriers.data(), 0, nullptr);
 
 	m_Stats.drawcalls = 0;
 	m_Stats.draws = 0;
@@ -588,6 +602,7 @@ AllocatedBufferUntyped VulkanEngine::CreateBuffer(size_t allocSize, VkBufferUsag
 	vmaallocInfo.requiredFlags = requiredFlag;
 
 	AllocatedBufferUntyped buffer;
+	buffer.size = allocSize;
 
 	VK_CHECK(vmaCreateBuffer(m_Allocator, &info, &vmaallocInfo, &buffer.buffer, &buffer.allocation, nullptr));
 
@@ -631,6 +646,7 @@ void VulkanEngine::InitVulkan()
 	features.multiDrawIndirect = true;
 	features.drawIndirectFirstInstance = true;
 	features.samplerAnisotropy = true;
+	features.textureCompressionBC = true;
 
 	vkb::PhysicalDeviceSelector selector(vkbInst);
 	vkb::PhysicalDevice physicalDevice = selector
@@ -1209,6 +1225,7 @@ void VulkanEngine::InitPipelines()
 		});
 
 	LoadComputeShader(ShaderPath("indirect_cull.comp.spv").c_str(), m_CullPipeline, m_CullLayout);
+	LoadComputeShader(ShaderPath("meshlet_cull.comp.spv").c_str(), m_MeshletCullPipeline, m_MeshletCullLayout);
 	LoadComputeShader(ShaderPath("depth_reduce.comp.spv").c_str(), m_DepthReducePipeline, m_DepthReduceLayout);
 	LoadComputeShader(ShaderPath("sparse_upload.comp.spv").c_str(), m_SparseUploadPipeline, m_SparseUploadLayout);
 }
@@ -1279,7 +1296,7 @@ void VulkanEngine::InitScene()
 			glm::mat4 translation = glm::translate(glm::mat4{ 1.0 }, glm::vec3(x * 5, 10, y * 5));
 			glm::mat4 scale = glm::scale(glm::mat4{ 1.0 }, glm::vec3(10));
 
-			LoadPrefab(AssetPath("FlightHelmet/FlightHelmet.pfb").c_str(), (translation * scale));
+			LoadPrefab("FlightHelmet/FlightHelmet.pfb", (translation * scale));
 		}
 	}
 
@@ -1287,8 +1304,8 @@ void VulkanEngine::InitScene()
 
 	glm::mat4 unrealFixRotation = glm::rotate(glm::radians(-90.f), glm::vec3{ 1,0,0 });
 
-	LoadPrefab(AssetPath("Sponza2.pfb").c_str(), sponzaMatrix);
-	LoadPrefab(AssetPath("scifi/TopDownScifi.pfb").c_str(), glm::translate(glm::vec3{ 0,20,0 }));
+	LoadPrefab("Sponza2.pfb", sponzaMatrix);
+	LoadPrefab("scifi/TopDownScifi.pfb", glm::translate(glm::vec3{ 0,20,0 }));
 	int dimcities = 2;
 	for (int x = -dimcities; x <= dimcities; x++) {
 		for (int y = -dimcities; y <= dimcities; y++) {
@@ -1297,7 +1314,7 @@ void VulkanEngine::InitScene()
 			glm::mat4 scale = glm::scale(glm::mat4{ 1.0 }, glm::vec3(10));
 
 			glm::mat4 cityMatrix = translation;
-			LoadPrefab(AssetPath("CITY/polycity.pfb").c_str(), cityMatrix);
+			LoadPrefab("CITY/polycity.pfb", cityMatrix);
 		}
 	}
 
@@ -1395,12 +1412,12 @@ bool VulkanEngine::LoadPrefab(const char* path, glm::mat4 root)
 {
 	ZoneScopedNC("Load prefab", tracy::Color::Red);
 
-	assets::PrefabInfo* prefab;
+	assets::FlatPrefab* prefab;
 	auto it = m_PrefabCache.find(path);
 	if (it == m_PrefabCache.end())
 	{
-		assets::AssetFile file;
-		bool loaded = assets::LoadBinaryFile(path, file);
+		assets::AssetView file;
+		bool loaded = LoadAsset(path, file);
 
 		if (!loaded)
 		{
@@ -1411,8 +1428,8 @@ bool VulkanEngine::LoadPrefab(const char* path, glm::mat4 root)
 		{
 			LOG_SUCCESS("Prefab {} loaded to cache", path);
 		}
-		prefab = new assets::PrefabInfo;
-		*prefab = assets::ReadPrefabInfo(&file);
+		prefab = new assets::FlatPrefab;
+		*prefab = assets::ReadFlatPrefab(file);
 		m_PrefabCache[path] = prefab;
 	}
 	else
@@ -1426,80 +1443,124 @@ bool VulkanEngine::LoadPrefab(const char* path, glm::mat4 root)
 	VkSampler smoothSampler;
 	vkCreateSampler(m_Device, &samplerInfo, nullptr, &smoothSampler);
 
-	std::unordered_map<uint64_t, glm::mat4> nodeWorldMats;
-	std::vector<std::pair<uint64_t, glm::mat4>> pendingNodes;
-	for (auto& [k, v] : prefab->node_matrices)
+	//parents always come before their children, so one pass resolves every world matrix
+	std::vector<glm::mat4> nodeWorldMats(prefab->nodes.size());
+	for (size_t i = 0; i < prefab->nodes.size(); ++i)
 	{
-		glm::mat4 nodematrix;
-		auto localMat = prefab->matrices[v];
-		memcpy(&nodematrix, &localMat, sizeof(glm::vec4));
+		const assets::PrefabNode& node = prefab->nodes[i];
 
-		auto matrixIt = prefab->node_parents.find(k);
-		if (matrixIt == prefab->node_parents.end())
+		glm::mat4 nodematrix{ 1.f };
+		if (node.matrix >= 0)
 		{
-			nodeWorldMats[k] = root * nodematrix;
+			memcpy(&nodematrix, prefab->matrices[node.matrix].data(), sizeof(glm::mat4));
 		}
-		else
+
+		nodeWorldMats[i] = (node.parent >= 0 ? nodeWorldMats[node.parent] : root) * nodematrix;
+	}
+
+	//request every dependency up front so disk reads and lz4 run on the loader while the main thread uploads
+	std::unordered_map<std::string, std::shared_future<assets::AsyncLoadResult>> pendingMeshes;
+	std::unordered_map<std::string, std::shared_future<assets::AsyncLoadResult>> pendingMaterials;
+	for (const assets::PrefabNode& node : prefab->nodes)
+	{
+		if (node.mesh < 0)
+		{
+			continue;
+		}
+
+		const std::string& meshName = prefab->meshPaths[node.mesh];
+		const std::string& materialName = prefab->materialPaths[node.material];
+		if (meshName.find("Sky") != std::string::npos)
 		{
-			pendingNodes.push_back({ k,nodematrix });
+			continue;
+		}
+
+		if (!GetMesh(meshName) && pendingMeshes.find(meshName) == pendingMeshes.end())
+		{
+			pendingMeshes[meshName] = m_AsyncLoader.Request({ meshName, true });
+		}
+		if (!m_MaterialSystem->GetMaterial(materialName) && pendingMaterials.find(materialName) == pendingMaterials.end())
+		{
+			pendingMaterials[materialName] = m_AsyncLoader.Request({ materialName, false });
 		}
 	}
 
-	while (pendingNodes.size() > 0)
+	//textures are only known once their material is read
+	std::unordered_map<std::string, assets::MaterialInfo> materialInfos;
+	std::unordered_map<std::string, std::shared_future<assets::AsyncLoadResult>> pendingTextures;
+	for (auto& [materialName, future] : pendingMaterials)
 	{
-		for (int i = 0; i < pendingNodes.size(); ++i)
+		const assets::AsyncLoadResult& loaded = future.get();
+		if (!loaded.loaded)
 		{
-			uint64_t node = pendingNodes[i].first;
-			uint64_t parent = prefab->node_parents[node];
-			auto matrixIt = nodeWorldMats.find(parent);
-			if (matrixIt != nodeWorldMats.end())
-			{
-				nodeWorldMats[node] = matrixIt->second * pendingNodes[i].second;
-				pendingNodes[i] = pendingNodes.back();
-				pendingNodes.pop_back();
-				--i;
-			}
+			continue;
+		}
+
+		assets::MaterialInfo material = assets::read_material_info(loaded.view);
+
+		auto textureName = material.textures["baseColor"];
+		if (textureName.size() <= 3)
+		{
+			textureName = "Sponza/White.tx";
+		}
+		material.textures["baseColor"] = textureName;
+
+		if (m_LoadedTextures.find(textureName) == m_LoadedTextures.end() && pendingTextures.find(textureName) == pendingTextures.end())
+		{
+			pendingTextures[textureName] = m_AsyncLoader.Request({ textureName, true });
+		}
+		materialInfos[materialName] = std::move(material);
+	}
+
+	//results are erased once uploaded so their decoded memory is released straight away
+	for (auto it = pendingMeshes.begin(); it != pendingMeshes.end(); it = pendingMeshes.erase(it))
+	{
+		const assets::AsyncLoadResult& loaded = it->second.get();
+
+		Mesh mesh{};
+		if (loaded.loaded)
+		{
+			UploadMeshFromAsset(mesh, loaded.view, it->first.c_str(), loaded.decoded.empty() ? nullptr : loaded.decoded.data());
 		}
+		m_Meshes[it->first] = mesh;
+	}
+
+	for (auto it = pendingTextures.begin(); it != pendingTextures.end(); it = pendingTextures.erase(it))
+	{
+		LoadImageToCache(it->first.c_str(), it->second.get());
 	}
 
 	std::vector<MeshObject> prefabRenderables;
-	prefabRenderables.reserve(prefab->node_meshes.size());
+	prefabRenderables.reserve(prefab->nodes.size());
 
-	for (auto& [k, v] : prefab->node_meshes)
+	for (size_t i = 0; i < prefab->nodes.size(); ++i)
 	{
-		if (v.mesh_path.find("Sky") != std::string::npos)
+		const assets::PrefabNode& node = prefab->nodes[i];
+		if (node.mesh < 0)
 		{
 			continue;
 		}
 
-		const std::string& meshName = v.mesh_path;
-		if (!GetMesh(meshName))
+		const std::string& meshName = prefab->meshPaths[node.mesh];
+		if (meshName.find("Sky") != std::string::npos)
 		{
-			Mesh mesh{};
-			mesh.LoadFromMeshAsset(AssetPath(meshName).c_str());
-			UploadMesh(mesh);
-			m_Meshes[meshName] = mesh;
+			continue;
 		}
 
-		const std::string& materialName = v.material_path;
+		const std::string& materialName = prefab->materialPaths[node.material];
 
 		bool isTransparent = false;
 		vkutil::Material* objectMaterial = m_MaterialSystem->GetMaterial(materialName);
 		if (!objectMaterial)
 		{
-			assets::AssetFile materialFile;
-			bool loaded = assets::LoadBinaryFile(AssetPath(materialName).c_str(), materialFile);
-			if (loaded)
+			auto materialIt = materialInfos.find(materialName);
+			if (materialIt != materialInfos.end())
 			{
-				assets::MaterialInfo material = assets::read_material_info(&materialFile);
+				assets::MaterialInfo& material = materialIt->second;
 
 				auto textureName = material.textures["baseColor"];
-				if (textureName.size() <= 3)
-				{
-					textureName = "Sponza/White.tx";
-				}
 
-				loaded = LoadImageToCache(textureName, AssetPath(textureName));
+				bool loaded = m_LoadedTextures.find(textureName) != m_LoadedTextures.end();
 
 				if (loaded)
 				{
@@ -1526,17 +1587,17 @@ bool VulkanEngine::LoadPrefab(const char* path, glm::mat4 root)
 
 					if (!objectMaterial)
 					{
-						LOG_ERROR("Error when building materia {}", v.material_path);
+						LOG_ERROR("Error when building materia {}", materialName);
 					}
 				}
 				else
 				{
-					LOG_ERROR("Error when loading image at {}", v.material_path);
+					LOG_ERROR("Error when loading image at {}", materialName);
 				}
 			}
 			else
 			{
-				LOG_ERROR("Error when loading material at path {}", v.material_path);
+				LOG_ERROR("Error when loading material at path {}", materialName);
 			}
 		}
 
@@ -1545,16 +1606,8 @@ bool VulkanEngine::LoadPrefab(const char* path, glm::mat4 root)
 		loadmesh.bDrawForwardPass = true;
 		loadmesh.bDrawShadowPass = !isTransparent;
 
-		glm::mat4 nodematrix{ 1.f };
-
-		auto matrixIt = nodeWorldMats.find(k);
-		if (matrixIt != nodeWorldMats.end())
-		{
-			memcpy(&nodematrix, &(matrixIt->second), sizeof(glm::mat4));
-		}
-
 		loadmesh.mesh = GetMesh(meshName);
-		loadmesh.transformMatrix = nodematrix;
+		loadmesh.transformMatrix = nodeWorldMats[i];
 		loadmesh.material = objectMaterial;
 
 		RefreshRenderBounds(&loadmesh);
@@ -1568,7 +1621,29 @@ bool VulkanEngine::LoadPrefab(const char* path, glm::mat4 root)
 
 void VulkanEngine::RefreshRenderBounds(MeshObject* object)
 {
+	object->bounds.valid = false;
 	if (!object->mesh->bounds.valid) return;
+
+	RenderBounds original = object->mesh->bounds;
+
+	//world aabb around the transformed corners of the mesh box
+	glm::vec3 min{ std::numeric_limits<float>::max() };
+	glm::vec3 max{ std::numeric_limits<float>::lowest() };
+	for (int i = 0; i < 8; ++i)
+	{
+		glm::vec3 corner = original.origin + original.extents * glm::vec3(i & 1 ? 1.f : -1.f, i & 2 ? 1.f : -1.f, i & 4 ? 1.f : -1.f);
+		glm::vec3 world = glm::vec3(object->transformMatrix * glm::vec4(corner, 1.f));
+		min = glm::min(min, world);
+		max = glm::max(max, world);
+	}
+
+	//the sphere keeps its own center, scaled by the largest axis so it still contains the mesh
+	float scale = std::max(glm::length(glm::vec3(object->transformMatrix[0])), std::max(glm::length(glm::vec3(object->transformMatrix[1])), glm::length(glm::vec3(object->transformMatrix[2]))));
+
+	object->bounds.extents = (max - min) * 0.5f;
+	object->bounds.origin = glm::vec3(object->transformMatrix * glm::vec4(original.origin, 1.f));
+	object->bounds.radius = original.radius * scale;
+	object->bounds.valid = true;
 }
 
 
@@ -1582,6 +1657,20 @@ std::string VulkanEngine::AssetPath(std::string_view path)
 	return "../../assets_export/" + std::string(path);
 }
 
+std::string VulkanEngine::AssetArchivePath()
+{
+	return "../../assets_export.pak";
+}
+
+bool VulkanEngine::LoadAsset(std::string_view path, assets::AssetView& outView)
+{
+	if (m_AssetArchive.IsOpen() && m_AssetArchive.LoadAssetView(path, outView))
+	{
+		return true;
+	}
+	return assets::LoadAssetView(AssetPath(path).c_str(), outView);
+}
+
 void VulkanEngine::LoadMeshes()
 {
 	m_Meshes.reserve(1000);
@@ -1603,7 +1692,7 @@ void VulkanEngine::LoadMeshes()
 
 void VulkanEngine::LoadImages()
 {
-	LoadImageToCache("white", AssetPath("Sponza/white.tx"));
+	LoadImageToCache("white", "Sponza/white.tx");
 }
 
 bool VulkanEngine::LoadImageToCache(const char* name, const char* path)
@@ -1616,7 +1705,8 @@ bool VulkanEngine::LoadImageToCache(const char* name, const char* path)
 	}
 
 	Texture tex;
-	bool result = vkutil::LoadImageFromAsset(*this, path, tex.image);
+	assets::AssetView file;
+	bool result = LoadAsset(path, file) && vkutil::LoadImageFromAsset(*this, file, path, tex.image);
 	if (!result)
 	{
 		LOG_ERROR("Errir when loading texture {} at path {}", name, path);
@@ -1636,6 +1726,10 @@ void VulkanEngine::UploadMesh(Mesh& mesh)
 {
 	ZoneScopedNC("Upload Mesh", tracy::Color::Orange);
 
+	mesh.vertexCount = static_cast<uint32_t>(mesh.vertices.size());
+	mesh.indexCount = static_cast<uint32_t>(mesh.indices.size());
+	mesh.indexType = VK_INDEX_TYPE_UINT32;
+
 	const size_t vertexBufferSize = mesh.vertices.size() * sizeof(Vertex);
 	VkBufferCreateInfo vertexBufferInfo{};
 
@@ -1679,6 +1773,54 @@ void VulkanEngine::UploadMesh(Mesh& mesh)
 	}
 }
 
+bool VulkanEngine::UploadMeshFromAsset(Mesh& mesh, const assets::AssetView& file, const char* name, const char* decodedBlob)
+{
+	ZoneScopedNC("Upload Mesh", tracy::Color::Orange);
+
+	assets::MeshInfo meshInfo = assets::ReadMeshInfo(file);
+
+	mesh.vertexCount = Mesh::AssetVertexCount(meshInfo);
+	mesh.indexType = Mesh::AssetIndexType(meshInfo);
+	if (mesh.vertexCount == 0 || mesh.indexType == VK_INDEX_TYPE_MAX_ENUM)
+	{
+		LOG_ERROR("Error when decoding mesh {}", name);
+		return false;
+	}
+	mesh.indexCount = static_cast<uint32_t>(meshInfo.indexBufferSize / Mesh::IndexTypeSize(mesh.indexType));
+
+	//same cpu side buffers UploadMesh makes, MergeMeshes copies out of them
+	mesh.vertexBuffer = CreateBuffer(mesh.vertexCount * sizeof(Vertex), VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VMA_MEMORY_USAGE_CPU_ONLY);
+	Vertex* vertexData = MapBuffer(mesh.vertexBuffer);
+
+	void* indexData = nullptr;
+	if (mesh.indexCount > 0)
+	{
+		mesh.indexBuffer = CreateBuffer(meshInfo.indexBufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VMA_MEMORY_USAGE_CPU_ONLY);
+		indexData = MapBuffer(mesh.indexBuffer);
+	}
+
+	bool decoded = Mesh::DecodeMeshAsset(meshInfo, file, vertexData, indexData, decodedBlob);
+
+	UnmapBuffer(mesh.vertexBuffer);
+	if (mesh.indexCount > 0)
+	{
+		UnmapBuffer(mesh.indexBuffer);
+	}
+
+	if (!decoded)
+	{
+		LOG_ERROR("Error when decoding mesh {}", name);
+		return false;
+	}
+
+	mesh.bounds.FromMeshBound(meshInfo.bounds);
+	mesh.meshlets = std::move(meshInfo.meshlets);
+	mesh.lods = std::move(meshInfo.lods);
+
+	LOG_SUCCESS("Loaded mesh {} : Verts {}, tris = {}", name, mesh.vertexCount, mesh.indexCount / 3);
+	return true;
+}
+
 size_t VulkanEngine::pad_uniform_buffer_size(size_t originalSize)
 {
 	size_t minAlignment = m_GpuPropertices.limits.minUniformBufferOffsetAlignment;
@@ -1692,12 +1834,44 @@ size_t VulkanEngine::pad_uniform_buffer_size(size_t originalSize)
 
 Mesh* VulkanEngine::GetMesh(const std::string& name)
 {
-	return nullptr;
+	//unordered_map nodes never move, so the pointer stays valid while more meshes are loaded
+	auto it = m_Meshes.find(name);
+	if (it == m_Meshes.end())
+	{
+		return nullptr;
+	}
+	return &it->second;
 }
 
 bool VulkanEngine::LoadImageToCache(const std::string& name, const std::string& path)
 {
-	return false;
+	return LoadImageToCache(name.c_str(), path.c_str());
+}
+
+bool VulkanEngine::LoadImageToCache(const char* name, const assets::AsyncLoadResult& loaded)
+{
+	ZoneScopedNC("Load Texture", tracy::Color::Yellow);
+
+	if (m_LoadedTextures.find(name) != m_LoadedTextures.end())
+	{
+		return true;
+	}
+
+	Texture tex;
+	bool result = loaded.loaded && vkutil::LoadImageFromAsset(*this, loaded.view, loaded.path.c_str(), tex.image, loaded.decoded.data());
+	if (!result)
+	{
+		LOG_ERROR("Errir when loading texture {} at path {}", name, loaded.path);
+		return false;
+	}
+	else
+	{
+		LOG_SUCCESS("Loaded Texture {} at path {}", name, loaded.path);
+	}
+	tex.imageView = tex.image.defaultView;
+
+	m_LoadedTextures[name] = tex;
+	return true;
 }
 
 void VulkanEngine::ReallocateBuffer(AllocatedBufferUntyped& buffer, size_t allocSize, VkBufferUsageFlags usage, VmaMemoryUsage memoryUsage, VkMemoryPropertyFlags requiredFlags)
@@ -16,11 +16,13 @@
 #include <material_system.h>
 #include <vk_pushbuffer.h>
 #include <player_camera.h>
+#include <asset_archive.h>
+#include <asset_async_loader.h>
 
 #include <glm/glm.hpp>
 
 namespace assets {
-	struct PrefabInfo;
+	struct FlatPrefab;
 }
 
 namespace vkutil
@@ -76,6 +78,10 @@ struct CullParams {
 	bool aabb;
 	glm::vec3 aabbMin;
 	glm::vec3 aabbMax;
+	//meshlet backface cones, only valid for passes that cull back faces
+	bool coneCull;
+	//needs a perspective projection, the error is scaled by distance
+	bool lod;
 };
 
 struct EngineStats {
@@ -91,7 +97,7 @@ struct DrawCullData
 	glm::mat4 viewMat;
 	float p00, p11, znear, zfar;// symmetric projection parameters
 	float frustum[4];	// data for left/right/top/bottom frustum planes
-	float lodBase, lodStep;	// lod distance i = base * pow(step, i)
+	float lodTargetError, lodScreenHeight;	// pixels of error a lod may add, on a target this many pixels high
 	float pyramidWidth, pyramidHeight; // depth pyramid size in texels
 
 	uint32_t drawCount;
@@ -110,6 +116,12 @@ struct DrawCullData
 	float aabbMaxZ;
 };
 
+struct MeshletCullData
+{
+	DrawCullData cullData;
+	int coneCullingEnabled;
+};
+
 struct DeletionQueue
 {
 	std::deque<std::function<void()>> deletors;
@@ -214,6 +226,9 @@ public:
 
 	bool LoadPrefab(const char* path, glm::mat4 root);
 
+	//resolves an export relative asset path, through the packed archive when one is loaded
+	bool LoadAsset(std::string_view path, assets::AssetView& outView);
+
 	void RefreshRenderBounds(MeshObject* object);
 
 	inline VkDevice device() const;
@@ -232,6 +247,7 @@ public:
 public:
 	static std::string ShaderPath(std::string_view path);
 	static std::string AssetPath(std::string_view path);
+	static std::string AssetArchivePath();
 private:
 	void InitVulkan();
 
@@ -265,8 +281,14 @@ private:
 
 	bool LoadImageToCache(const char* name, const char* path);
 
+	//uploads a texture the async loader already read and decompressed
+	bool LoadImageToCache(const char* name, const assets::AsyncLoadResult& loaded);
+
 	void UploadMesh(Mesh& mesh);
 
+	//creates the mesh staging buffers and decodes the asset straight into them
+	bool UploadMeshFromAsset(Mesh& mesh, const assets::AssetView& file, const char* name, const char* decodedBlob = nullptr);
+
 	size_t pad_uniform_buffer_size(size_t originalSize);
 
 	Mesh* GetMesh(const std::string& name);
@@ -274,14 +296,18 @@ private:
 	bool LoadImageToCache(const std::string& name, const std::string& path);
 
 	void ReadyMeshDraw(VkCommandBuffer cmd);
+	//uploads the batches and instances of a pass after it was rebuilt
+	void ReadyPassBuffers(RenderScene::MeshPass& pass, VkCommandBuffer cmd);
 
 	void ReadyCullData(RenderScene::MeshPass& pass, VkCommandBuffer cmd);
+	void ReadyMeshletCullData(RenderScene::MeshPass& pass, VkCommandBuffer cmd);
 
 	void DrawObjectsForward(VkCommandBuffer cmd, RenderScene::MeshPass& pass);
 
 	void DrawObjectsShadow(VkCommandBuffer cmd, RenderScene::MeshPass& pass);
 
-	void ExecuteDrawCommands(VkCommandBuffer cmd, RenderScene::MeshPass& passs, VkDescriptorSet objectDataSet, std::vector<uint32_t> dynamicOffsets, VkDescriptorSet globalSet);
+	VkDescriptorSet BuildMeshletObjectDataSet(RenderScene::MeshPass& pass, VkDescriptorBufferInfo& objectBufferInfo);
+	void ExecuteDrawCommands(VkCommandBuffer cmd, RenderScene::MeshPass& passs, VkDescriptorSet objectDataSet, VkDescriptorSet meshletObjectDataSet, std::vector<uint32_t> dynamicOffsets, VkDescriptorSet globalSet);
 
 	void ForwardPass(VkClearValue clearValue, VkCommandBuffer cmd);
 
@@ -292,6 +318,7 @@ private:
 	void ReduceDepth(VkCommandBuffer cmd);
 
 	void ExecuteComputeCull(VkCommandBuffer cmd, RenderScene::MeshPass& pass, CullParams& params);
+	void ExecuteMeshletCull(VkCommandBuffer cmd, RenderScene::MeshPass& pass, CullParams& params, const DrawCullData& cullData);
 
 	void ReallocateBuffer(AllocatedBufferUntyped& buffer, size_t allocSize, VkBufferUsageFlags usage, VmaMemoryUsage memoryUsage, VkMemoryPropertyFlags requiredFlags = 0);
 private:
@@ -350,6 +377,9 @@ private:
 	VkPipeline m_CullPipeline;
 	VkPipelineLayout m_CullLayout;
 
+	VkPipeline m_MeshletCullPipeline;
+	VkPipelineLayout m_MeshletCullLayout;
+
 	VkPipeline m_DepthReducePipeline;
 	VkPipelineLayout m_DepthReduceLayout;
 
@@ -367,8 +397,11 @@ private:
 	vkutil::DescriptorLayoutCache* m_DescritptorLayoutCache;
 	vkutil::MaterialSystem* m_MaterialSystem;
 
+	assets::AssetArchive m_AssetArchive;
+	assets::AsyncLoader m_AsyncLoader;
+
 	std::unordered_map<std::string, Mesh> m_Meshes;
-	std::unordered_map<std::string, assets::PrefabInfo*> m_PrefabCache;
+	std::unordered_map<std::string, assets::FlatPrefab*> m_PrefabCache;
 	std::unordered_map<std::string, Texture> m_LoadedTextures;
 
 	RenderScene m_RenderScene;
@@ -9,6 +9,11 @@ AutoCVar_Int CVAR_FreezeCull("culling.freeze", "Locks culling", 0, CVarFlags::Ed
 
 AutoCVar_Int CVAR_Shadowcast("gpu.shadowcast", "Use shadowcasting", 1, CVarFlags::EditCheckbox);
 
+AutoCVar_Int CVAR_ConeCull("culling.meshletConeCull", "Cull meshlets that face away from the camera", 1, CVarFlags::EditCheckbox);
+
+AutoCVar_Int CVAR_LodEnabled("culling.enableLod", "Pick a level of detail per object on the gpu", 1, CVarFlags::EditCheckbox);
+AutoCVar_Float CVAR_LodTargetError("culling.lodTargetError", "Pixels of error a level of detail may add", 1.f);
+
 AutoCVar_Float CVAR_ShadowBias("gpu.shadowBias", "Distance cull", 5.25f);
 AutoCVar_Float CVAR_SlopeBias("gpu.shadowBiasSlope", "Distance cull", 4.75f);
 
@@ -111,13 +116,92 @@ void VulkanEngine::ReadyMeshDraw(VkCommandBuffer cmd)
 		m_UploadBarriers.push_back(barrier);
 		m_RenderScene.ClearDirtyObjects();
 	}
+
+	ReadyPassBuffers(m_RenderScene.GetMeshPass(MeshpassType::Forward), cmd);
+	ReadyPassBuffers(m_RenderScene.GetMeshPass(MeshpassType::Transparency), cmd);
+	ReadyPassBuffers(m_RenderScene.GetMeshPass(MeshpassType::DirectionalShadow), cmd);
+
+	if (m_UploadBarriers.size() > 0)
+	{
+		vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+			0, 0, nullptr, (uint32_t)m_UploadBarriers.size(), m_UploadBarriers.data(), 0, nullptr);
+		m_UploadBarriers.clear();
+	}
+}
+
+void VulkanEngine::ReadyPassBuffers(RenderScene::MeshPass& pass, VkCommandBuffer cmd)
+{
+	if (pass.needsIndirectRefresh && pass.indirectDrawCount > 0)
+	{
+		ZoneScopedNC("Refresh Indirect Buffer", tracy::Color::Red);
+
+		//the clear buffer is copied over the draws every frame, the frames in flight still copy from the old one
+		AllocatedBuffer<GPUIndirectObject> newBuffer = CreateBuffer(pass.indirectDrawCount * sizeof(GPUIndirectObject), VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VMA_MEMORY_USAGE_CPU_TO_GPU);
+		m_RenderScene.FillIndirectArray(MapBuffer(newBuffer), pass);
+		UnmapBuffer(newBuffer);
+
+		AllocatedBuffer<GPUIndirectObject> oldBuffer = pass.clearIndirectBuffer;
+		GetCurrentFrame().frameDeletionQueue.push_function([=]() {
+			vmaDestroyBuffer(m_Allocator, oldBuffer.buffer, oldBuffer.allocation);
+			});
+		pass.clearIndirectBuffer = newBuffer;
+
+		if (pass.drawIndirectBuffer.size < newBuffer.size)
+		{
+			ReallocateBuffer(pass.drawIndirectBuffer, newBuffer.size, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT, VMA_MEMORY_USAGE_GPU_ONLY);
+		}
+		pass.needsIndirectRefresh = false;
+	}
+
+	if (pass.needsInstanceRefresh && pass.flatRenderBatches.size() > 0)
+	{
+		ZoneScopedNC("Refresh Instancing Buffer", tracy::Color::Red);
+
+		size_t instanceSize = pass.flatRenderBatches.size() * sizeof(GPUInstance);
+		if (pass.passObjectsBuffer.size < instanceSize)
+		{
+			ReallocateBuffer(pass.passObjectsBuffer, instanceSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VMA_MEMORY_USAGE_GPU_ONLY);
+		}
+		if (pass.compactedInstanceBuffer.size < pass.instanceSlotCount * sizeof(uint32_t))
+		{
+			ReallocateBuffer(pass.compactedInstanceBuffer, pass.instanceSlotCount * sizeof(uint32_t), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VMA_MEMORY_USAGE_GPU_ONLY);
+		}
+		if (pass.instanceLodBuffer.size < pass.flatRenderBatches.size() * sizeof(uint32_t))
+		{
+			ReallocateBuffer(pass.instanceLodBuffer, pass.flatRenderBatches.size() * sizeof(uint32_t), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VMA_MEMORY_USAGE_GPU_ONLY);
+		}
+
+		AllocatedBuffer<GPUInstance> staging = CreateBuffer(instanceSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VMA_MEMORY_USAGE_CPU_ONLY);
+		m_RenderScene.FillInstancesArray(MapBuffer(staging), pass);
+		UnmapBuffer(staging);
+
+		GetCurrentFrame().frameDeletionQueue.push_function([=]() {
+			vmaDestroyBuffer(m_Allocator, staging.buffer, staging.allocation);
+			});
+
+		VkBufferCopy instanceCopy;
+		instanceCopy.dstOffset = 0;
+		instanceCopy.srcOffset = 0;
+		instanceCopy.size = instanceSize;
+		vkCmdCopyBuffer(cmd, staging.buffer, pass.passObjectsBuffer.buffer, 1, &instanceCopy);
+
+		VkBufferMemoryBarrier barrier = vkinit::buffer_barrier(pass.passObjectsBuffer.buffer, m_GraphicsQueueFamily);
+		barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+		m_UploadBarriers.push_back(barrier);
+
+		pass.needsInstanceRefresh = false;
+	}
 }
 
 void VulkanEngine::ReadyCullData(RenderScene::MeshPass& pass, VkCommandBuffer cmd)
 {
+	if (pass.indirectDrawCount == 0)
+		return;
+
 	VkBufferCopy indirectCopy;
 	indirectCopy.dstOffset = 0; 
-	indirectCopy.size = pass.indirectBatches.size() * sizeof(GPUIndirectObject);
+	indirectCopy.size = pass.indirectDrawCount * sizeof(GPUIndirectObject);
 	indirectCopy.srcOffset = 0;
 	vkCmdCopyBuffer(cmd, pass.clearIndirectBuffer.buffer, pass.drawIndirectBuffer.buffer, 1, &indirectCopy);
 	{
@@ -127,6 +211,76 @@ void VulkanEngine::ReadyCullData(RenderScene::MeshPass& pass, VkCommandBuffer cm
 
 		m_CullReadyBarriers.push_back(barrier);
 	}
+
+	if (pass.meshletDrawCount > 0)
+	{
+		ReadyMeshletCullData(pass, cmd);
+	}
+}
+
+void VulkanEngine::ReadyMeshletCullData(RenderScene::MeshPass& pass, VkCommandBuffer cmd)
+{
+	size_t drawSize = pass.meshletDrawCount * sizeof(GPUIndirectObject);
+	size_t idSize = pass.meshletDrawCount * sizeof(uint32_t);
+	size_t countSize = pass.indirectBatches.size() * sizeof(uint32_t);
+
+	//only ever grown, every frame clears the part it uses
+	if (pass.meshletDrawBuffer.size < drawSize)
+	{
+		ReallocateBuffer(pass.meshletDrawBuffer, drawSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT, VMA_MEMORY_USAGE_GPU_ONLY);
+	}
+	if (pass.meshletObjectIdBuffer.size < idSize)
+	{
+		ReallocateBuffer(pass.meshletObjectIdBuffer, idSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VMA_MEMORY_USAGE_GPU_ONLY);
+	}
+	if (pass.meshletCountBuffer.size < countSize)
+	{
+		ReallocateBuffer(pass.meshletCountBuffer, countSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VMA_MEMORY_USAGE_GPU_ONLY);
+	}
+
+	if (pass.needsMeshletRefresh)
+	{
+		ZoneScopedNC("Refresh Meshlet Instances", tracy::Color::Red);
+
+		size_t instanceSize = pass.meshletInstances.size() * sizeof(GPUMeshletInstance);
+		if (pass.meshletInstanceBuffer.size < instanceSize)
+		{
+			ReallocateBuffer(pass.meshletInstanceBuffer, instanceSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VMA_MEMORY_USAGE_GPU_ONLY);
+		}
+
+		AllocatedBuffer<GPUMeshletInstance> staging = CreateBuffer(instanceSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VMA_MEMORY_USAGE_CPU_ONLY);
+		memcpy(MapBuffer(staging), pass.meshletInstances.data(), instanceSize);
+		UnmapBuffer(staging);
+
+		GetCurrentFrame().frameDeletionQueue.push_function([=]() {
+			vmaDestroyBuffer(m_Allocator, staging.buffer, staging.allocation);
+			});
+
+		VkBufferCopy instanceCopy;
+		instanceCopy.dstOffset = 0;
+		instanceCopy.srcOffset = 0;
+		instanceCopy.size = instanceSize;
+		vkCmdCopyBuffer(cmd, staging.buffer, pass.meshletInstanceBuffer.buffer, 1, &instanceCopy);
+
+		VkBufferMemoryBarrier barrier = vkinit::buffer_barrier(pass.meshletInstanceBuffer.buffer, m_GraphicsQueueFamily);
+		barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+		m_CullReadyBarriers.push_back(barrier);
+
+		pass.needsMeshletRefresh = false;
+	}
+
+	//slots no visible meshlet lands in stay zero, which draws nothing
+	vkCmdFillBuffer(cmd, pass.meshletDrawBuffer.buffer, 0, drawSize, 0);
+	vkCmdFillBuffer(cmd, pass.meshletCountBuffer.buffer, 0, countSize, 0);
+
+	for (VkBuffer buffer : { pass.meshletDrawBuffer.buffer, pass.meshletCountBuffer.buffer })
+	{
+		VkBufferMemoryBarrier barrier = vkinit::buffer_barrier(buffer, m_GraphicsQueueFamily);
+		barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		barrier.dstAccessMask = VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_SHADER_READ_BIT;
+		m_CullReadyBarriers.push_back(barrier);
+	}
 }
 
 void VulkanEngine::DrawObjectsForward(VkCommandBuffer cmd, RenderScene::MeshPass& pass)
@@ -179,14 +333,16 @@ void VulkanEngine::DrawObjectsForward(VkCommandBuffer cmd, RenderScene::MeshPass
 	VkDescriptorSet objectDataSet;
 	vkutil::DescriptorBuilder::Begin(m_DescritptorLayoutCache, currentFrame.dynamicDescriptorAllocator)
 		.BindBuffer(0, &objectBufferInfo, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_VERTEX_BIT)
-		.BindBuffer(0, &instanceInfo, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_VERTEX_BIT)
+		.BindBuffer(1, &instanceInfo, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_VERTEX_BIT)
 		.Build(objectDataSet);
 
+	VkDescriptorSet meshletObjectDataSet = BuildMeshletObjectDataSet(pass, objectBufferInfo);
+
 	vkCmdSetDepthBias(cmd, 0, 0, 0);
 	std::vector<uint32_t> dynamicOffsets;
 	dynamicOffsets.push_back(cameraDataOffset);
 	dynamicOffsets.push_back(sceneDataOffset);
-	ExecuteDrawCommands(cmd, pass, objectDataSet, dynamicOffsets, globalSet);
+	ExecuteDrawCommands(cmd, pass, objectDataSet, meshletObjectDataSet, dynamicOffsets, globalSet);
 	
 }
 
@@ -221,18 +377,39 @@ void VulkanEngine::DrawObjectsShadow(VkCommandBuffer cmd, RenderScene::MeshPass&
 	VkDescriptorSet objectDataSet;
 	vkutil::DescriptorBuilder::Begin(m_DescritptorLayoutCache, currentFrame.dynamicDescriptorAllocator)
 		.BindBuffer(0, &objectBufferInfo, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_VERTEX_BIT)
-		.BindBuffer(0, &instanceInfo, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_VERTEX_BIT)
+		.BindBuffer(1, &instanceInfo, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_VERTEX_BIT)
 		.Build(objectDataSet);
 
+	VkDescriptorSet meshletObjectDataSet = BuildMeshletObjectDataSet(pass, objectBufferInfo);
+
 	vkCmdSetDepthBias(cmd, CVAR_ShadowBias.GetFloat(), 0, CVAR_SlopeBias.GetFloat());
 
 	std::vector<uint32_t> dynamicOffsets;
 	dynamicOffsets.push_back(cameraDataOffset);
 
-	ExecuteDrawCommands(cmd, pass, objectDataSet, dynamicOffsets, globalSet);
+	ExecuteDrawCommands(cmd, pass, objectDataSet, meshletObjectDataSet, dynamicOffsets, globalSet);
 }
 
-void VulkanEngine::ExecuteDrawCommands(VkCommandBuffer cmd, RenderScene::MeshPass& passs, VkDescriptorSet objectDataSet, std::vector<uint32_t> dynamicOffsets, VkDescriptorSet globalSet)
+VkDescriptorSet VulkanEngine::BuildMeshletObjectDataSet(RenderScene::MeshPass& pass, VkDescriptorBufferInfo& objectBufferInfo)
+{
+	if (pass.meshletDrawCount == 0)
+	{
+		return VK_NULL_HANDLE;
+	}
+
+	VkDescriptorBufferInfo meshletIdInfo = pass.meshletObjectIdBuffer.GetInfo();
+
+	//same layout as the object set, the instance ids come from the meshlet cull instead
+	VkDescriptorSet meshletObjectDataSet;
+	vkutil::DescriptorBuilder::Begin(m_DescritptorLayoutCache, GetCurrentFrame().dynamicDescriptorAllocator)
+		.BindBuffer(0, &objectBufferInfo, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_VERTEX_BIT)
+		.BindBuffer(1, &meshletIdInfo, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_VERTEX_BIT)
+		.Build(meshletObjectDataSet);
+
+	return meshletObjectDataSet;
+}
+
+void VulkanEngine::ExecuteDrawCommands(VkCommandBuffer cmd, RenderScene::MeshPass& passs, VkDescriptorSet objectDataSet, VkDescriptorSet meshletObjectDataSet, std::vector<uint32_t> dynamicOffsets, VkDescriptorSet globalSet)
 {
 	if (passs.indirectBatches.size() > 0)
 	{
@@ -242,11 +419,14 @@ void VulkanEngine::ExecuteDrawCommands(VkCommandBuffer cmd, RenderScene::MeshPas
 		VkPipeline lastPipeline{ VK_NULL_HANDLE };
 		VkPipelineLayout lastLayout{ VK_NULL_HANDLE };
 		VkDescriptorSet lastMaterialSet{ VK_NULL_HANDLE };
+		VkDescriptorSet lastObjectSet{ VK_NULL_HANDLE };
 
 		VkDeviceSize offset = 0;
 		
 		vkCmdBindVertexBuffers(cmd, 0, 1, &m_RenderScene.mergedVertexBuffer.buffer, &offset);
-		vkCmdBindIndexBuffer(cmd, m_RenderScene.mergedVertexBuffer.buffer, 0, VK_INDEX_TYPE_UINT32);
+
+		//merged index buffer currently bound, there is one per index type
+		VkIndexType lastIndexType = VK_INDEX_TYPE_MAX_ENUM;
 
 		m_Stats.objects = (int)passs.flatRenderBatches.size();
 		for (int i = 0; i < passs.multibatches.size(); ++i)
@@ -257,14 +437,25 @@ void VulkanEngine::ExecuteDrawCommands(VkCommandBuffer cmd, RenderScene::MeshPas
 			VkPipeline newPipeline = instanceDraw.material.shaderPass->pipeline;
 			VkPipelineLayout newLayout = instanceDraw.material.shaderPass->layout;
 			VkDescriptorSet newMaterialSet = instanceDraw.material.materialSet;
-			Mesh* drawMesh = m_RenderScene.GetMesh(instanceDraw.meshId)->original;
+			DrawMesh* sceneMesh = m_RenderScene.GetMesh(instanceDraw.meshId);
+			Mesh* drawMesh = sceneMesh->original;
+
+			//multibatches never mix meshlet and per object batches
+			bool meshletDraw = instanceDraw.meshletDrawCount > 0;
+			VkDescriptorSet newObjectSet = meshletDraw ? meshletObjectDataSet : objectDataSet;
 
 			if (newPipeline != lastPipeline)
 			{
 				lastPipeline = newPipeline;
 				vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, newPipeline);
-				vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, newLayout, 1, 1, &objectDataSet, 0, nullptr);
+				vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, newLayout, 1, 1, &newObjectSet, 0, nullptr);
 				vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, newLayout, 0, 1, &globalSet, (uint32_t)dynamicOffsets.size(), dynamicOffsets.data());
+				lastObjectSet = newObjectSet;
+			}
+			if (newObjectSet != lastObjectSet)
+			{
+				lastObjectSet = newObjectSet;
+				vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, newLayout, 1, 1, &newObjectSet, 0, nullptr);
 			}
 			if (newMaterialSet != lastMaterialSet)
 			{
@@ -272,16 +463,21 @@ void VulkanEngine::ExecuteDrawCommands(VkCommandBuffer cmd, RenderScene::MeshPas
 				vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, newLayout, 2, 1, &newMaterialSet, 0, nullptr);
 			}
 
-			bool merged = m_RenderScene.GetMesh(instanceDraw.meshId)->isMerged;
-			if (merged)
+			if (sceneMesh->isMerged)
 			{
 				if (lastMesh != nullptr)
 				{
 					VkDeviceSize offset = 0;
 
 					vkCmdBindVertexBuffers(cmd, 0, 1, &m_RenderScene.mergedVertexBuffer.buffer, &offset);
-					vkCmdBindIndexBuffer(cmd, m_RenderScene.mergedVertexBuffer.buffer, 0, VK_INDEX_TYPE_UINT32);
 					lastMesh = nullptr;
+					lastIndexType = VK_INDEX_TYPE_MAX_ENUM;
+				}
+				if (sceneMesh->indexCount > 0 && lastIndexType != sceneMesh->indexType)
+				{
+					lastIndexType = sceneMesh->indexType;
+					VkBuffer indexBuffer = lastIndexType == VK_INDEX_TYPE_UINT16 ? m_RenderScene.mergedIndexBuffer16.buffer : m_RenderScene.mergedIndexBuffer.buffer;
+					vkCmdBindIndexBuffer(cmd, indexBuffer, 0, lastIndexType);
 				}
 			}
 			else if (lastMesh != drawMesh)
@@ -291,26 +487,45 @@ void VulkanEngine::ExecuteDrawCommands(VkCommandBuffer cmd, RenderScene::MeshPas
 				vkCmdBindVertexBuffers(cmd, 0, 1, &drawMesh->vertexBuffer.buffer, &offset);
 				if (drawMesh->indexBuffer.buffer != VK_NULL_HANDLE)
 				{
-					vkCmdBindIndexBuffer(cmd, drawMesh->indexBuffer.buffer, 0, VK_INDEX_TYPE_UINT32);
+					vkCmdBindIndexBuffer(cmd, drawMesh->indexBuffer.buffer, 0, drawMesh->indexType);
 				}
 				lastMesh = drawMesh;
+				lastIndexType = VK_INDEX_TYPE_MAX_ENUM;
 			}
 
-			bool hasIndices = drawMesh->indices.size() > 0;
+			bool hasIndices = drawMesh->indexCount > 0;
 			if (!hasIndices)
 			{
-				m_Stats.triangles += (int)drawMesh->vertices.size() / 3 * instanceDraw.count;
-				vkCmdDraw(cmd, (uint32_t)drawMesh->vertices.size(), instanceDraw.count, 0, instanceDraw.first);
+				m_Stats.triangles += (int)drawMesh->vertexCount / 3 * instanceDraw.count;
+				vkCmdDraw(cmd, drawMesh->vertexCount, instanceDraw.count, 0, instanceDraw.firstInstance);
 
 				++m_Stats.draws;
 				m_Stats.drawcalls += instanceDraw.count;
 			}
 			else
 			{
-				m_Stats.triangles += (int)drawMesh->indices.size() / 3 * instanceDraw.count;
-				vkCmdDrawIndexedIndirect(cmd, passs.drawIndirectBuffer.buffer, multibatch.first * sizeof(GPUIndirectObject), multibatch.count, sizeof(GPUIndirectObject));
+				auto& lastDraw = passs.indirectBatches[multibatch.first + multibatch.count - 1];
+				m_Stats.triangles += (int)sceneMesh->indexCount / 3 * instanceDraw.count;
 
-				++m_Stats.draws;
+				if (meshletDraw)
+				{
+					uint32_t meshletDrawCount = lastDraw.firstMeshletDraw + lastDraw.meshletDrawCount - instanceDraw.firstMeshletDraw;
+					vkCmdDrawIndexedIndirect(cmd, passs.meshletDrawBuffer.buffer, instanceDraw.firstMeshletDraw * sizeof(GPUIndirectObject), meshletDrawCount, sizeof(GPUIndirectObject));
+					++m_Stats.draws;
+				}
+
+				//every lod of the multibatch in one call. Meshlet batches only draw their lower lods here, their lod 0 commands stay empty
+				uint32_t drawCount = lastDraw.firstDraw + lastDraw.drawCount - instanceDraw.firstDraw;
+				if (!meshletDraw || drawCount > multibatch.count)
+				{
+					if (lastObjectSet != objectDataSet)
+					{
+						lastObjectSet = objectDataSet;
+						vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, newLayout, 1, 1, &objectDataSet, 0, nullptr);
+					}
+					vkCmdDrawIndexedIndirect(cmd, passs.drawIndirectBuffer.buffer, instanceDraw.firstDraw * sizeof(GPUIndirectObject), drawCount, sizeof(GPUIndirectObject));
+					++m_Stats.draws;
+				}
 				m_Stats.drawcalls += instanceDraw.count;
 			}
 		}
@@ -406,6 +621,8 @@ void VulkanEngine::ExecuteComputeCull(VkCommandBuffer cmd, RenderScene::MeshPass
 	VkDescriptorBufferInfo instanceInfo = pass.passObjectsBuffer.GetInfo();
 	VkDescriptorBufferInfo finalInfo = pass.compactedInstanceBuffer.GetInfo();
 	VkDescriptorBufferInfo indirectInfo = pass.drawIndirectBuffer.GetInfo();
+	VkDescriptorBufferInfo instanceLodInfo = pass.instanceLodBuffer.GetInfo();
+	VkDescriptorBufferInfo lodErrorInfo = m_RenderScene.lodErrorBuffer.GetInfo();
 
 	VkDescriptorImageInfo depthPyramid;
 	depthPyramid.sampler = m_DepthSampler;
@@ -420,6 +637,8 @@ void VulkanEngine::ExecuteComputeCull(VkCommandBuffer cmd, RenderScene::MeshPass
 		.BindBuffer(3, &finalInfo, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT)
 		.BindImage(4, &depthPyramid, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_COMPUTE_BIT)
 		.BindBuffer(5, &dynamicInfo, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT)
+		.BindBuffer(6, &instanceLodInfo, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT)
+		.BindBuffer(7, &lodErrorInfo, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT)
 		.Build(computeObjectDataSet);
 
 	glm::mat4 projection = params.projMat;
@@ -438,13 +657,13 @@ void VulkanEngine::ExecuteComputeCull(VkCommandBuffer cmd, RenderScene::MeshPass
 	cullData.frustum[1] = frustumX.z;
 	cullData.frustum[2] = frustumY.y;
 	cullData.frustum[3] = frustumY.z;
-	cullData.lodBase = 10.f;
-	cullData.lodStep = 1.5f;
+	cullData.lodTargetError = CVAR_LodTargetError.GetFloat();
+	cullData.lodScreenHeight = (float)m_WindowExtent.height;
 	cullData.pyramidWidth = (float)m_DepthPyramidWidth;
 	cullData.pyramidHeight = (float)m_DepthPyramidHeight;
 	cullData.drawCount = (uint32_t)pass.flatRenderBatches.size();
 	cullData.cullingEnabled = params.frustrumCull;
-	cullData.lodEnabled = false;
+	cullData.lodEnabled = params.lod && CVAR_LodEnabled.Get();
 	cullData.occlusionEnabled = params.occlusionCull;
 	cullData.distanceCheck = params.drawDist <= 10000;
 	cullData.AABBCheck = params.aabb;
@@ -479,10 +698,74 @@ void VulkanEngine::ExecuteComputeCull(VkCommandBuffer cmd, RenderScene::MeshPass
 		uint32_t offset = GetCurrentFrame().debugDataOffsets.back();
 		VkBufferCopy debugCopy;
 		debugCopy.dstOffset = offset;
-		debugCopy.size = pass.indirectBatches.size() * sizeof(GPUIndirectObject);
+		debugCopy.size = pass.indirectDrawCount * sizeof(GPUIndirectObject);
 		debugCopy.srcOffset = 0;
 		vkCmdCopyBuffer(cmd, pass.drawIndirectBuffer.buffer, GetCurrentFrame().debugOutputBuffer.buffer, 1, &debugCopy);
 		GetCurrentFrame().debugDataOffsets.push_back(offset + (uint32_t)debugCopy.size);
 		GetCurrentFrame().debugDataNames.push_back("Cull Indirect Output");
 	}
+
+	if (pass.meshletInstances.size() > 0)
+	{
+		ExecuteMeshletCull(cmd, pass, params, cullData);
+	}
+}
+
+void VulkanEngine::ExecuteMeshletCull(VkCommandBuffer cmd, RenderScene::MeshPass& pass, CullParams& params, const DrawCullData& cullData)
+{
+	TracyVkZone(m_GraphicQueueContext, cmd, "Meshlet Cull Dispatch");
+
+	VkDescriptorBufferInfo objectBufferInfo = m_RenderScene.objectDataBuffer.GetInfo();
+	VkDescriptorBufferInfo meshletInfo = m_RenderScene.mergedMeshletBuffer.GetInfo();
+	VkDescriptorBufferInfo instanceInfo = pass.meshletInstanceBuffer.GetInfo();
+	VkDescriptorBufferInfo drawInfo = pass.meshletDrawBuffer.GetInfo();
+	VkDescriptorBufferInfo countInfo = pass.meshletCountBuffer.GetInfo();
+	VkDescriptorBufferInfo idInfo = pass.meshletObjectIdBuffer.GetInfo();
+	VkDescriptorBufferInfo instanceLodInfo = pass.instanceLodBuffer.GetInfo();
+
+	VkDescriptorImageInfo depthPyramid;
+	depthPyramid.sampler = m_DepthSampler;
+	depthPyramid.imageView = m_DepthPyramidImage.defaultView;
+	depthPyramid.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+	VkDescriptorSet meshletCullSet;
+	vkutil::DescriptorBuilder::Begin(m_DescritptorLayoutCache, GetCurrentFrame().dynamicDescriptorAllocator)
+		.BindBuffer(0, &objectBufferInfo, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT)
+		.BindBuffer(1, &meshletInfo, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT)
+		.BindBuffer(2, &instanceInfo, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT)
+		.BindBuffer(3, &drawInfo, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT)
+		.BindImage(4, &depthPyramid, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_COMPUTE_BIT)
+		.BindBuffer(5, &countInfo, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT)
+		.BindBuffer(6, &idInfo, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT)
+		.BindBuffer(7, &instanceLodInfo, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT)
+		.Build(meshletCullSet);
+
+	//meshlets of objects the object cull dropped or gave a lower lod are skipped
+	VkBufferMemoryBarrier lodBarrier = vkinit::buffer_barrier(pass.instanceLodBuffer.buffer, m_GraphicsQueueFamily);
+	lodBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	lodBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+	vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 1, &lodBarrier, 0, nullptr);
+
+	MeshletCullData meshletCullData;
+	meshletCullData.cullData = cullData;
+	meshletCullData.cullData.drawCount = (uint32_t)pass.meshletInstances.size();
+	meshletCullData.coneCullingEnabled = params.coneCull && CVAR_ConeCull.Get();
+
+	vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, m_MeshletCullPipeline);
+	vkCmdPushConstants(cmd, m_MeshletCullLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(MeshletCullData), &meshletCullData);
+	vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, m_MeshletCullLayout, 0, 1, &meshletCullSet, 0, nullptr);
+	vkCmdDispatch(cmd, static_cast<uint32_t>(pass.meshletInstances.size() / 256) + 1, 1, 1);
+
+	{
+		VkBufferMemoryBarrier barrier = vkinit::buffer_barrier(pass.meshletObjectIdBuffer.buffer, m_GraphicsQueueFamily);
+		barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+		barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+		m_PostCullBarriers.push_back(barrier);
+	}
+	{
+		VkBufferMemoryBarrier barrier = vkinit::buffer_barrier(pass.meshletDrawBuffer.buffer, m_GraphicsQueueFamily);
+		barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+		barrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT;
+		m_PostCullBarriers.push_back(barrier);
+	}
 }
@@ -1,10 +1,12 @@
 #include "vk_mesh.h"
 #include <tiny_obj_loader.h>
 #include <iostream>
+#include <algorithm>
 #include <glm/common.hpp>
 #include <glm/detail/func_geometric.inl>
 #include <asset_loader.h>
 #include <mesh_asset.h>
+#include <asset_threadpool.h>
 #include <logger.h>
 
 
@@ -107,8 +109,8 @@ void Vertex::PackColor(glm::vec3 c)
 
 bool Mesh::LoadFromMeshAsset(const char* filename)
 {
-	assets::AssetFile file;
-	bool loaded = assets::LoadBinaryFile(filename, file);
+	assets::AssetView file;
+	bool loaded = assets::LoadAssetView(filename, file);
 
 	if (!loaded)
 	{
@@ -116,75 +118,192 @@ bool Mesh::LoadFromMeshAsset(const char* filename)
 		return false;
 	}
 
-	assets::MeshInfo meshInfo = assets::ReadMeshInfo(&file);
+	return LoadFromMeshAsset(file, filename);
+}
 
-	std::vector<char> vertexBuffer;
-	std::vector<char> indexBuffer;
+bool Mesh::LoadFromMeshAsset(const assets::AssetView& file, const char* filename)
+{
+	assets::MeshInfo meshInfo = assets::ReadMeshInfo(file);
 
-	vertexBuffer.resize(meshInfo.vertexBufferSize);
-	indexBuffer.resize(meshInfo.indexBufferSize);
+	VkIndexType assetIndexType = AssetIndexType(meshInfo);
+	if (assetIndexType == VK_INDEX_TYPE_MAX_ENUM)
+	{
+		LOG_ERROR("Unknown index size in mesh {}", filename);
+		return false;
+	}
 
-	assets::UnpackMesh(&meshInfo, file.binaryBlob.data(), file.binaryBlob.size(), vertexBuffer.data(), indexBuffer.data());
+	vertexCount = AssetVertexCount(meshInfo);
+	indexCount = static_cast<uint32_t>(meshInfo.indexBufferSize / IndexTypeSize(assetIndexType));
+	indexType = VK_INDEX_TYPE_UINT32;
+
+	vertices.resize(vertexCount);
+	indices.resize(indexCount);
+
+	if (!DecodeMeshAsset(meshInfo, file, vertices.data(), indices.data()))
+	{
+		LOG_ERROR("Unknown vertex format in mesh {}", filename);
+		return false;
+	}
+
+	//16 bit indices land in the front half, widened back to front so none is overwritten before it is read
+	if (assetIndexType == VK_INDEX_TYPE_UINT16)
+	{
+		const char* narrowIndices = reinterpret_cast<const char*>(indices.data());
+		for (uint32_t i = indexCount; i-- > 0;)
+		{
+			uint16_t index;
+			memcpy(&index, narrowIndices + i * sizeof(uint16_t), sizeof(uint16_t));
+			indices[i] = index;
+		}
+	}
 
 	bounds.FromMeshBound(meshInfo.bounds);
+	meshlets = std::move(meshInfo.meshlets);
+	lods = std::move(meshInfo.lods);
 
-	vertices.clear();
-	indices.clear();
+	LOG_SUCCESS("Loaded mesh {} : Verts {}, tris = {}", filename, vertices.size(), indices.size() / 3);
+	return true;
+}
 
-	indices.resize(indexBuffer.size() / sizeof(uint32_t));
-	memcpy(indices.data(), indexBuffer.data(), indexBuffer.size());
-	/*for (int i = 0; i < indices.size(); ++i)
+uint32_t Mesh::AssetVertexCount(const assets::MeshInfo& meshInfo)
+{
+	switch (meshInfo.vertexFormat)
 	{
-		uint32_t* unpackedIndices = (uint32_t*)indexBuffer.data();
-		indices[i] = unpackedIndices[i];
-	}*/
+	case assets::VertexFormat::PNCV_F32:
+		return static_cast<uint32_t>(meshInfo.vertexBufferSize / sizeof(assets::Vertex_f32_PNCV));
+	case assets::VertexFormat::P32N8C8V16:
+		return static_cast<uint32_t>(meshInfo.vertexBufferSize / sizeof(assets::Vertex_P32N8C8V16));
+	case assets::VertexFormat::P32O8C8V32:
+		return static_cast<uint32_t>(meshInfo.vertexBufferSize / sizeof(assets::Vertex_P32O8C8V32));
+	default:
+		return 0;
+	}
+}
 
-	if (meshInfo.vertexFormat == assets::VertexFormat::PNCV_F32)
+VkIndexType Mesh::AssetIndexType(const assets::MeshInfo& meshInfo)
+{
+	switch (meshInfo.indexSize)
 	{
-		assets::Vertex_f32_PNCV* unpackedVertices = (assets::Vertex_f32_PNCV*)vertexBuffer.data();
-		vertices.resize(vertexBuffer.size() / sizeof(assets::Vertex_f32_PNCV));
+	case sizeof(uint16_t):
+		return VK_INDEX_TYPE_UINT16;
+	case sizeof(uint32_t):
+		return VK_INDEX_TYPE_UINT32;
+	default:
+		return VK_INDEX_TYPE_MAX_ENUM;
+	}
+}
+
+uint32_t Mesh::IndexTypeSize(VkIndexType indexType)
+{
+	return indexType == VK_INDEX_TYPE_UINT16 ? sizeof(uint16_t) : sizeof(uint32_t);
+}
+
+static void convert_vertex(const assets::Vertex_f32_PNCV& source, Vertex& vertex)
+{
+	vertex.position.x = source.position[0];
+	vertex.position.y = source.position[1];
+	vertex.position.z = source.position[2];
+
+	vertex.PackNormal(glm::vec3(source.normal[0], source.normal[1], source.normal[2]));
+	vertex.PackColor(glm::vec3(source.color[0], source.color[1], source.color[2]));
+
+	vertex.uv.x = source.uv[0];
+	vertex.uv.y = source.uv[1];
+}
 
-		for (int i = 0; i < vertices.size(); ++i)
+static void convert_vertex(const assets::Vertex_P32N8C8V16& source, Vertex& vertex)
+{
+	vertex.position.x = source.position[0];
+	vertex.position.y = source.position[1];
+	vertex.position.z = source.position[2];
+
+	//same octahedral encoding as the engine vertex, alpha has no slot in it
+	vertex.octNormal.x = source.octNormal[0];
+	vertex.octNormal.y = source.octNormal[1];
+	vertex.color.x = source.color[0];
+	vertex.color.y = source.color[1];
+	vertex.color.z = source.color[2];
+
+	vertex.uv.x = assets::half_to_float(source.uv[0]);
+	vertex.uv.y = assets::half_to_float(source.uv[1]);
+}
+
+template<typename V>
+static void convert_vertices(const char* source, Vertex* destination, uint32_t count)
+{
+	//split in ranges big enough that the pool overhead doesnt matter
+	constexpr uint32_t rangeSize = 16384;
+	size_t rangeCount = (count + rangeSize - 1) / rangeSize;
+
+	const V* unpackedVertices = reinterpret_cast<const V*>(source);
+	assets::GetDecodeThreadPool().ParallelFor(rangeCount, [&](size_t range) {
+		uint32_t first = static_cast<uint32_t>(range) * rangeSize;
+		uint32_t last = std::min(first + rangeSize, count);
+		for (uint32_t i = first; i < last; ++i)
 		{
-			vertices[i].position.x = unpackedVertices[i].position[0];
-			vertices[i].position.y = unpackedVertices[i].position[1];
-			vertices[i].position.z = unpackedVertices[i].position[2];
-
-			vertices[i].PackNormal(glm::vec3(unpackedVertices[i].normal[0], 
-				unpackedVertices[i].normal[1], 
-				unpackedVertices[i].normal[2]));
-			vertices[i].PackColor(glm::vec3(unpackedVertices[i].color[0],
-				unpackedVertices[i].color[1],
-				unpackedVertices[i].color[2]));
-
-			vertices[i].uv.x = unpackedVertices[i].uv[0];
-			vertices[i].uv.y = unpackedVertices[i].uv[1];
+			convert_vertex(unpackedVertices[i], destination[i]);
 		}
+	});
+}
+
+bool Mesh::DecodeMeshAsset(assets::MeshInfo& meshInfo, const assets::AssetView& file, Vertex* vertexDestination, void* indexDestination, const char* decodedBlob)
+{
+	uint32_t count = AssetVertexCount(meshInfo);
+	if (count == 0 && meshInfo.vertexBufferSize != 0)
+	{
+		return false;
 	}
-	else if (meshInfo.vertexFormat == assets::VertexFormat::P32N8C8V16)
+
+	//the runtime layout needs no conversion, uncompressed blobs are a plain copy out of the mapped file
+	if (meshInfo.vertexFormat == assets::VertexFormat::P32O8C8V32)
+	{
+		if (decodedBlob)
+		{
+			memcpy(vertexDestination, decodedBlob, meshInfo.vertexBufferSize);
+			memcpy(indexDestination, decodedBlob + meshInfo.vertexBufferSize, meshInfo.indexBufferSize);
+		}
+		else
+		{
+			return assets::UnpackMesh(&meshInfo, file.binaryBlob.data(), file.binaryBlob.size(), (char*)vertexDestination, (char*)indexDestination);
+		}
+		return true;
+	}
+
+	const char* sourceVertices = decodedBlob;
+	std::vector<char> scratch;
+	if (!decodedBlob)
 	{
-		assets::Vertex_P32N8C8V16* unpackedVertices = (assets::Vertex_P32N8C8V16*)vertexBuffer.data();
-		vertices.resize(vertexBuffer.size() / sizeof(assets::Vertex_P32N8C8V16));
+		//the asset vertices need converting so they go through scratch memory, indices are decoded in place.
+		//single block blobs can only be decoded as a whole, so there the scratch also holds the indices
+		bool singleBlock = meshInfo.compressionMode == assets::CompressionMode::LZ4 && meshInfo.chunkSize == 0;
+
+		scratch.resize(meshInfo.vertexBufferSize + (singleBlock ? meshInfo.indexBufferSize : 0));
+		char* indexTarget = singleBlock ? scratch.data() + meshInfo.vertexBufferSize : (char*)indexDestination;
+
+		if (!assets::UnpackMesh(&meshInfo, file.binaryBlob.data(), file.binaryBlob.size(), scratch.data(), indexTarget))
+		{
+			return false;
+		}
 
-		for (int i = 0; i < vertices.size(); ++i)
+		if (singleBlock && meshInfo.indexBufferSize > 0)
 		{
-			vertices[i].position.x = unpackedVertices[i].position[0];
-			vertices[i].position.y = unpackedVertices[i].position[1];
-			vertices[i].position.z = unpackedVertices[i].position[2];
-
-			vertices[i].PackNormal(glm::vec3(unpackedVertices[i].normal[0],
-				unpackedVertices[i].normal[1],
-				unpackedVertices[i].normal[2]));
-			vertices[i].color.x = unpackedVertices[i].color[0];
-			vertices[i].color.y = unpackedVertices[i].color[1];
-			vertices[i].color.z = unpackedVertices[i].color[2];
-
-			vertices[i].uv.x = unpackedVertices[i].uv[0];
-			vertices[i].uv.y = unpackedVertices[i].uv[1];
+			memcpy(indexDestination, indexTarget, meshInfo.indexBufferSize);
 		}
+		sourceVertices = scratch.data();
+	}
+	else if (meshInfo.indexBufferSize > 0)
+	{
+		memcpy(indexDestination, decodedBlob + meshInfo.vertexBufferSize, meshInfo.indexBufferSize);
+	}
+
+	if (meshInfo.vertexFormat == assets::VertexFormat::PNCV_F32)
+	{
+		convert_vertices<assets::Vertex_f32_PNCV>(sourceVertices, vertexDestination, count);
+	}
+	else if (meshInfo.vertexFormat == assets::VertexFormat::P32N8C8V16)
+	{
+		convert_vertices<assets::Vertex_P32N8C8V16>(sourceVertices, vertexDestination, count);
 	}
-	
-	LOG_SUCCESS("Loaded mesh {} : Verts {}, tris = {}", filename, vertices.size(), indices.size() / 3);
 	return true;
 }
 
@@ -25,6 +25,12 @@ struct Vertex {
 	void PackColor(glm::vec3 c);
 };
 
+//meshes baked in the runtime layout are copied into the vertex buffer as they are
+static_assert(sizeof(Vertex) == sizeof(assets::Vertex_P32O8C8V32), "runtime vertex layout out of sync with assetlib");
+static_assert(offsetof(Vertex, octNormal) == offsetof(assets::Vertex_P32O8C8V32, octNormal), "runtime vertex layout out of sync with assetlib");
+static_assert(offsetof(Vertex, color) == offsetof(assets::Vertex_P32O8C8V32, color), "runtime vertex layout out of sync with assetlib");
+static_assert(offsetof(Vertex, uv) == offsetof(assets::Vertex_P32O8C8V32, uv), "runtime vertex layout out of sync with assetlib");
+
 struct RenderBounds {
 	glm::vec3 origin;
 	float radius;
@@ -35,13 +41,38 @@ struct RenderBounds {
 };
 
 struct Mesh {
+	//cpu side copies, only kept for meshes built in code. Meshes decoded into their buffers leave these empty
 	std::vector<Vertex> vertices;
 	std::vector<uint32_t> indices;
 
+	uint32_t vertexCount{ 0 };
+	uint32_t indexCount{ 0 };
+
+	//baked meshes with up to 65536 vertices use 16 bit indices, the cpu side indices are always 32 bit
+	VkIndexType indexType{ VK_INDEX_TYPE_UINT32 };
+
 	AllocatedBuffer<Vertex> vertexBuffer;
-	AllocatedBuffer<uint32_t> indexBuffer;
+	AllocatedBufferUntyped indexBuffer;
 
 	RenderBounds bounds;
 
+	//contiguous index ranges with their own bounds and normal cone, empty for meshes built in code and older assets
+	std::vector<assets::Meshlet> meshlets;
+
+	//index ranges of every level of detail, lod 0 first. Empty when the mesh only has the one in indexCount
+	std::vector<assets::MeshLod> lods;
+
 	bool LoadFromMeshAsset(const char* filename);
+	bool LoadFromMeshAsset(const assets::AssetView& file, const char* filename);
+
+	//decodes the asset in one pass into caller memory, usually a mapped staging buffer.
+	//vertexDestination must hold vertexBufferSize / sizeof of the asset vertex format elements, indexDestination indexBufferSize bytes in the asset index type.
+	//decodedBlob skips the decompression when it already happened elsewhere, like on the async loader
+	static bool DecodeMeshAsset(assets::MeshInfo& meshInfo, const assets::AssetView& file, Vertex* vertexDestination, void* indexDestination, const char* decodedBlob = nullptr);
+
+	static uint32_t AssetVertexCount(const assets::MeshInfo& meshInfo);
+
+	//VK_INDEX_TYPE_MAX_ENUM when the asset index size is not 2 or 4
+	static VkIndexType AssetIndexType(const assets::MeshInfo& meshInfo);
+	static uint32_t IndexTypeSize(VkIndexType indexType);
 };
\ No newline at end of file
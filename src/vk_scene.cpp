@@ -103,13 +103,19 @@ void RenderScene::FillIndirectArray(GPUIndirectObject* data, MeshPass& pass)
     {
         auto batch = pass.indirectBatches[i];
 
-        data[i].command.firstInstance = batch.first;
-        data[i].command.instanceCount = 0;
-        data[i].command.firstIndex = GetMesh(batch.meshId)->firstIndex;
-        data[i].command.vertexOffset = GetMesh(batch.meshId)->firstVertex;
-        data[i].command.indexCount = GetMesh(batch.meshId)->indexCount;
-        data[i].objectId = 0;
-        data[i].batchId = i;
+        for (uint32_t lod = 0; lod < batch.drawCount; ++lod)
+        {
+            DrawMesh* mesh = GetMesh(Handle<DrawMesh>{ batch.meshId.handle + lod });
+            GPUIndirectObject& draw = data[batch.firstDraw + lod];
+
+            draw.command.firstInstance = batch.firstInstance + lod * batch.count;
+            draw.command.instanceCount = 0;
+            draw.command.firstIndex = mesh->firstIndex;
+            draw.command.vertexOffset = mesh->firstVertex;
+            draw.command.indexCount = mesh->indexCount;
+            draw.objectId = 0;
+            draw.batchId = i;
+        }
     }
 }
 
@@ -121,10 +127,20 @@ void RenderScene::FillInstancesArray(GPUInstance* data, MeshPass& pass)
     {
         auto batch = pass.indirectBatches[i];
 
+        //lod errors only exist on the gpu once the meshes are merged
+        DrawMesh* mesh = GetMesh(batch.meshId);
+        uint32_t lodCount = mesh->isMerged ? batch.drawCount : 1;
+        if (batch.meshletDrawCount > 0)
+        {
+            lodCount |= kInstanceMeshletLod0;
+        }
+
         for (uint32_t b = 0; b < batch.count; ++b)
         {
             data[dataIndex].objectId = pass.Get(pass.flatRenderBatches[b + batch.first].object)->originalObjectId.handle;
-            data[dataIndex].batchId = i;
+            data[dataIndex].batchId = batch.firstDraw;
+            data[dataIndex].firstLod = batch.meshId.handle;
+            data[dataIndex].lodCount = lodCount;
             ++dataIndex;
         }
     }
@@ -171,25 +187,96 @@ void RenderScene::MergeMeshes(VulkanEngine* engine)
     ZoneScopedNC("Mesh Merge", tracy::Color::Magenta);
     size_t totalVertices = 0;
     size_t totalIndices = 0;
+    size_t totalIndices16 = 0;
+    size_t totalMeshlets = 0;
 
+    DrawMesh* lod0 = nullptr;
     for (auto& mesh : meshes)
     {
-        mesh.firstIndex = static_cast<uint32_t>(totalIndices);
+        //lower lods are ranges of the index buffer that lod 0 already copies whole
+        if (mesh.lodLevel > 0)
+        {
+            uint32_t lodLevel = mesh.lodLevel;
+            mesh.firstIndex = lod0->firstIndex + mesh.original->lods[lodLevel].firstIndex;
+            mesh.firstVertex = lod0->firstVertex;
+            mesh.firstMeshlet = 0;
+            mesh.meshletCount = 0;
+            mesh.isMerged = true;
+            continue;
+        }
+        lod0 = &mesh;
+
+        //the vertices are shared, the indices stay relative to the mesh so 16 bit ones still fit
+        size_t& indexTotal = mesh.indexType == VK_INDEX_TYPE_UINT16 ? totalIndices16 : totalIndices;
+
+        mesh.firstIndex = static_cast<uint32_t>(indexTotal);
         mesh.firstVertex = static_cast<uint32_t>(totalVertices);
 
         totalVertices += mesh.vertexCount;
-        totalIndices += mesh.indexCount;
+        indexTotal += mesh.original->indexCount;
+
+        mesh.firstMeshlet = static_cast<uint32_t>(totalMeshlets);
+        mesh.meshletCount = static_cast<uint32_t>(mesh.original->meshlets.size());
+        totalMeshlets += mesh.meshletCount;
 
         mesh.isMerged = true;
     }
 
+    //meshlets are small and only read by the cull shader, so they stay in host visible memory
+    if (totalMeshlets > 0)
+    {
+        mergedMeshletBuffer = engine->CreateBuffer(totalMeshlets * sizeof(GPUMeshlet), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VMA_MEMORY_USAGE_CPU_TO_GPU);
+        GPUMeshlet* meshletData = engine->MapBuffer(mergedMeshletBuffer);
+        for (auto& mesh : meshes)
+        {
+            for (uint32_t i = 0; i < mesh.meshletCount; ++i)
+            {
+                const assets::Meshlet& meshlet = mesh.original->meshlets[i];
+                GPUMeshlet& target = meshletData[mesh.firstMeshlet + i];
+                target.centerRadius = glm::vec4(meshlet.center[0], meshlet.center[1], meshlet.center[2], meshlet.radius);
+                target.coneAxisCutoff = glm::vec4(meshlet.coneAxis[0], meshlet.coneAxis[1], meshlet.coneAxis[2], meshlet.coneCutoff);
+                target.firstIndex = mesh.firstIndex + meshlet.firstIndex;
+                target.indexCount = meshlet.indexCount;
+                target.vertexOffset = static_cast<int32_t>(mesh.firstVertex);
+                target.padding = 0;
+            }
+        }
+        engine->UnmapBuffer(mergedMeshletBuffer);
+    }
+
+    lodErrorBuffer = engine->CreateBuffer(meshes.size() * sizeof(float), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VMA_MEMORY_USAGE_CPU_TO_GPU);
+    float* lodErrors = engine->MapBuffer(lodErrorBuffer);
+    for (size_t i = 0; i < meshes.size(); ++i)
+    {
+        lodErrors[i] = meshes[i].lodError;
+    }
+    engine->UnmapBuffer(lodErrorBuffer);
+
+    //the batches built before the merge drew every mesh whole
+    for (int i = 0; i < (int)MeshpassType::Count; ++i)
+    {
+        m_Passes[(MeshpassType)i].needsMeshletRebuild = true;
+    }
+
     mergedVertexBuffer = engine->CreateBuffer(totalVertices * sizeof(Vertex), VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VMA_MEMORY_USAGE_GPU_ONLY);
-    mergedIndexBuffer = engine->CreateBuffer(totalIndices * sizeof(uint32_t), VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT, VMA_MEMORY_USAGE_GPU_ONLY);
+    if (totalIndices > 0)
+    {
+        mergedIndexBuffer = engine->CreateBuffer(totalIndices * sizeof(uint32_t), VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT, VMA_MEMORY_USAGE_GPU_ONLY);
+    }
+    if (totalIndices16 > 0)
+    {
+        mergedIndexBuffer16 = engine->CreateBuffer(totalIndices16 * sizeof(uint16_t), VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT, VMA_MEMORY_USAGE_GPU_ONLY);
+    }
 
     engine->ImmediateSubmit([&](VkCommandBuffer cmd)
         {
             for (auto& mesh : meshes)
             {
+                if (mesh.lodLevel > 0)
+                {
+                    continue;
+                }
+
                 VkBufferCopy vertexCopy;
                 vertexCopy.dstOffset = mesh.firstVertex * sizeof(Vertex);
                 vertexCopy.size = mesh.vertexCount * sizeof(Vertex);
@@ -197,12 +284,20 @@ void RenderScene::MergeMeshes(VulkanEngine* engine)
 
                 vkCmdCopyBuffer(cmd, mesh.original->vertexBuffer.buffer, mergedVertexBuffer.buffer, 1, &vertexCopy);
 
+                if (mesh.original->indexCount == 0)
+                {
+                    continue;
+                }
+
+                uint32_t indexSize = Mesh::IndexTypeSize(mesh.indexType);
+                VkBuffer indexTarget = mesh.indexType == VK_INDEX_TYPE_UINT16 ? mergedIndexBuffer16.buffer : mergedIndexBuffer.buffer;
+
                 VkBufferCopy indexCopy;
-                indexCopy.dstOffset = mesh.firstIndex * sizeof(uint32_t);
-                indexCopy.size = mesh.indexCount * sizeof(uint32_t);
+                indexCopy.dstOffset = mesh.firstIndex * indexSize;
+                indexCopy.size = mesh.original->indexCount * indexSize;
                 indexCopy.srcOffset = 0;
 
-                vkCmdCopyBuffer(cmd, mesh.original->indexBuffer.buffer, mergedIndexBuffer.buffer, 1, &indexCopy);
+                vkCmdCopyBuffer(cmd, mesh.original->indexBuffer.buffer, indexTarget, 1, &indexCopy);
             }
         }
     );
@@ -212,6 +307,10 @@ void RenderScene::RefreshPass(MeshPass* pass)
 {
     pass->needsIndirectRefresh = true;
     pass->needsInstanceRefresh = true;
+    if (pass->passObjectsToDelete.size() > 0 || pass->unbatchedRenderObjectIds.size() > 0)
+    {
+        pass->needsMeshletRebuild = true;
+    }
 
     std::vector<uint32_t> newObjectIndices;
     auto cmpRenderBatch = [](const RenderScene::RenderBatch& a, const RenderScene::RenderBatch& b)
@@ -222,13 +321,16 @@ void RenderScene::RefreshPass(MeshPass* pass)
         }
         return a.sortKey < b.sortKey;
     };
-    auto calcPassObjectHash = [](const RenderScene::PassObject& obj)
+    auto calcPassObjectHash = [this](const RenderScene::PassObject& obj)
     {
         uint64_t pipelineHash = std::hash<uint64_t>()(uint64_t(obj.material.shaderPass->pipeline));
         uint64_t setHash = std::hash<uint64_t>()((uint64_t)obj.material.materialSet);
 
         uint32_t matHash = static_cast<uint32_t>(pipelineHash ^ setHash);
-        uint32_t meshMatHash = uint64_t(matHash) ^ uint64_t(obj.meshId.handle);
+
+        //top bit is the index type, so 16 and 32 bit meshes dont interleave and split the multibatches at every switch
+        uint32_t indexTypeBit = GetMesh(obj.meshId)->indexType == VK_INDEX_TYPE_UINT16 ? 0x80000000u : 0u;
+        uint32_t meshMatHash = ((matHash ^ obj.meshId.handle) & 0x7fffffffu) | indexTypeBit;
 
         return uint64_t(meshMatHash) | (uint64_t(obj.customKey) << 32);
     };
@@ -356,6 +458,9 @@ void RenderScene::RefreshPass(MeshPass* pass)
         pass->indirectBatches.clear();
         BuildIndirectBatches(pass, pass->indirectBatches, pass->flatRenderBatches);
 
+        AssignDrawSlots(pass);
+        BuildMeshletInstances(pass);
+
         pass->multibatches.clear();
 
         if (pass->indirectBatches.size() > 0)
@@ -369,7 +474,13 @@ void RenderScene::RefreshPass(MeshPass* pass)
                 IndirectBatch* joinBatch = &pass->indirectBatches[newMultibatch.first];
                 IndirectBatch* batch = &pass->indirectBatches[i];
 
-                bool bCompatibleMesh = joinBatch->meshId == batch->meshId || (GetMesh(joinBatch->meshId)->isMerged && GetMesh(batch->meshId)->isMerged);
+                DrawMesh* joinMesh = GetMesh(joinBatch->meshId);
+                DrawMesh* batchMesh = GetMesh(batch->meshId);
+
+                //merged meshes share the vertex buffer, but only the ones with the same index type share an index buffer.
+                //meshlet batches draw out of their own indirect buffer
+                bool bCompatibleMesh = joinBatch->meshId == batch->meshId || (joinMesh->isMerged && batchMesh->isMerged && joinMesh->indexType == batchMesh->indexType);
+                bCompatibleMesh = bCompatibleMesh && UsesMeshlets(joinMesh) == UsesMeshlets(batchMesh);
                 bool bSameMat = joinBatch->material.materialSet == batch->material.materialSet && joinBatch->material.shaderPass == batch->material.shaderPass;
 
                 if (bCompatibleMesh && bSameMat)
@@ -420,7 +531,7 @@ void RenderScene::BuildIndirectBatches(MeshPass* pass, std::vector<IndirectBatch
         else
         {
             newBatch.first = i;
-            newBatch.count = i;
+            newBatch.count = 1;
             newBatch.material = obj->material;
             newBatch.meshId = obj->meshId;
 
@@ -430,6 +541,75 @@ void RenderScene::BuildIndirectBatches(MeshPass* pass, std::vector<IndirectBatch
     }
 }
 
+void RenderScene::AssignDrawSlots(MeshPass* pass)
+{
+    uint32_t draws = 0;
+    uint32_t instances = 0;
+    for (auto& batch : pass->indirectBatches)
+    {
+        batch.firstDraw = draws;
+        batch.drawCount = GetMesh(batch.meshId)->lodCount;
+        batch.firstInstance = instances;
+
+        //any lod can end up with every instance of the batch
+        draws += batch.drawCount;
+        instances += batch.drawCount * batch.count;
+    }
+    pass->indirectDrawCount = draws;
+    pass->instanceSlotCount = instances;
+}
+
+void RenderScene::BuildMeshletInstances(MeshPass* pass)
+{
+    ZoneScopedNC("Build Meshlet Instances", tracy::Color::Blue);
+
+    //slot ranges follow the batches, which are rebuilt every refresh
+    uint32_t meshletDraws = 0;
+    for (auto& batch : pass->indirectBatches)
+    {
+        DrawMesh* mesh = GetMesh(batch.meshId);
+        batch.firstMeshletDraw = meshletDraws;
+        batch.meshletDrawCount = UsesMeshlets(mesh) ? batch.count * mesh->meshletCount : 0;
+        meshletDraws += batch.meshletDrawCount;
+    }
+    pass->meshletDrawCount = meshletDraws;
+
+    if (!pass->needsMeshletRebuild)
+    {
+        return;
+    }
+
+    pass->meshletInstances.clear();
+    pass->meshletInstances.reserve(meshletDraws);
+    for (uint32_t i = 0; i < pass->indirectBatches.size(); ++i)
+    {
+        IndirectBatch& batch = pass->indirectBatches[i];
+        if (batch.meshletDrawCount == 0)
+        {
+            continue;
+        }
+
+        DrawMesh* mesh = GetMesh(batch.meshId);
+        for (uint32_t b = 0; b < batch.count; ++b)
+        {
+            uint32_t objectId = pass->Get(pass->flatRenderBatches[batch.first + b].object)->originalObjectId.handle;
+            for (uint32_t m = 0; m < mesh->meshletCount; ++m)
+            {
+                GPUMeshletInstance instance;
+                instance.objectId = objectId;
+                instance.meshletId = mesh->firstMeshlet + m;
+                instance.batchId = i;
+                instance.firstDraw = batch.firstMeshletDraw;
+                instance.instanceId = batch.first + b;
+                pass->meshletInstances.push_back(instance);
+            }
+        }
+    }
+
+    pass->needsMeshletRebuild = false;
+    pass->needsMeshletRefresh = true;
+}
+
 RenderObject* RenderScene::GetObject(Handle<RenderObject> objectId)
 {
     return &renderables[objectId.handle];
@@ -440,6 +620,11 @@ DrawMesh* RenderScene::GetMesh(Handle<DrawMesh> objectId)
     return &meshes[objectId.handle];
 }
 
+bool RenderScene::UsesMeshlets(const DrawMesh* mesh) const
+{
+    return mesh->isMerged && mesh->meshletCount > 1;
+}
+
 vkutil::Material* RenderScene::GetMaterial(Handle<vkutil::Material> id)
 {
     return materials[id.handle];
@@ -475,15 +660,38 @@ Handle<DrawMesh> RenderScene::GetMeshHandle(Mesh* m)
     auto it = meshConvert.find(m);
     if (it == meshConvert.end())
     {
-        uint32_t index = static_cast<uint32_t>(materials.size());
+        uint32_t index = static_cast<uint32_t>(meshes.size());
         DrawMesh drawMesh;
         drawMesh.original = m;
         drawMesh.firstIndex = 0;
         drawMesh.firstVertex = 0;
-        drawMesh.vertexCount = static_cast<uint32_t>(m->vertices.size());
-        drawMesh.indexCount = static_cast<uint32_t>(m->indices.size());
-
-        meshes.push_back(drawMesh);
+        drawMesh.vertexCount = m->vertexCount;
+        drawMesh.indexCount = m->indexCount;
+        drawMesh.indexType = m->indexType;
+        drawMesh.isMerged = false;
+        drawMesh.firstMeshlet = 0;
+        drawMesh.meshletCount = 0;
+        drawMesh.lodLevel = 0;
+        drawMesh.lodCount = 1;
+        drawMesh.lodError = 0.f;
+
+        if (m->lods.empty())
+        {
+            meshes.push_back(drawMesh);
+        }
+        else
+        {
+            //objects only ever point at lod 0, the cull shaders find the others next to it
+            drawMesh.lodCount = static_cast<uint32_t>(m->lods.size());
+            for (uint32_t i = 0; i < drawMesh.lodCount; ++i)
+            {
+                drawMesh.lodLevel = i;
+                drawMesh.firstIndex = m->lods[i].firstIndex;
+                drawMesh.indexCount = m->lods[i].indexCount;
+                drawMesh.lodError = m->lods[i].error;
+                meshes.push_back(drawMesh);
+            }
+        }
 
         handle.handle = index;
         meshConvert[m] = handle;
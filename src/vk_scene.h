@@ -24,16 +24,49 @@ struct DrawMesh {
 	uint32_t firstIndex;
 	uint32_t indexCount;
 	uint32_t vertexCount;
+	//merged meshes index into the merged buffer of their index type
+	VkIndexType indexType;
 	bool isMerged;
 
+	//range of the merged meshlet buffer, only set once merged
+	uint32_t firstMeshlet;
+	uint32_t meshletCount;
+
+	//every level of detail is its own mesh, registered right after lod 0. They share the vertices and index buffer of lod 0
+	uint32_t lodLevel;
+	uint32_t lodCount;
+	float lodError;
+
 	Mesh* original;
 };
 
-struct GPUInstance {
+struct GPUMeshlet {
+	glm::vec4 centerRadius;
+	glm::vec4 coneAxisCutoff;
+	uint32_t firstIndex;	//into the merged index buffer of the mesh index type
+	uint32_t indexCount;
+	int32_t vertexOffset;
+	uint32_t padding;
+};
+
+//one meshlet of one object, culled by its own thread in meshlet_cull.comp
+struct GPUMeshletInstance {
 	uint32_t objectId;
+	uint32_t meshletId;
 	uint32_t batchId;
+	uint32_t firstDraw;	//draw slots of the batch, visible meshlets are packed at the front
+	uint32_t instanceId;	//of the object in the pass, the object cull writes its lod there
+};
+
+struct GPUInstance {
+	uint32_t objectId;
+	uint32_t batchId;	//draw of lod 0, lod i is drawn by batchId + i
+	uint32_t firstLod;	//lod errors of the mesh in the scene lod buffer
+	uint32_t lodCount;	//or'd with kInstanceMeshletLod0 when meshlets draw lod 0
 };
 
+constexpr uint32_t kInstanceMeshletLod0 = 0x80000000u;
+
 struct GPUIndirectObject {
 	VkDrawIndexedIndirectCommand command;
 	uint32_t objectId;
@@ -71,6 +104,15 @@ public:
 		PassMaterial material;
 		uint32_t first;
 		uint32_t count;
+
+		//slots in the meshlet draw buffer, count * meshlets of the mesh. 0 when the batch is drawn per object
+		uint32_t firstMeshletDraw;
+		uint32_t meshletDrawCount;
+
+		//one draw command per lod of the mesh, each with count instance slots starting at firstInstance + lod * count
+		uint32_t firstDraw;
+		uint32_t drawCount;
+		uint32_t firstInstance;
 	};
 	struct PassObject {
 		PassMaterial material;
@@ -109,12 +151,33 @@ public:
 		AllocatedBuffer<GPUIndirectObject> drawIndirectBuffer;
 		AllocatedBuffer<GPUIndirectObject> clearIndirectBuffer;
 
+		//draw commands and instance slots of all the batches, larger than the batch and object counts when meshes have lods
+		uint32_t indirectDrawCount = 0;
+		uint32_t instanceSlotCount = 0;
+
+		//lod the object cull picked for every instance, ~0 when it was culled
+		AllocatedBuffer<uint32_t> instanceLodBuffer;
+
+		//every meshlet of every object in a meshlet batch, rebuilt only when objects are added or removed
+		std::vector<GPUMeshletInstance> meshletInstances;
+		uint32_t meshletDrawCount = 0;
+
+		AllocatedBuffer<GPUMeshletInstance> meshletInstanceBuffer;
+		//one draw per meshlet slot, the ones left empty are zero and draw nothing
+		AllocatedBuffer<GPUIndirectObject> meshletDrawBuffer;
+		//visible meshlets per indirect batch
+		AllocatedBuffer<uint32_t> meshletCountBuffer;
+		//object of every meshlet draw, read through gl_InstanceIndex like compactedInstanceBuffer
+		AllocatedBuffer<uint32_t> meshletObjectIdBuffer;
+
 		PassObject* Get(Handle<PassObject> handle);
 
 		MeshpassType type;
 
 		bool needsIndirectRefresh = true;
 		bool needsInstanceRefresh = true;
+		bool needsMeshletRebuild = true;
+		bool needsMeshletRefresh = true;
 	};
 
 	void Init();
@@ -141,8 +204,17 @@ public:
 	void RefreshPass(MeshPass* pass);
 
 	void BuildIndirectBatches(MeshPass* pass, std::vector<IndirectBatch>& outBatches, std::vector<RenderScene::RenderBatch>& inObjects);
+
+	//gives every batch a draw command per lod and the instance slots for them
+	void AssignDrawSlots(MeshPass* pass);
+
+	//assigns the meshlet draw slots of every batch and lists the meshlets of their objects for the cull shader
+	void BuildMeshletInstances(MeshPass* pass);
 	RenderObject* GetObject(Handle<RenderObject> objectId);
 	DrawMesh* GetMesh(Handle<DrawMesh> objectId);
+
+	//meshes with a single meshlet gain nothing over the object cull
+	bool UsesMeshlets(const DrawMesh* mesh) const;
 	vkutil::Material* GetMaterial(Handle<vkutil::Material> id);
 
 	std::vector<RenderObject> renderables;
@@ -163,6 +235,10 @@ public:
 
 	AllocatedBuffer<Vertex> mergedVertexBuffer;
 	AllocatedBuffer<uint32_t> mergedIndexBuffer;
+	AllocatedBuffer<uint16_t> mergedIndexBuffer16;
+	AllocatedBuffer<GPUMeshlet> mergedMeshletBuffer;
+	//error of every mesh, indexed by mesh handle
+	AllocatedBuffer<float> lodErrorBuffer;
 
 	AllocatedBuffer<GPUObjectData> objectDataBuffer;
 };
\ No newline at end of file
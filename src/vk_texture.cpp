@@ -1,5 +1,6 @@
 #include "vk_texture.h"
 #include <iostream>
+#include <algorithm>
 #include <vk_initializers.h>
 #include <texture_asset.h>
 #include <Tracy.hpp>
@@ -44,15 +45,20 @@ bool vkutil::LoadImageFromFile(VulkanEngine& engine, const char* file, Allocated
 
 bool vkutil::LoadImageFromAsset(VulkanEngine& engine, const char* filename, AllocatedImage& outImage)
 {
-	assets::AssetFile file;
-	bool loaded = assets::LoadBinaryFile(filename, file);
+	assets::AssetView file;
+	bool loaded = assets::LoadAssetView(filename, file);
 	if (!loaded)
 	{
 		LOG_ERROR("Erroe when loading texture {}", filename);
 		return false;
 	}
 
-	assets::TextureInfo textureInfo = assets::ReadTextureInfo(&file);
+	return LoadImageFromAsset(engine, file, filename, outImage);
+}
+
+bool vkutil::LoadImageFromAsset(VulkanEngine& engine, const assets::AssetView& file, const char* filename, AllocatedImage& outImage, const char* decodedPages)
+{
+	assets::TextureInfo textureInfo = assets::ReadTextureInfo(file);
 
 	VkDeviceSize imageSize = textureInfo.textureSize;
 	VkFormat format;
@@ -61,28 +67,68 @@ bool vkutil::LoadImageFromAsset(VulkanEngine& engine, const char* filename, Allo
 	case assets::TextureFormat::RGBA8:
 			format = VK_FORMAT_R8G8B8A8_UNORM;
 			break;
+	case assets::TextureFormat::BC1:
+		format = VK_FORMAT_BC1_RGBA_UNORM_BLOCK;
+		break;
+	case assets::TextureFormat::BC3:
+		format = VK_FORMAT_BC3_UNORM_BLOCK;
+		break;
+	case assets::TextureFormat::BC4:
+		format = VK_FORMAT_BC4_UNORM_BLOCK;
+		break;
+	case assets::TextureFormat::BC5:
+		format = VK_FORMAT_BC5_UNORM_BLOCK;
+		break;
+	case assets::TextureFormat::BC7:
+		format = VK_FORMAT_BC7_UNORM_BLOCK;
+		break;
 	default:
 		LOG_ERROR("Error when read texture format {}", filename);
 		return false;
 		break;
 	}
 
+	if (textureInfo.pages.empty())
+	{
+		LOG_ERROR("Error when read texture pages {}", filename);
+		return false;
+	}
+
 	AllocatedBufferUntyped stagingBuffer = engine.CreateBuffer(imageSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VMA_MEMORY_USAGE_CPU_ONLY);
 
 	void* data = engine.MapBuffer(stagingBuffer);
 
 	std::vector<MipmapInfo> mips;
+	std::vector<size_t> mipOffsets;
 	size_t offset = 0;
 	for (int i = 0; i < textureInfo.pages.size(); ++i)
 	{
-		ZoneScopedNC("Unpack Texture", tracy::Color::Magenta);
 		MipmapInfo mip{ textureInfo.pages[i].originalSize, offset };
 		mips.push_back(mip);
-		assets::unpack_texture_page(&textureInfo, i, file.binaryBlob.data(), (char*)data + offset);
+		mipOffsets.push_back(offset);
 		offset += mip.dataSize;
 	}
+
+	bool unpacked = true;
+	if (decodedPages)
+	{
+		//decoded pages are already laid out like the mips
+		memcpy(data, decodedPages, offset);
+	}
+	else
+	{
+		ZoneScopedNC("Unpack Texture", tracy::Color::Magenta);
+		unpacked = assets::unpack_texture_pages_parallel(&textureInfo, file.binaryBlob.data(), file.binaryBlob.size(), (char*)data, mipOffsets);
+	}
 	engine.UnmapBuffer(stagingBuffer);
 
+	if (!unpacked)
+	{
+		LOG_ERROR("Error when unpacking texture {}", filename);
+		engine.DestroyBuffer(stagingBuffer);
+		return false;
+	}
+
 	outImage = UploadImage(textureInfo.pages[0].width, textureInfo.pages[0].height, format, engine, stagingBuffer, mips);
 
 	engine.DestroyBuffer(stagingBuffer);
@@ -100,11 +146,12 @@ AllocatedImage vkutil::UploadImage(int width, int height, VkFormat format, Vulka
 	imageExtent.depth = 1;
 
 	VkImageCreateInfo imageInfo = vkinit::image_create_info(format, VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT, imageExtent);
+	imageInfo.mipLevels = (uint32_t)mips.size();
 
 	VmaAllocationCreateInfo imgAllocInfo{};
 	imgAllocInfo.usage = VMA_MEMORY_USAGE_GPU_ONLY;
 
-	AllocatedImage newImage = engine.CreateImage(&imageInfo, &imgAllocInfo, format, VK_IMAGE_ASPECT_COLOR_BIT);
+	AllocatedImage newImage = engine.CreateImage(&imageInfo, &imgAllocInfo, format, VK_IMAGE_ASPECT_COLOR_BIT, (int)mips.size());
 
 	engine.ImmediateSubmit([&](VkCommandBuffer cmd) {
 		VkImageSubresourceRange range;
@@ -140,8 +187,9 @@ AllocatedImage vkutil::UploadImage(int width, int height, VkFormat format, Vulka
 			copyRegion.imageExtent = imageExtent;
 
 			vkCmdCopyBufferToImage(cmd, stagingBuffer.buffer, newImage.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &copyRegion);
-			imageExtent.width /= 2;
-			imageExtent.height /= 2;
+			//small block compressed mips still copy their full extent, which can be below the 4x4 block size
+			imageExtent.width = std::max(1u, imageExtent.width / 2);
+			imageExtent.height = std::max(1u, imageExtent.height / 2);
 		}
 
 		VkImageMemoryBarrier imageBarrierToReadable = imageBarrierToTransfer;
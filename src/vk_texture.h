@@ -1,6 +1,7 @@
 #pragma once
 #include "vk_types.h"
 #include "vk_engine.h"
+#include <asset_loader.h>
 
 namespace vkutil {
 	struct MipmapInfo
@@ -11,6 +12,8 @@ namespace vkutil {
 
 	bool LoadImageFromFile(VulkanEngine& engine, const char* file, AllocatedImage& outImage);
 	bool LoadImageFromAsset(VulkanEngine& engine, const char* file, AllocatedImage& outImage);
+	//decodedPages skips the decompression when the pages were already unpacked, like on the async loader
+	bool LoadImageFromAsset(VulkanEngine& engine, const assets::AssetView& file, const char* filename, AllocatedImage& outImage, const char* decodedPages = nullptr);
 
 	AllocatedImage UploadImage(int width, int height, VkFormat format, VulkanEngine& engine, AllocatedBufferUntyped& stagingBuffer, std::vector<MipmapInfo> mips);
 }
\ No newline at end of file